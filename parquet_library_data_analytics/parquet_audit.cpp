@@ -1,12 +1,14 @@
 // parquet_audit.cpp
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_audit.cpp -lparquet -larrow -lzstd -o parquet_audit
+//   g++ -std=gnu++23 -O3 parquet_audit.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_audit
 //
 // Usage:
 //   ./parquet_audit file.parquet
 //
 // Output: one JSON object to stdout (one line) with summary metrics.
 
+#include "parquet_reader_lib.h"
+
 #include <parquet/api/reader.h>
 
 #include <iostream>
@@ -60,8 +62,8 @@ int main(int argc, char** argv) {
   int64_t ts_min = numeric_limits<int64_t>::max();
   int64_t ts_max = numeric_limits<int64_t>::min();
   uint64_t null_ts = 0;
-  int64_t prev_ts = 0;
-  bool have_prev_ts = false;
+  GapCarry gap_carry;   // ts gaps continue across row groups
+  GapStats gap_stats({1'000'000'000LL});
   uint64_t max_gap_ns = 0;
   uint64_t gaps_gt_1s = 0;
   uint64_t gaps_gt_100ms = 0;
@@ -123,6 +125,10 @@ int main(int argc, char** argv) {
     if (idx_qty >= 0) nrows_actual = min<int64_t>(nrows_actual, (int64_t)buf_qty.size());
     if (idx_tradeId >= 0) nrows_actual = min<int64_t>(nrows_actual, (int64_t)buf_tradeId.size());
 
+    // ts gaps (>= 100ms counted, >= 1s binned)
+    if (idx_ts >= 0 && nrows_actual > 0)
+      gaps_gt_100ms += find_gaps(buf_ts.data(), (size_t)nrows_actual, 100'000'000LL, gap_carry, nullptr, &gap_stats);
+
     // Process rows
     for (int64_t i = 0; i < nrows_actual; ++i) {
       ++total_rows;
@@ -133,15 +139,6 @@ int main(int argc, char** argv) {
         // assume non-null because schema often required; if value looks like sentinel, still process
         ts_min = min(ts_min, t);
         ts_max = max(ts_max, t);
-
-        if (have_prev_ts) {
-          uint64_t gap = (t >= prev_ts) ? (uint64_t)(t - prev_ts) : 0;
-          if (gap > max_gap_ns) max_gap_ns = gap;
-          if (gap >= 1000000000ULL) ++gaps_gt_1s;
-          if (gap >= 100000000ULL) ++gaps_gt_100ms;
-        }
-        prev_ts = t;
-        have_prev_ts = true;
       } else {
         ++null_ts;
       }
@@ -180,6 +177,8 @@ int main(int argc, char** argv) {
     if (idx_qty >= 0 && (int64_t)buf_qty.size() < rows) null_counts[idx_qty] += (rows - buf_qty.size());
     if (idx_tradeId >= 0 && (int64_t)buf_tradeId.size() < rows) null_counts[idx_tradeId] += (rows - buf_tradeId.size());
   } // rg
+  max_gap_ns = gap_stats.max_gap_ns;
+  gaps_gt_1s = gap_stats.at_least(0);
 
   // Prepare output JSON
   ostringstream o;
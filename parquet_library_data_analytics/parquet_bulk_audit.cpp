@@ -1,7 +1,7 @@
 // parquet_bulk_audit.cpp
 // Scan a directory of parquet files and detect anomalies.
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_bulk_audit.cpp -lparquet -larrow -lzstd -o parquet_bulk_audit
+//   g++ -std=gnu++23 -O3 parquet_bulk_audit.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_bulk_audit
 //
 // Usage:
 //   ./parquet_bulk_audit /path/to/parquet_dir anomalies.ndjson
@@ -14,6 +14,8 @@
 // - Focuses on common numeric columns: ts, px, qty, tradeId, isMarket.
 // - Flags both explicit anomalies (missing rows, nulls, dup tradeId, non-monotonic ts) and statistical outliers.
 
+#include "parquet_reader_lib.h"
+
 #include <parquet/api/reader.h>
 
 #include <filesystem>
@@ -112,7 +114,7 @@ struct FileMetric {
 
     // additional
     uint64_t ts_samples = 0;
-    long double gap_mean = 0.0L; // computed via Welford
+    long double gap_mean = 0.0L; // sum of gaps / pairs (find_gaps)
 };
 
 // Reads single file and fills FileMetric
@@ -138,7 +140,8 @@ static bool analyze_file(const string& path, FileMetric& out)
         out.has_tradeId = (idx_tradeId >= 0);
 
         // accumulators
-        Welford gap_w;
+        GapCarry gap_carry;   // ts gaps continue across row groups
+        GapStats gap_stats({1'000'000'000LL});
         Welford px_w;
         Welford qty_w;
 
@@ -160,6 +163,9 @@ static bool analyze_file(const string& path, FileMetric& out)
             if (out.has_qty) read_i64_column(*rg_reader, idx_qty, v_qty);
             if (out.has_tradeId) read_i64_column(*rg_reader, idx_tradeId, v_tradeId);
 
+            // time gaps and monotonicity over every ts of the row group (>= 100ms counted, >= 1s binned)
+            if (out.has_ts) out.gaps_gt_100ms += find_gaps(v_ts.data(), v_ts.size(), 100'000'000LL, gap_carry, nullptr, &gap_stats);
+
             // actual rows (min across present columns)
             int64_t nrows = rows;
             if (out.has_ts) nrows = min<int64_t>(nrows, (int64_t)v_ts.size());
@@ -177,9 +183,6 @@ static bool analyze_file(const string& path, FileMetric& out)
                     ++out.ts_samples;
                     if (t < out.ts_min) out.ts_min = t;
                     if (t > out.ts_max) out.ts_max = t;
-                    if (out.ts_samples > 1) {
-                        // compute gap to previous via stored prev_ts in gap_w? We'll store prev externally
-                    }
                 } else {
                     ++out.null_ts;
                 }
@@ -226,54 +229,12 @@ static bool analyze_file(const string& path, FileMetric& out)
                     ++out.null_tradeId;
                 }
             }
-
-            // compute time gaps and monotonic checks per rowgroup to avoid storing whole column:
-            if (out.has_ts) {
-                // we may have fewer ts read than rows, use v_ts.size()
-                size_t n_ts = v_ts.size();
-                if (n_ts > 0) {
-                    // iterate ts and compute gaps and monotonicity
-                    static int64_t prev_ts_local = 0;
-                    static bool have_prev_local = false;
-                    // Note: prev_ts_local/have_prev_local are static for function scope; but to isolate per file we reset them outside loops.
-                    // We'll instead implement per-file prev_ts storage below
-                }
-            }
         } // end rowgroups
 
-        // Second pass (simpler): re-open and compute gaps & non-monotonicity (we need per-row prev_ts)
-        // We'll compute gaps, mean gap, non-monotonic count by streaming ts across rowgroups
-        {
-            int64_t prev_ts = 0;
-            bool have_prev = false;
-            Welford gap_w2;
-            unique_ptr<parquet::ParquetFileReader> reader2 = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/true);
-            auto md2 = reader2->metadata();
-            for (int rg = 0; rg < md2->num_row_groups(); ++rg) {
-                auto rg_reader = reader2->RowGroup(rg);
-                if (!out.has_ts) break;
-                vector<int64_t> v_ts;
-                read_i64_column(*rg_reader, find_col_idx(md2->schema(), "ts"), v_ts);
-                for (size_t i = 0; i < v_ts.size(); ++i) {
-                    int64_t t = v_ts[i];
-                    if (have_prev) {
-                        uint64_t gap = (t >= prev_ts) ? (uint64_t)(t - prev_ts) : 0;
-                        gap_w2.add((long double)gap);
-                        if (gap > (uint64_t)out.max_gap_ns) out.max_gap_ns = gap;
-                        if (gap >= 100000000ULL) ++out.gaps_gt_100ms;
-                        if (gap >= 1000000000ULL) ++out.gaps_gt_1s;
-                        if (t < prev_ts) ++out.non_monotonic_ts;
-                    }
-                    prev_ts = t;
-                    have_prev = true;
-                }
-            }
-            if (gap_w2.n > 0) {
-                out.gap_mean = gap_w2.mean;
-            } else {
-                out.gap_mean = 0.0L;
-            }
-        }
+        out.max_gap_ns = gap_stats.max_gap_ns;
+        out.gaps_gt_1s = gap_stats.at_least(0);
+        out.non_monotonic_ts = gap_stats.non_monotonic;
+        out.gap_mean = gap_stats.pairs ? (long double)gap_stats.sum_gap_ns / (long double)gap_stats.pairs : 0.0L;
 
         // finalize averages
         out.px_avg = (px_w.n > 0) ? (long double)px_w.mean : 0.0L;
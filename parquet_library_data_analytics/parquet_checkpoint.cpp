@@ -0,0 +1,74 @@
+// parquet_checkpoint.cpp (write/refresh <shard>.ckpt book checkpoints next to depth shards)
+// Build:
+//   g++ -std=gnu++23 -O3 parquet_checkpoint.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_checkpoint
+//
+// Usage:
+//   parquet_checkpoint <root> <symb> [markets_csv=fut,spot] [--every=SEC] [--debug]
+// Run after new depth days land; days before the first missing or stale sidecar
+// are not replayed again (the book is resumed from the previous day's last checkpoint).
+
+#include "parquet_reader_lib.h"
+
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static vector<string> split_csv(const string& s)
+{
+  vector<string> out;
+  stringstream ss(s);
+  string x;
+  while (getline(ss, x, ',')) if (!x.empty()) out.push_back(x);
+  return out;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " <root> <symb> [markets_csv=fut,spot] [--every=SEC] [--debug]\n"
+         << "        --every=SEC   checkpoint interval (default: 60)\n";
+    return 1;
+  }
+
+  const string root = argv[1];
+  const string symb = argv[2];
+  vector<string> markets = {"fut", "spot"};
+  double every_sec = 60.0;
+  bool debug = false;
+
+  int pos = 0;
+  for (int i = 3; i < argc; ++i) {
+    string a = argv[i];
+    if (a == "--debug") debug = true;
+    else if (a.rfind("--every=",0)==0) {
+      try { every_sec = stod(a.substr(8)); } catch (...) { cerr << "ERROR: bad value in " << a << "\n"; return 1; }
+      if (every_sec <= 0) { cerr << "ERROR: --every must be > 0\n"; return 1; }
+    }
+    else if (pos == 0) { markets = split_csv(a); ++pos; }
+    else { cerr << "ERROR: unexpected argument " << a << "\n"; return 1; }
+  }
+
+  ShardedDB::set_debug(debug);
+  ShardedDB db(root);
+  const int64_t every_ns = static_cast<int64_t>(every_sec * 1e9);
+
+  int rc = 0;
+  for (const auto& mkt : markets) {
+    const fs::path dir = fs::path(root) / ("depth_" + mkt) / symb;
+    if (!fs::is_directory(dir)) continue;
+    try {
+      size_t n = db.update_checkpoints(mkt, symb, every_ns);
+      cout << dir.string() << ": " << n << " files checkpointed\n";
+    } catch (const exception& e) {
+      cerr << "ERROR: " << dir.string() << " : " << e.what() << "\n";
+      rc = 2;
+    }
+  }
+  return rc;
+}
@@ -0,0 +1,199 @@
+// parquet_format_bench.cpp (rows/s of parquet_reader text output: iostream path vs TextOut)
+// Build:
+//   g++ -std=gnu++23 -O3 -DNDEBUG parquet_format_bench.cpp -o parquet_format_bench
+//
+// Usage:
+//   parquet_format_bench [--rows=N] [--reps=N] [--raw-ts] [--raw] [--precision=N] [--out=PATH]
+//
+// Formats synthetic top rows (ts;ask_px;ask_qty;bid_px;bid_qty, one tick per
+// ~1.7 ms) the way parquet_reader prints them, once through the former
+// per-row ostringstream + print_scaled1e8_fixed path and once through
+// parquet_text_out.h, and writes both to --out (default /dev/null). The two
+// outputs are compared byte for byte before timing; prints the best rep.
+
+#include "parquet_text_out.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+struct Rows
+{
+  vector<int64_t> ts, apx, aq, bpx, bq;
+};
+
+static Rows make_rows(size_t n)
+{
+  Rows r;
+  mt19937_64 g(42);
+  int64_t t  = 1'751'414'400'000'000'000LL;  // 2025-07-02
+  int64_t px = 123'456'780'000LL;             // 1234.5678 scaled 1e8
+  for (size_t i = 0; i < n; ++i)
+  {
+    t  += 1'000'000 + static_cast<int64_t>(g() % 1'500'000);
+    px += static_cast<int64_t>(g() % 2001) * 10'000 - 10'000'000;
+    r.ts.push_back(t);
+    r.apx.push_back(px + 1'000'000);
+    r.bpx.push_back(px);
+    r.aq.push_back(static_cast<int64_t>(g() % 50'000'000'000ULL));
+    r.bq.push_back(static_cast<int64_t>(g() % 50'000'000'000ULL));
+  }
+  return r;
+}
+
+// ---- the former parquet_reader path (per row: ostringstream, long double fields)
+
+static string iso_from_ns_ms(int64_t ns)
+{
+  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
+  int64_t ms = (ns / 1'000'000LL) % 1000;
+  tm tm{}; gmtime_r(&s, &tm);
+  ostringstream o;
+  o << setfill('0')
+    << setw(4) << (tm.tm_year + 1900) << '-'
+    << setw(2) << (tm.tm_mon + 1) << '-'
+    << setw(2) << tm.tm_mday << 'T'
+    << setw(2) << tm.tm_hour << ':'
+    << setw(2) << tm.tm_min  << ':'
+    << setw(2) << tm.tm_sec  << '.'
+    << setw(3) << ms << 'Z';
+  return o.str();
+}
+
+static void print_scaled1e8_fixed(ostream& os, int64_t raw, int precision)
+{
+  ios::fmtflags f = os.flags();
+  auto p = os.precision();
+  os.setf(ios::fixed);
+  os << setprecision(precision) << (static_cast<long double>(raw) / 1'0000'0000.0L);
+  os.flags(f);
+  os.precision(p);
+}
+
+struct Cfg
+{
+  bool raw_ts = false;
+  bool raw = false;
+  int precision = 8;
+};
+
+static void run_iostream(const Rows& r, const Cfg& c, ostream& out)
+{
+  auto val = [&](ostream& os, int64_t v) { if (c.raw) os << v; else print_scaled1e8_fixed(os, v, c.precision); };
+  for (size_t i = 0; i < r.ts.size(); ++i)
+  {
+    ostringstream os;
+    if (c.raw_ts) os << r.ts[i]; else os << iso_from_ns_ms(r.ts[i]);
+    os << ';'; val(os, r.apx[i]);
+    os << ';'; val(os, r.aq[i]);
+    os << ';'; val(os, r.bpx[i]);
+    os << ';'; val(os, r.bq[i]);
+    out << os.str() << '\n';
+  }
+  out.flush();
+}
+
+// ---- TextOut path
+
+static void run_textout(const Rows& r, const Cfg& c, TextOut& out)
+{
+  auto val = [&](int64_t v) { if (c.raw) out.put_i64(v); else out.put_fixed(v, 8, c.precision); };
+  for (size_t i = 0; i < r.ts.size(); ++i)
+  {
+    if (c.raw_ts) out.put_i64(r.ts[i]); else out.put_iso_ms(r.ts[i]);
+    out.put(';'); val(r.apx[i]);
+    out.put(';'); val(r.aq[i]);
+    out.put(';'); val(r.bpx[i]);
+    out.put(';'); val(r.bq[i]);
+    out.end_line();
+  }
+  out.flush();
+}
+
+int main(int argc, char** argv)
+{
+  size_t rows = 2'000'000;
+  int reps = 3;
+  Cfg cfg;
+  string out_path = "/dev/null";
+
+  for (int i = 1; i < argc; ++i) {
+    string a = argv[i];
+    try {
+      if (a.rfind("--rows=",0)==0)           rows = static_cast<size_t>(stoull(a.substr(7)));
+      else if (a.rfind("--reps=",0)==0)      reps = max(1, stoi(a.substr(7)));
+      else if (a=="--raw-ts")                cfg.raw_ts = true;
+      else if (a=="--raw")                   cfg.raw = true;
+      else if (a.rfind("--precision=",0)==0) cfg.precision = max(0, stoi(a.substr(12)));
+      else if (a.rfind("--out=",0)==0)       out_path = a.substr(6);
+      else { cerr << "ERROR: unknown argument " << a << "\n"; return 1; }
+    } catch (...) { cerr << "ERROR: bad value in " << a << "\n"; return 1; }
+  }
+
+  const Rows r = make_rows(rows);
+
+  // Same bytes from both paths (on a 100k-row prefix)
+  double row_bytes = 0;
+  {
+    Rows head = r;
+    for (auto* v : {&head.ts, &head.apx, &head.aq, &head.bpx, &head.bq}) v->resize(min<size_t>(rows, 100'000));
+    ostringstream a;
+    run_iostream(head, cfg, a);
+    TextOut b;
+    run_textout(head, cfg, b);
+    if (a.str() != b.view()) { cerr << "ERROR: TextOut output differs from the iostream path\n"; return 2; }
+    row_bytes = head.ts.empty() ? 0.0 : static_cast<double>(a.str().size()) / head.ts.size();
+  }
+
+  FILE* f = fopen(out_path.c_str(), "wb");
+  if (!f) { cerr << "ERROR: cannot open " << out_path << "\n"; return 1; }
+
+  cout << left << setw(12) << "path" << right << setw(12) << "rows" << setw(10) << "sec"
+       << setw(12) << "Mrows/s" << setw(10) << "MB/s" << "\n";
+
+  for (const char* path : {"iostream", "textout"})
+  {
+    double best = 0.0;
+    for (int k = 0; k < reps; ++k)
+    {
+      rewind(f);
+      auto t0 = chrono::steady_clock::now();
+      if (string(path) == "iostream")
+      {
+        // stdio-backed stream over the same FILE*, as cout writes to stdout
+        struct FileBuf : streambuf {
+          FILE* f;
+          explicit FileBuf(FILE* fp) : f(fp) {}
+          int_type overflow(int_type c) override { return c == traits_type::eof() ? 0 : fputc(c, f); }
+          streamsize xsputn(const char* s, streamsize n) override { return static_cast<streamsize>(fwrite(s, 1, static_cast<size_t>(n), f)); }
+        } fb(f);
+        ostream os(&fb);
+        run_iostream(r, cfg, os);
+      }
+      else
+      {
+        TextOut out(f);
+        run_textout(r, cfg, out);
+      }
+      fflush(f);
+      double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+      if (k == 0 || sec < best) best = sec;
+    }
+
+    cout << left << setw(12) << path << right << setw(12) << rows << setw(10) << fixed << setprecision(3) << best
+         << setw(12) << setprecision(2) << (best > 0 ? rows / best / 1e6 : 0.0)
+         << setw(10) << setprecision(0) << (best > 0 ? rows * row_bytes / best / 1e6 : 0.0) << "\n";
+  }
+  fclose(f);
+  return 0;
+}
@@ -0,0 +1,69 @@
+// parquet_manifest.cpp (write/refresh _manifest.tsv shard indexes used by ShardedDB discovery)
+// Build:
+//   g++ -std=gnu++23 -O3 parquet_manifest.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_manifest
+//
+// Usage:
+//   parquet_manifest <root> <symb> [kinds_csv=top,trade,depth] [markets_csv=fut,spot] [--debug]
+// Run after new days land; only new or rewritten files are opened.
+
+#include "parquet_reader_lib.h"
+
+#include <filesystem>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static vector<string> split_csv(const string& s)
+{
+  vector<string> out;
+  stringstream ss(s);
+  string x;
+  while (getline(ss, x, ',')) if (!x.empty()) out.push_back(x);
+  return out;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 3) {
+    cerr << "Usage: " << argv[0] << " <root> <symb> [kinds_csv=top,trade,depth] [markets_csv=fut,spot] [--debug]\n";
+    return 1;
+  }
+
+  const string root = argv[1];
+  const string symb = argv[2];
+  vector<string> kinds   = {"top", "trade", "depth"};
+  vector<string> markets = {"fut", "spot"};
+  bool debug = false;
+
+  int pos = 0;
+  for (int i = 3; i < argc; ++i) {
+    string a = argv[i];
+    if (a == "--debug") debug = true;
+    else if (pos == 0) { kinds = split_csv(a); ++pos; }
+    else if (pos == 1) { markets = split_csv(a); ++pos; }
+    else { cerr << "ERROR: unexpected argument " << a << "\n"; return 1; }
+  }
+
+  ShardedDB::set_debug(debug);
+  ShardedDB db(root);
+
+  int rc = 0;
+  for (const auto& kind : kinds) {
+    for (const auto& mkt : markets) {
+      const fs::path dir = fs::path(root) / (kind + "_" + mkt) / symb;
+      if (!fs::is_directory(dir)) continue;
+      try {
+        size_t n = db.update_manifest(kind, mkt, symb);
+        cout << dir.string() << ": " << n << " files\n";
+      } catch (const exception& e) {
+        cerr << "ERROR: " << dir.string() << " : " << e.what() << "\n";
+        rc = 2;
+      }
+    }
+  }
+  return rc;
+}
@@ -4,9 +4,12 @@
 //   g++ -std=gnu++23 -O3 -DNDEBUG -march=native -mtune=native -flto=auto -fno-plt parquet_reader.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_reader -g
 
 #include "parquet_reader_lib.h"
+#include "parquet_text_out.h"
 
 #include <arrow/api.h>
+#include <arrow/c/bridge.h>
 #include <arrow/io/api.h>
+#include <arrow/ipc/writer.h>
 #include <parquet/api/reader.h>
 
 #include <cctype>
@@ -26,6 +29,11 @@
 #include <algorithm>
 #include <fstream>
 #include <chrono>  // perf timing
+#include <future>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
 
 #if defined(__linux__)
   #include <fcntl.h>
@@ -38,19 +46,28 @@ namespace fs = std::filesystem;
 
 // ---------- OS + prefetch helpers (Linux) ----------
 
-static inline void prefetch_path(const std::string& path) {
+// Hint the chunks of the given columns to the kernel, up to budget bytes
+static void hint_columns(const std::string& path, const parquet::FileMetaData& md,
+                         const vector<int>& cols, size_t budget) {
 #if defined(__linux__)
   int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
   if (fd < 0) return;
-  struct stat st{};
-  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
-    readahead(fd, 0, static_cast<size_t>(st.st_size));
+  for (int rg = 0; rg < md.num_row_groups() && budget > 0; ++rg) {
+    auto rmd = md.RowGroup(rg);
+    for (int c : cols) {
+      if (c < 0 || budget == 0) continue;
+      auto cc = rmd->ColumnChunk(c);
+      int64_t off = cc->data_page_offset();
+      if (cc->has_dictionary_page() && cc->dictionary_page_offset() > 0 && cc->dictionary_page_offset() < off)
+        off = cc->dictionary_page_offset();
+      size_t len = std::min(static_cast<size_t>(cc->total_compressed_size()), budget);
+      posix_fadvise(fd, off, static_cast<off_t>(len), POSIX_FADV_WILLNEED);
+      budget -= len;
+    }
   }
   ::close(fd);
 #else
-  (void)path;
+  (void)path; (void)md; (void)cols; (void)budget;
 #endif
 }
 
@@ -116,23 +133,6 @@ static string iso_from_ns(int64_t ns) {
   return o.str();
 }
 
-// Human ISO8601 with milliseconds
-static string iso_from_ns_ms(int64_t ns) {
-  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
-  int64_t ms = (ns / 1'000'000LL) % 1000;
-  tm tm{}; gmtime_r(&s, &tm);
-  ostringstream o;
-  o << setfill('0')
-    << setw(4) << (tm.tm_year + 1900) << '-'
-    << setw(2) << (tm.tm_mon + 1) << '-'
-    << setw(2) << tm.tm_mday << 'T'
-    << setw(2) << tm.tm_hour << ':'
-    << setw(2) << tm.tm_min  << ':'
-    << setw(2) << tm.tm_sec  << '.'
-    << setw(3) << ms << 'Z';
-  return o.str();
-}
-
 static inline int64_t to_ns(double sec){
   long double x = static_cast<long double>(sec) * 1'000'000'000.0L;
   if (x < static_cast<long double>(numeric_limits<int64_t>::min())) return numeric_limits<int64_t>::min();
@@ -157,42 +157,32 @@ struct PrintCfg {
   bool header = false;                 // print header row
 };
 
-static void print_ts_fmt(ostream& os, int64_t ns, TsFormat fmt) {
+static void print_ts_fmt(TextOut& os, int64_t ns, TsFormat fmt) {
   if (fmt == TsFormat::Human) {
-    os << iso_from_ns_ms(ns);
+    os.put_iso_ms(ns);       // ISO with .mmm
   } else {
-    os << ns; // raw nanoseconds
+    os.put_i64(ns); // raw nanoseconds
   }
 }
 
-static void print_scaled1e8_fixed(ostream& os, int64_t raw, int precision) {
-  std::ios::fmtflags f = os.flags();
-  auto p = os.precision();
-  os.setf(std::ios::fixed);
-  os << setprecision(precision) << (static_cast<long double>(raw) / 1'0000'0000.0L);
-  os.flags(f);
-  os.precision(p);
+static void print_scaled1e8_fixed(TextOut& os, int64_t raw, int precision) {
+  os.put_fixed(raw, 8, precision);
 }
 
-static inline void print_px_val(ostream& os, int64_t raw, const PrintCfg& pcfg) {
+static inline void print_px_val(TextOut& os, int64_t raw, const PrintCfg& pcfg) {
   if (pcfg.pxqty_double && !pcfg.raw_override) print_scaled1e8_fixed(os, raw, pcfg.precision_px);
-  else os << raw;
+  else os.put_i64(raw);
 }
-static inline void print_qty_val(ostream& os, int64_t raw, const PrintCfg& pcfg) {
+static inline void print_qty_val(TextOut& os, int64_t raw, const PrintCfg& pcfg) {
   if (pcfg.pxqty_double && !pcfg.raw_override) print_scaled1e8_fixed(os, raw, pcfg.precision_qty);
-  else os << raw;
+  else os.put_i64(raw);
 }
 
-static inline void print_gap_s_ms(ostream& os, int64_t dt_ns) {
-  std::ios::fmtflags f = os.flags();
-  auto p = os.precision();
-  os.setf(std::ios::fixed);
-  os << setprecision(3) << (static_cast<long double>(dt_ns) / 1'000'000'000.0L);
-  os.flags(f);
-  os.precision(p);
+static inline void print_gap_s_ms(TextOut& os, int64_t dt_ns) {
+  os.put_fixed(dt_ns, 9, 3);
 }
 
-static inline void print_prefix(ostream& os,
+static inline void print_prefix(TextOut& os,
                                 const PrintCfg& pcfg,
                                 const string* /*filename1_opt*/,
                                 const string* /*filename2_opt*/,
@@ -202,21 +192,130 @@ static inline void print_prefix(ostream& os,
   bool need_idx = (pcfg.idx_mode != IdxMode::None);
   if (!need_idx) return;
 
-  bool first = true;
-  auto put = [&](const string& s){
-    if (!first) os << " ;";
-    os << s;
-    first = false;
-  };
-
   if (pcfg.idx_mode == IdxMode::Raw && idx1.has_value() && idx2.has_value()) {
-    put(to_string(*idx1) + "," + to_string(*idx2));
+    os.put_u64(*idx1); os.put(','); os.put_u64(*idx2);
   } else if (idx1.has_value()) {
-    put(to_string(*idx1));
+    os.put_u64(*idx1);
   } else {
-    put("-");
+    os.put('-');
   }
-  os << " ;";
+  os.put(" ;");
+}
+
+// Gap-mode edge row: first;last;gap
+static inline void print_edge(TextOut& os, const TextOut& first, const TextOut& last, int64_t dt_ns) {
+  os.put(first.view()); os.put(';');
+  os.put(last.view());  os.put(';');
+  print_gap_s_ms(os, dt_ns);
+  os.end_line();
+}
+
+// ---------- binary output (--out-format=arrow-ipc|raw) ----------
+
+enum class OutFormat { Text, ArrowIpc, Raw };
+
+// Streams reader batches (export_arrow, zero-copy) to stdout or a file, either
+// as an Arrow IPC stream or as raw column blocks. Raw layout, native byte
+// order, one block per batch:
+//   "PQRB" u32 ncols u64 nrows, then per column:
+//   u16 name_len, name, u8 type ('l' int64, 'C' uint8, 'I' uint32), u64 count, values
+// A depth side becomes <side>.off (uint32, nrows + 1, from 0) + <side>.px / <side>.qty.
+class BatchSink {
+public:
+  BatchSink(OutFormat fmt, const string& path) : fmt_(fmt) {
+    shared_ptr<arrow::io::FileOutputStream> f;
+    if (path.empty() || path == "-") { PARQUET_ASSIGN_OR_THROW(f, arrow::io::FileOutputStream::Open(1)); }
+    else                             { PARQUET_ASSIGN_OR_THROW(f, arrow::io::FileOutputStream::Open(path)); }
+    PARQUET_ASSIGN_OR_THROW(out_, arrow::io::BufferedOutputStream::Create(1 << 20, arrow::default_memory_pool(), f));
+  }
+
+  // Takes ownership of a and s (both released here)
+  void write(ArrowArray* a, ArrowSchema* s) {
+    if (fmt_ == OutFormat::Raw) {
+      try { write_raw(*a, *s); } catch (...) { a->release(a); s->release(s); throw; }
+      a->release(a);
+      s->release(s);
+      return;
+    }
+    PARQUET_ASSIGN_OR_THROW(auto batch, arrow::ImportRecordBatch(a, s));
+    if (!ipc_) { PARQUET_ASSIGN_OR_THROW(ipc_, arrow::ipc::MakeStreamWriter(out_, batch->schema())); }
+    PARQUET_THROW_NOT_OK(ipc_->WriteRecordBatch(*batch));
+  }
+
+  void close() {
+    if (ipc_) PARQUET_THROW_NOT_OK(ipc_->Close());
+    PARQUET_THROW_NOT_OK(out_->Close());
+  }
+
+private:
+  void bytes(const void* p, size_t n) { PARQUET_THROW_NOT_OK(out_->Write(p, static_cast<int64_t>(n))); }
+
+  void block(const string& name, char type, const void* p, uint64_t count, size_t width) {
+    const uint16_t len = static_cast<uint16_t>(name.size());
+    bytes(&len, sizeof len);
+    bytes(name.data(), name.size());
+    bytes(&type, 1);
+    bytes(&count, sizeof count);
+    bytes(p, count * width);
+  }
+
+  void write_raw(const ArrowArray& a, const ArrowSchema& s) {
+    const uint64_t n = static_cast<uint64_t>(a.length);
+    uint32_t ncols = 0;
+    for (int64_t k = 0; k < a.n_children; ++k) {
+      const bool list = string(s.children[k]->format) == "+l";
+      ncols += list ? 1 + static_cast<uint32_t>(a.children[k]->children[0]->n_children) : 1;
+    }
+    bytes("PQRB", 4);
+    bytes(&ncols, sizeof ncols);
+    bytes(&n, sizeof n);
+
+    for (int64_t k = 0; k < a.n_children; ++k) {
+      const ArrowArray& c = *a.children[k];
+      const ArrowSchema& cs = *s.children[k];
+      const string fmt = cs.format;
+      if (fmt == "l") {
+        block(cs.name, 'l', static_cast<const int64_t*>(c.buffers[1]) + c.offset, n, sizeof(int64_t));
+      } else if (fmt == "C") {
+        block(cs.name, 'C', static_cast<const uint8_t*>(c.buffers[1]) + c.offset, n, sizeof(uint8_t));
+      } else if (fmt == "+l") {
+        const uint32_t* off = static_cast<const uint32_t*>(c.buffers[1]) + c.offset;
+        off_.resize(n + 1);
+        for (uint64_t i = 0; i <= n; ++i) off_[i] = off[i] - off[0];
+        block(string(cs.name) + ".off", 'I', off_.data(), n + 1, sizeof(uint32_t));
+
+        const ArrowArray& elem = *c.children[0];
+        const ArrowSchema& elem_s = *cs.children[0];
+        for (int64_t j = 0; j < elem.n_children; ++j)
+          block(string(cs.name) + "." + elem_s.children[j]->name, 'l',
+                static_cast<const int64_t*>(elem.children[j]->buffers[1]) + off[0], off[n] - off[0], sizeof(int64_t));
+      } else {
+        throw runtime_error("raw output: unsupported column format " + fmt);
+      }
+    }
+  }
+
+  OutFormat fmt_;
+  shared_ptr<arrow::io::OutputStream> out_;
+  shared_ptr<arrow::ipc::RecordBatchWriter> ipc_;
+  vector<uint32_t> off_;  // rebased list offsets of one batch
+};
+
+// Every batch of rdr through a BatchSink; returns rows written
+template <class Reader, class View>
+static uint64_t dump_binary(Reader& rdr, OutFormat fmt, const string& path) {
+  BatchSink sink(fmt, path);
+  View v{};
+  uint64_t rows = 0;
+  while (rdr.next(v)) {
+    ArrowArray a;
+    ArrowSchema s;
+    if (!rdr.export_arrow(&a, &s)) break;
+    sink.write(&a, &s);
+    rows += v.n;
+  }
+  sink.close();
+  return rows;
 }
 
 // ---------- file-open printer with raw idx + perf (M rec/s) ----------
@@ -276,6 +375,295 @@ struct FnPrinter {
   }
 };
 
+static void print_reader_stats(const char* kind, const ReaderStats& st) {
+  cerr << "[debug] " << kind << " stats: files=" << st.files_opened
+       << " rg_decoded=" << st.row_groups_decoded
+       << " rg_skipped=" << st.row_groups_skipped
+       << " rows_decoded=" << st.rows_decoded
+       << " rows_emitted=" << st.rows_emitted
+       << " batches=" << st.batches
+       << " scratch_allocs=" << st.scratch_allocs << "\n";
+
+  const ChunkCacheStats cc = ShardedDB::chunk_cache_stats();
+  if (cc.budget_bytes)
+    cerr << "[debug] chunk cache: hits=" << cc.hits << " misses=" << cc.misses
+         << " evictions=" << cc.evictions << " entries=" << cc.entries
+         << " bytes=" << cc.bytes << "/" << cc.budget_bytes << "\n";
+}
+
+static void add_reader_stats(ReaderStats& into, const ReaderStats& st) {
+  into.files_opened       += st.files_opened;
+  into.row_groups_skipped += st.row_groups_skipped;
+  into.row_groups_decoded += st.row_groups_decoded;
+  into.rows_decoded       += st.rows_decoded;
+  into.rows_emitted       += st.rows_emitted;
+  into.scratch_allocs     += st.scratch_allocs;
+  into.batches            += st.batches;
+}
+
+// ---------- ordered parallel scan (--threads=N[,SEC]) ----------
+//
+// The window is cut into slices (px: month files; otherwise one reader per
+// market x SEC of UTC time, default a day), each formatted on a worker into a
+// Chunk with slice-local raw row numbers (1-based). The emitter takes the
+// chunks in scan order and adds what depends on the rows before them: raw and
+// printed idx, --seen_every, the gap edge across the slice boundary and the
+// FIRST/LAST edges, so stdout is byte-identical to the sequential loops.
+// Sequential gap mode uses the same pieces with one chunk per batch.
+
+struct Chunk {
+  TextOut text;                               // non-gap: rows; gap: edges inside the slice
+  vector<size_t> line_end;                    // end of each line of text (only when prefixes are needed)
+  vector<pair<uint64_t, uint64_t>> line_raw;  // local raw idx per line: (row, 0) or gap (prev, cur)
+  vector<pair<string, uint64_t>> files;       // --print-fn: file and local raw idx before its first row
+  uint64_t rows = 0;                          // rows in the window
+  bool any = false;                           // gap mode: first/last below are set
+  int64_t first_ts = 0, last_ts = 0;
+  TextOut first_line, last_line;
+  string note;                                // stderr text, replayed in order
+  string error;
+};
+
+class ChunkBuilder {
+public:
+  ChunkBuilder(Chunk& c, const PrintCfg& pcfg, bool lines) : c_(c), gap_(pcfg.gap_ns), lines_(lines) {}
+
+  void file(string fn) {
+    if (c_.files.empty() || c_.files.back().first != fn) c_.files.emplace_back(std::move(fn), c_.rows);
+  }
+
+  // A window row that is not printed (px --seen_every)
+  void skip() { ++c_.rows; }
+
+  // Non-gap mode: one printed row
+  template <class Render>
+  void row(size_t i, Render& render) {
+    ++c_.rows;
+    render(c_.text, i);
+    c_.text.end_line();
+    if (lines_) line(c_.rows, 0);
+  }
+
+  // Gap mode: the next n rows of the slice (ts[k] is rendered by render(os, k)).
+  // find_gaps carries the previous block's last row, whose text is kept in last_line.
+  template <class Render>
+  void block(const int64_t* ts, size_t n, Render& render) {
+    if (n == 0) return;
+    const uint64_t base = c_.rows;
+    find_gaps(ts, n, *gap_, carry_, &gaps_);
+    if (!c_.any) { render(c_.first_line, 0); c_.any = true; c_.first_ts = ts[0]; }
+    for (uint32_t k : gaps_) {
+      const TextOut* prev = &c_.last_line;
+      if (k > 0) { prev_.clear(); render(prev_, k - 1); prev = &prev_; }
+      cur_.clear(); render(cur_, k);
+      print_edge(c_.text, *prev, cur_, ts[k] - (k > 0 ? ts[k - 1] : c_.last_ts));
+      if (lines_) line(base + k, base + k + 1);
+    }
+    c_.last_line.clear(); render(c_.last_line, n - 1);
+    c_.last_ts = ts[n - 1];
+    c_.rows += n;
+  }
+
+private:
+  void line(uint64_t raw1, uint64_t raw2) {
+    c_.line_end.push_back(c_.text.view().size());
+    c_.line_raw.emplace_back(raw1, raw2);
+  }
+
+  Chunk& c_;
+  optional<int64_t> gap_;
+  bool lines_;
+  GapCarry carry_;
+  vector<uint32_t> gaps_;
+  TextOut prev_, cur_;
+};
+
+class OrderedEmitter {
+public:
+  // seen_every: applied to the running raw idx, as the top/trade loops do
+  OrderedEmitter(TextOut& out, const PrintCfg& pcfg, uint64_t seen_every)
+  : out_(out), pcfg_(pcfg), seen_every_(seen_every) { fnp_.enabled = pcfg.print_fn; }
+
+  // Whether chunks must keep per-line offsets / raw idx
+  bool needs_lines() const {
+    return pcfg_.idx_mode != IdxMode::None || (!pcfg_.gap_ns && seen_every_ > 1);
+  }
+
+  void emit(Chunk& c) {
+    for (const auto& [fn, at] : c.files) fnp_.open(fn, raw_ + at);
+    if (!c.note.empty()) cerr << c.note;
+    if (pcfg_.gap_ns) emit_gap(c); else emit_rows(c);
+    raw_ += c.rows;
+  }
+
+  void finish() {
+    if (have_prev_) {   // LAST edge
+      prefix(prev_raw_, prev_raw_);
+      print_edge(out_, prev_line_, prev_line_, 0);
+    }
+    fnp_.finish(raw_);
+  }
+
+private:
+  void prefix(uint64_t raw1, optional<uint64_t> raw2) {
+    ++printed_;
+    optional<uint64_t> idx = pcfg_.idx_mode==IdxMode::Printed ? optional<uint64_t>(printed_) :
+                             pcfg_.idx_mode==IdxMode::Raw ? optional<uint64_t>(raw1) : nullopt;
+    print_prefix(out_, pcfg_, nullptr, nullptr, idx, pcfg_.idx_mode==IdxMode::Raw ? raw2 : nullopt);
+  }
+
+  // Lines of c.text, each prefixed with raw1 (+ raw2 in gap mode) shifted to the running idx
+  void emit_lines(const Chunk& c, bool gap) {
+    const string_view text = c.text.view();
+    size_t from = 0;
+    for (size_t k = 0; k < c.line_end.size(); ++k) {
+      const size_t to = c.line_end[k];
+      const uint64_t raw1 = raw_ + c.line_raw[k].first;
+      if (gap || raw1 % seen_every_ == 0) {
+        prefix(raw1, gap ? optional<uint64_t>(raw_ + c.line_raw[k].second) : nullopt);
+        out_.put(text.substr(from, to - 1 - from));
+        out_.end_line();
+      }
+      from = to;
+    }
+  }
+
+  void emit_rows(const Chunk& c) {
+    if (needs_lines()) emit_lines(c, false);
+    else out_.put_lines(c.text.view());
+  }
+
+  void emit_gap(Chunk& c) {
+    if (!c.any) return;
+    const uint64_t first = raw_ + 1;
+    if (!have_prev_) {   // FIRST edge
+      prefix(first, first);
+      print_edge(out_, c.first_line, c.first_line, 0);
+    } else if (c.first_ts - prev_ts_ >= *pcfg_.gap_ns) {
+      prefix(prev_raw_, first);
+      print_edge(out_, prev_line_, c.first_line, c.first_ts - prev_ts_);
+    }
+    if (needs_lines()) emit_lines(c, true);
+    else out_.put_lines(c.text.view());
+
+    have_prev_ = true;
+    prev_ts_ = c.last_ts;
+    prev_raw_ = raw_ + c.rows;
+    prev_line_ = std::move(c.last_line);
+  }
+
+  TextOut& out_;
+  const PrintCfg& pcfg_;
+  uint64_t seen_every_;
+  FnPrinter fnp_;
+  uint64_t raw_ = 0;
+  uint64_t printed_ = 0;
+  bool have_prev_ = false;
+  int64_t prev_ts_ = 0;
+  uint64_t prev_raw_ = 0;
+  TextOut prev_line_;
+};
+
+// fill(k, chunk) for k in [0, n) on `threads` workers, emit(chunk) in order of
+// k on this thread. Workers run at most 2*threads chunks ahead of the emitter,
+// which bounds the formatted text held in memory. A fill() that throws stops
+// the scan; the error is rethrown here once the workers have exited.
+template <class Fill, class Emit>
+static void run_ordered(size_t n, unsigned threads, Fill fill, Emit emit) {
+  mutex m;
+  condition_variable cv;
+  vector<unique_ptr<Chunk>> done(n);
+  size_t next = 0, emitted = 0;
+  bool stop = false;
+  const size_t window = 2 * static_cast<size_t>(threads);
+
+  auto worker = [&] {
+    for (;;) {
+      size_t k = 0;
+      {
+        unique_lock<mutex> lk(m);
+        cv.wait(lk, [&] { return stop || next >= n || next < emitted + window; });
+        if (stop || next >= n) return;
+        k = next++;
+      }
+      auto c = make_unique<Chunk>();
+      try { fill(k, *c); }
+      catch (const exception& e) { c->error = e.what(); if (c->error.empty()) c->error = "scan failed"; }
+      { lock_guard<mutex> lk(m); done[k] = std::move(c); }
+      cv.notify_all();
+    }
+  };
+
+  vector<thread> pool;
+  for (unsigned t = 0; t < threads && t < n; ++t) pool.emplace_back(worker);
+
+  string error;
+  for (size_t k = 0; k < n && error.empty(); ++k) {
+    unique_ptr<Chunk> c;
+    {
+      unique_lock<mutex> lk(m);
+      cv.wait(lk, [&] { return done[k] != nullptr; });
+      c = std::move(done[k]);
+      ++emitted;
+    }
+    cv.notify_all();
+    if (!c->error.empty()) { error = c->error; break; }
+    try { emit(*c); }
+    catch (const exception& e) { error = e.what(); }
+  }
+
+  { lock_guard<mutex> lk(m); stop = true; }
+  cv.notify_all();
+  for (auto& t : pool) t.join();
+  if (!error.empty()) throw runtime_error(error);
+}
+
+struct Slice {
+  string market;
+  int64_t start_ns, end_ns;
+};
+
+// Both markets (fut, then spot) unless one is given, as the readers list them;
+// slice_ns-aligned pieces in UTC. Relies on the daily-shard layout (each file
+// holds its UTC day), so no file contributes rows to two slices out of order.
+static vector<Slice> make_slices(const optional<string>& market, int64_t start_ns, int64_t end_ns, int64_t slice_ns) {
+  vector<string> markets;
+  if (market) markets.push_back(*market); else markets = {"fut", "spot"};
+  vector<Slice> out;
+  for (const string& mkt : markets) {
+    int64_t s = start_ns - ((start_ns % slice_ns) + slice_ns) % slice_ns;
+    for (; s < end_ns; s += slice_ns)
+      out.push_back(Slice{mkt, max(s, start_ns), min(s + slice_ns, end_ns)});
+  }
+  return out;
+}
+
+// One reader per slice (open(slice)), rows rendered by render(os, view, i)
+template <class View, class Open, class Render>
+static ReaderStats scan_ordered(const vector<Slice>& slices, unsigned threads, TextOut& out,
+                                const PrintCfg& pcfg, uint64_t seen_every, Open open, Render render) {
+  OrderedEmitter em(out, pcfg, seen_every);
+  ReaderStats total;
+  mutex m;
+  run_ordered(slices.size(), threads,
+    [&](size_t k, Chunk& c) {
+      auto rdr = open(slices[k]);
+      View v{};
+      ChunkBuilder b(c, pcfg, em.needs_lines());
+      auto row = [&](TextOut& os, size_t i) { render(os, v, i); };
+      while (rdr->next(v)) {
+        if (pcfg.print_fn) b.file(v.file ? v.file : string("-"));
+        if (pcfg.gap_ns) b.block(v.ts, v.n, row);
+        else for (size_t i=0;i<v.n;++i) b.row(i, row);
+      }
+      lock_guard<mutex> lk(m);
+      add_reader_stats(total, rdr->stats());
+    },
+    [&](Chunk& c) { em.emit(c); });
+  em.finish();
+  return total;
+}
+
 // ---------- parse TYPE ----------
 
 struct ParsedType {
@@ -366,6 +754,64 @@ static TradeSelect make_trade_select_from_csv(const string& csv)
   return sel;
 }
 
+// ---------- --where -> row filters ----------
+
+// "qty>500000000,isMarket=1": terms ANDed, ops < <= > >= = !=, raw int64 values
+template <class Field>
+static vector<Term<Field>> parse_where(const string& expr, optional<Field> (*field)(const string&))
+{
+  vector<Term<Field>> out;
+  for (const string& t : split_csv(expr)) {
+    size_t p = t.find_first_of("<>=!");
+    if (p == string::npos || p == 0) throw runtime_error("bad --where term: " + t);
+    size_t q = p + 1;
+    if (q < t.size() && t[q] == '=') ++q;
+
+    const string op = t.substr(p, q - p);
+    CmpOp o;
+    if (op=="<") o = CmpOp::Lt;
+    else if (op=="<=") o = CmpOp::Le;
+    else if (op==">") o = CmpOp::Gt;
+    else if (op==">=") o = CmpOp::Ge;
+    else if (op=="=" || op=="==") o = CmpOp::Eq;
+    else if (op=="!=") o = CmpOp::Ne;
+    else throw runtime_error("bad --where operator in " + t);
+
+    auto f = field(norm_token(t.substr(0, p)));
+    if (!f) throw runtime_error("unknown --where column in " + t);
+    int64_t v = 0;
+    try { v = stoll(t.substr(q)); } catch (...) { throw runtime_error("bad --where value in " + t); }
+    out.push_back(Term<Field>{*f, o, v});
+  }
+  return out;
+}
+
+static optional<TopField> top_field(const string& k)
+{
+  if (k=="ts"||k=="time") return TopField::ts;
+  if (k=="askpx"||k=="ask"||k=="askprice") return TopField::ask_px;
+  if (k=="askqty"||k=="asksize") return TopField::ask_qty;
+  if (k=="bidpx"||k=="bid"||k=="bidprice") return TopField::bid_px;
+  if (k=="bidqty"||k=="bidsize") return TopField::bid_qty;
+  if (k=="valu"||k=="value") return TopField::valu;
+  if (k=="spread") return TopField::spread;
+  return nullopt;
+}
+
+static optional<TradeField> trade_field(const string& k)
+{
+  if (k=="ts"||k=="time") return TradeField::ts;
+  if (k=="px"||k=="price") return TradeField::px;
+  if (k=="qty"||k=="size"||k=="quantity") return TradeField::qty;
+  if (k=="tradeid"||k=="tid") return TradeField::tradeId;
+  if (k=="buyerorderid"||k=="boid") return TradeField::buyerOrderId;
+  if (k=="sellerorderid"||k=="soid") return TradeField::sellerOrderId;
+  if (k=="tradetime"||k=="ttime") return TradeField::tradeTime;
+  if (k=="ismarket"||k=="market") return TradeField::isMarket;
+  if (k=="eventtime"||k=="evt"||k=="event") return TradeField::eventTime;
+  return nullopt;
+}
+
 // ---------- Parquet (px) helpers ----------
 
 static int find_col_idx(const parquet::SchemaDescriptor* schema, const string& name) {
@@ -417,21 +863,101 @@ static vector<PxFile> list_px_months(const string& root, const string& symb, con
 
 // ----- helpers to render rows to strings -----
 
-static string render_px_row_content(int64_t ts, int64_t ap, int64_t bp,
-                                    bool need_ts, bool need_ask, bool need_bid,
-                                    const PrintCfg& pcfg)
+static void render_px_row_content(TextOut& os, int64_t ts, int64_t ap, int64_t bp,
+                                  bool need_ts, bool need_ask, bool need_bid,
+                                  const PrintCfg& pcfg)
 {
-  ostringstream os;
   bool first = true;
-  auto put_sep = [&]{ if (!first) os<<';'; first=false; };
+  auto put_sep = [&]{ if (!first) os.put(';'); first=false; };
 
   if (need_ts) { put_sep(); print_ts_fmt(os, ts, pcfg.ts_fmt); }
   if (need_ask){ put_sep(); print_px_val(os, ap, pcfg); }
   if (need_bid){ put_sep(); print_px_val(os, bp, pcfg); }
-  return os.str();
+}
+
+// One row of each ShardedDB reader as printed (columns present in the view)
+static void render_top_row(TextOut& os, const TopColsView& v, size_t i, bool have_ts_to_print, const PrintCfg& pcfg)
+{
+  bool first = true;
+  auto put_sep=[&]{ if(!first) os.put(';'); first=false; };
+
+  if (v.ts && have_ts_to_print) { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
+  if (v.ask_px){ put_sep(); print_px_val(os, v.ask_px[i], pcfg); }
+  if (v.ask_qty){ put_sep(); print_qty_val(os, v.ask_qty[i], pcfg); }
+  if (v.bid_px){ put_sep(); print_px_val(os, v.bid_px[i], pcfg); }
+  if (v.bid_qty){ put_sep(); print_qty_val(os, v.bid_qty[i], pcfg); }
+  if (v.valu){ put_sep(); os.put_i64(v.valu[i]); }
+
+  if (v.min_bid_px){ put_sep(); print_px_val(os, v.min_bid_px[i], pcfg); }
+  if (v.max_bid_px){ put_sep(); print_px_val(os, v.max_bid_px[i], pcfg); }
+  if (v.min_ask_px){ put_sep(); print_px_val(os, v.min_ask_px[i], pcfg); }
+  if (v.max_ask_px){ put_sep(); print_px_val(os, v.max_ask_px[i], pcfg); }
+
+  if (v.min_bid_ts){ put_sep(); os.put_i64(v.min_bid_ts[i]); }
+  if (v.max_bid_ts){ put_sep(); os.put_i64(v.max_bid_ts[i]); }
+  if (v.min_ask_ts){ put_sep(); os.put_i64(v.min_ask_ts[i]); }
+  if (v.max_ask_ts){ put_sep(); os.put_i64(v.max_ask_ts[i]); }
+}
+
+static void render_trade_row(TextOut& os, const TradeColsView& v, size_t i, bool print_ts, const PrintCfg& pcfg)
+{
+  bool first=true;
+  auto put_sep=[&]{ if(!first) os.put(';'); first=false; };
+  if (v.ts && print_ts)     { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
+  if (v.px)                { put_sep(); print_px_val(os, v.px[i], pcfg); }
+  if (v.qty)               { put_sep(); print_qty_val(os, v.qty[i], pcfg); }
+  if (v.tradeId)           { put_sep(); os.put_i64(v.tradeId[i]); }
+  if (v.buyerOrderId)      { put_sep(); os.put_i64(v.buyerOrderId[i]); }
+  if (v.sellerOrderId)     { put_sep(); os.put_i64(v.sellerOrderId[i]); }
+  if (v.tradeTime)         { put_sep(); os.put_i64(v.tradeTime[i]); }
+  if (v.isMarket)          { put_sep(); os.put_i64(v.isMarket[i]); }
+  if (v.eventTime)         { put_sep(); os.put_i64(v.eventTime[i]); }
+}
+
+static void render_depth_row(TextOut& os, const DeltaColsView& v, size_t i, const PrintCfg& pcfg)
+{
+  if (v.ts) print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); else os.put('0');
+  os.put(';'); if (v.firstId) os.put_i64(v.firstId[i]); else os.put('0');
+  os.put(';'); if (v.lastId)  os.put_i64(v.lastId[i]);  else os.put('0');
+  os.put(';'); if (v.eventTime) os.put_i64(v.eventTime[i]); else os.put('0');
+
+  os.put(';');
+  if (v.ask_off && (v.ask_px || v.ask_qty)) {
+    uint32_t a0=v.ask_off[i], a1=v.ask_off[i+1];
+    for (uint32_t k=a0;k<a1;++k) {
+      if (k>a0) os.put(',');
+      if (v.ask_px) { print_px_val(os, v.ask_px[k], pcfg); }
+      if (v.ask_px && v.ask_qty) os.put('(');
+      if (v.ask_qty) { print_qty_val(os, v.ask_qty[k], pcfg); }
+      if (v.ask_px && v.ask_qty) os.put(')');
+    }
+  }
+
+  os.put(';');
+  if (v.bid_off && (v.bid_px || v.bid_qty)) {
+    uint32_t b0=v.bid_off[i], b1=v.bid_off[i+1];
+    for (uint32_t k=b0;k<b1;++k) {
+      if (k>b0) os.put(',');
+      if (v.bid_px) { print_px_val(os, v.bid_px[k], pcfg); }
+      if (v.bid_px && v.bid_qty) os.put('(');
+      if (v.bid_qty) { print_qty_val(os, v.bid_qty[k], pcfg); }
+      if (v.bid_px && v.bid_qty) os.put(')');
+    }
+  }
 }
 
 // Build header strings
+// Gap mode: the rows of one px row group inside [start_ns, end_ns) as one block
+template <class Render>
+static void px_window_block(ChunkBuilder& b, const vector<int64_t>& ts, int64_t start_ns, int64_t end_ns,
+                            vector<int64_t>& w_ts, vector<uint32_t>& w_row, Render& render) {
+  w_ts.clear(); w_row.clear();
+  for (size_t i=0;i<ts.size();++i)
+    if (ts[i] >= start_ns && ts[i] < end_ns) { w_ts.push_back(ts[i]); w_row.push_back(static_cast<uint32_t>(i)); }
+  auto window_row = [&](TextOut& os, size_t k) { render(os, w_row[k]); };
+  b.block(w_ts.data(), w_ts.size(), window_row);
+}
+
 static string header_from_names(const vector<string>& names) {
   ostringstream os;
   for (size_t i=0;i<names.size();++i){ if(i) os<<';'; os<<names[i]; }
@@ -448,7 +974,9 @@ static int dump_px_direct(const string& root,
                           bool debug,
                           const TopSelect& sel_from_csv,
                           const PrintCfg& pcfg,
-                          bool prefetch)
+                          const ReadAheadOptions& ra,
+                          const optional<IoOptions>& io,
+                          unsigned threads)
 {
   TopSelect sel = sel_from_csv;
   bool print_ts  = sel.ts;
@@ -469,6 +997,8 @@ static int dump_px_direct(const string& root,
     for (auto& f: files) cerr << "  " << f.path << "\n";
   }
 
+  TextOut out(stdout);
+
   if (pcfg.header) {
     vector<string> names;
     if (pcfg.idx_mode != IdxMode::None) names.push_back("idx");
@@ -479,32 +1009,95 @@ static int dump_px_direct(const string& root,
     };
     if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
     else { add_cols(""); }
-    cout << header_from_names(names) << '\n';
+    out.put(header_from_names(names)); out.end_line();
   }
 
   uint64_t printed_idx = 0;
   uint64_t raw_idx_global = 0;
   bool gap_mode = pcfg.gap_ns.has_value();
 
-  // gap-state
-  bool have_prev = false;
-  int64_t prev_ts = 0;
-  uint64_t prev_raw_idx = 0;
-  size_t prev_i = 0;
-  bool prev_str_ready = false;
-  string prev_str;
+  // gap mode (and --threads): rows go through ChunkBuilder, edges between chunks here
+  OrderedEmitter em(out, pcfg, 1);
 
   FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
+  // mmap unless --io picked something else (io_uring is library-only; pread here)
+  auto open_px = [&io](const string& path) {
+    parquet::ReaderProperties props = parquet::default_reader_properties();
+    if (io && io->buffer_size > 0) { props.enable_buffered_stream(); props.set_buffer_size(static_cast<int64_t>(io->buffer_size)); }
+    const bool mmap = !io || io->backend == IoBackend::Mmap;
+    return parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/mmap, props);
+  };
+
+  // --threads: one chunk per month file (run_ordered above); each worker opens its own
+  if (threads > 1) {
+    run_ordered(files.size(), threads,
+      [&](size_t k, Chunk& c) {
+        const auto& f = files[k];
+        ChunkBuilder b(c, pcfg, em.needs_lines());
+        std::unique_ptr<parquet::ParquetFileReader> reader;
+        try {
+          reader = open_px(f.path);
+          if (pcfg.print_fn) b.file(fs::path(f.path).filename().string());
+        } catch (const std::exception& e) {
+          c.note = "ERROR(px): open failed: " + f.path + " : " + e.what() + "\n";
+          return;
+        }
+        auto md = reader->metadata();
+        auto schema = md->schema();
+        int ts_i  = find_col_idx(schema, "ts");
+        int bp_i  = find_col_idx(schema, "bid_px");
+        int ap_i  = find_col_idx(schema, "ask_px");
+        if (ts_i<0 || bp_i<0 || ap_i<0) { c.note = "ERROR(px): missing ts/bid_px/ask_px in " + f.path + "\n"; return; }
+
+        vector<int64_t> v_ts, v_bp, v_ap, w_ts;
+        vector<uint32_t> w_row;
+        auto row = [&](TextOut& os, size_t i) {
+          render_px_row_content(os, v_ts[i], v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
+        };
+        for (int rg=0; rg<md->num_row_groups(); ++rg) {
+          auto rg_reader = reader->RowGroup(rg);
+          read_i64_column(*rg_reader, ts_i, v_ts);
+          read_i64_column(*rg_reader, bp_i, v_bp);
+          read_i64_column(*rg_reader, ap_i, v_ap);
+
+          if (gap_mode) { px_window_block(b, v_ts, start_ns, end_ns, w_ts, w_row, row); continue; }
+          uint64_t raw_idx_local = 0;   // --seen_every counts per row group here
+          for (size_t i=0;i<v_ts.size();++i) {
+            int64_t t = v_ts[i];
+            if (t < start_ns || t >= end_ns) continue;
+            if (++raw_idx_local % seen_every != 0) { b.skip(); continue; }
+            b.row(i, row);
+          }
+        }
+      },
+      [&](Chunk& c) { em.emit(c); });
+    em.finish();
+    return 0;
+  }
+
+  // Read-ahead: the next file is opened on a background thread (footer parsed,
+  // fd kept for the loop) and only its ts/bid_px/ask_px chunks are hinted.
+  auto open_px_ahead = [open_px, budget = ra.budget_bytes](const string& path) {
+    auto r = open_px(path);
+    auto md = r->metadata();
+    auto schema = md->schema();
+    hint_columns(path, *md, { find_col_idx(schema, "ts"), find_col_idx(schema, "bid_px"),
+                              find_col_idx(schema, "ask_px") }, budget);
+    return r;
+  };
+  std::future<std::unique_ptr<parquet::ParquetFileReader>> next_reader;
+
   for (size_t fi=0; fi<files.size(); ++fi) {
     const auto& f = files[fi];
 
-    if (prefetch && fi + 1 < files.size())
-      prefetch_path(files[fi + 1].path);
+    auto pending = std::move(next_reader);
+    if (ra.enabled && fi + 1 < files.size())
+      next_reader = std::async(std::launch::async, open_px_ahead, files[fi + 1].path);
 
     std::unique_ptr<parquet::ParquetFileReader> reader;
     try {
-      reader = parquet::ParquetFileReader::OpenFile(f.path, /*memory_map=*/true);
+      reader = pending.valid() ? pending.get() : open_px(f.path);
       if (pcfg.print_fn) fnp.open(fs::path(f.path).filename().string(), raw_idx_global);
     } catch (const std::exception& e) {
       cerr << "ERROR(px): open failed: " << f.path << " : " << e.what() << "\n";
@@ -517,7 +1110,8 @@ static int dump_px_direct(const string& root,
     int ap_i  = find_col_idx(schema, "ask_px");
     if (ts_i<0 || bp_i<0 || ap_i<0) { cerr << "ERROR(px): missing ts/bid_px/ask_px in " << f.path << "\n"; continue; }
 
-    vector<int64_t> v_ts, v_bp, v_ap;
+    vector<int64_t> v_ts, v_bp, v_ap, w_ts;
+    vector<uint32_t> w_row;
 
     for (int rg=0; rg<md->num_row_groups(); ++rg) {
       auto rg_reader = reader->RowGroup(rg);
@@ -534,90 +1128,29 @@ static int dump_px_direct(const string& root,
           ++raw_idx_local; ++raw_idx_global;
           if (raw_idx_local % seen_every != 0) continue;
 
-          string content = render_px_row_content(t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx_global) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << content << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_px_row_content(out, t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
+          out.end_line();
         }
       } else {
-        // GAP MODE (lazy string building) + FIRST print
-        for (size_t i=0;i<n;++i) {
-          int64_t t = v_ts[i];
-          if (t < start_ns || t >= end_ns) continue;
-          ++raw_idx_global;
-
-          if (!have_prev) {
-            // print FIRST edge: first;first;0
-            string first_line = render_px_row_content(t, v_ap[i], v_bp[i],
-                                                      print_ts, need_ask, need_bid, pcfg);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx_global) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw_same,
-                         raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
-
-            have_prev = true;
-            prev_ts = t;
-            prev_i = i;
-            prev_raw_idx = raw_idx_global;
-            prev_str = std::move(first_line);
-            prev_str_ready = true;
-            continue;
-          }
-
-          if (t - prev_ts >= *pcfg.gap_ns) {
-            if (!prev_str_ready) {
-              prev_str = render_px_row_content(v_ts[prev_i], v_ap[prev_i], v_bp[prev_i],
-                                               print_ts, need_ask, need_bid, pcfg);
-              prev_str_ready = true;
-            }
-            string cur = render_px_row_content(t, v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
-
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-            optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx_global) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
-          }
-
-          // Move window to current row (do NOT render yet)
-          prev_ts = t;
-          prev_i = i;
-          prev_raw_idx = raw_idx_global;
-          prev_str_ready = false;
-        }
-
-        // End of RG: materialize prev string to carry across RG boundary
-        if (have_prev && !prev_str_ready) {
-          prev_str = render_px_row_content(v_ts[prev_i], v_ap[prev_i], v_bp[prev_i],
-                                           print_ts, need_ask, need_bid, pcfg);
-          prev_str_ready = true;
-        }
+        // GAP MODE: the row group's window rows through find_gaps
+        Chunk c;
+        ChunkBuilder b(c, pcfg, em.needs_lines());
+        auto row = [&](TextOut& os, size_t i) {
+          render_px_row_content(os, v_ts[i], v_ap[i], v_bp[i], print_ts, need_ask, need_bid, pcfg);
+        };
+        px_window_block(b, v_ts, start_ns, end_ns, w_ts, w_row, row);
+        em.emit(c);
+        raw_idx_global += c.rows;
       }
     }
   }
 
-  // GAP MODE: print LAST edge if we saw anything
-  if (gap_mode && have_prev) {
-    ++printed_idx;
-    optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-    optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-    print_prefix(cout, pcfg, nullptr, nullptr,
-                 printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-    cout << prev_str << ';' << prev_str << ';';
-    print_gap_s_ms(cout, 0);
-    cout << '\n';
-  }
+  // GAP MODE: LAST edge if we saw anything
+  if (gap_mode) em.finish();
 
   fnp.finish(raw_idx_global);
   return 0;
@@ -638,8 +1171,23 @@ int main(int argc, char** argv)
          << "        [--precision-px=N]         (default: 8)\n"
          << "        [--precision-qty=N]        (default: 8)\n"
          << "        [--print-fn]               (stderr: file switch + raw idx + M rec/s)\n"
-         << "        [--prefetch]               (Linux: readahead next file)\n"
+         << "        [--prefetch]               (Linux: read ahead the selected columns of the next file in the background)\n"
+         << "        [--readahead=MB[,FILES]]   (as --prefetch with a per-file byte budget / files ahead; default: 256,1)\n"
+         << "        [--huge-pages]             (Linux: THP-backed decode scratch)\n"
+         << "        [--no-manifest]            (probe every day on disk instead of reading _manifest.tsv)\n"
+         << "        [--pipeline=N[,DEPTH]]     (decode row groups ahead on N threads; default: off)\n"
+         << "        [--batch=TARGET[,MAX]]     (coalesce row groups up to TARGET rows / split at MAX rows; default: one row group)\n"
+         << "        [--threads=N[,SEC]]        (text output: decode + format N slices of SEC (default: a UTC day) at once,\n"
+         << "                                    printed in order, same bytes as sequential; px: one month file each)\n"
+         << "        [--chunk-cache=MB]         (share decoded flat column chunks between readers, LRU within MB; default: off)\n"
+         << "        [--bars=SEC]               (trade_fut/trade_spot: OHLC/volume/VWAP bars per SEC bucket instead of rows)\n"
+         << "        [--where=EXPR]             (top/trade row filter, e.g. qty>500000000,isMarket=1 or spread>=2000000;\n"
+         << "                                    terms ANDed, ops < <= > >= = !=, raw int64 values)\n"
+         << "        [--io=pread[,BUF]|mmap|uring[,QD]] (file access; BUF = buffered stream bytes; default: pread, px: mmap)\n"
          << "        [--idx=printed|raw|none]   (default: none)\n"
+         << "        [--out-format=text|arrow-ipc|raw] (top/trade/depth: Arrow IPC stream or raw int64 column blocks\n"
+         << "                                    of the selected columns instead of text; default: text)\n"
+         << "        [--out=PATH]               (binary output file; default: stdout)\n"
          << "        [--seen_every=N]           (default: 1)\n"
          << "        [--debug] [columns_csv]\n"
          << "Defaults:\n"
@@ -664,9 +1212,21 @@ int main(int argc, char** argv)
 
   optional<string> sampling;
   bool debug=false;
-  bool prefetch=false;
+  ReadAheadOptions ra;
+  bool huge_pages=false;
+  bool use_manifest=true;
   uint64_t seen_every = 1;
   string columns_csv;
+  string where;
+  PipelineOptions pipe;
+  BatchOptions batch;
+  size_t chunk_cache_mb = 0;
+  optional<IoOptions> io;
+  optional<int64_t> bars_ns;
+  OutFormat out_format = OutFormat::Text;
+  string out_path;
+  unsigned threads = 0;
+  int64_t slice_ns = 86'400'000'000'000LL;
 
   PrintCfg pcfg;
 
@@ -698,13 +1258,81 @@ int main(int argc, char** argv)
     } else if (a=="--print-fn") {
       pcfg.print_fn = true;
     } else if (a=="--prefetch") {
-      prefetch = true;
+      ra.enabled = true;
+    } else if (a.rfind("--readahead=",0)==0) {
+      string v = a.substr(12);
+      size_t comma = v.find(',');
+      try {
+        ra.budget_bytes = static_cast<size_t>(stoull(v.substr(0, comma))) << 20;
+        if (comma != string::npos) ra.files_ahead = static_cast<unsigned>(stoul(v.substr(comma + 1)));
+      } catch (...) { cerr << "ERROR: --readahead must be MB or MB,FILES\n"; return 1; }
+      ra.enabled = true;
+    } else if (a=="--huge-pages") {
+      huge_pages = true;
+    } else if (a=="--no-manifest") {
+      use_manifest = false;
+    } else if (a.rfind("--pipeline=",0)==0) {
+      string v = a.substr(11);
+      size_t comma = v.find(',');
+      try {
+        pipe.threads = static_cast<unsigned>(stoul(v.substr(0, comma)));
+        if (comma != string::npos) pipe.depth = static_cast<size_t>(stoull(v.substr(comma + 1)));
+      } catch (...) { cerr << "ERROR: --pipeline must be N or N,DEPTH\n"; return 1; }
+    } else if (a.rfind("--batch=",0)==0) {
+      string v = a.substr(8);
+      size_t comma = v.find(',');
+      try {
+        batch.target_rows = static_cast<size_t>(stoull(v.substr(0, comma)));
+        if (comma != string::npos) batch.max_rows = static_cast<size_t>(stoull(v.substr(comma + 1)));
+      } catch (...) { cerr << "ERROR: --batch must be TARGET or TARGET,MAX\n"; return 1; }
+    } else if (a.rfind("--threads=",0)==0) {
+      string v = a.substr(10);
+      size_t comma = v.find(',');
+      try {
+        threads = static_cast<unsigned>(stoul(v.substr(0, comma)));
+        if (comma != string::npos) slice_ns = to_ns(stod(v.substr(comma + 1)));
+      } catch (...) { cerr << "ERROR: --threads must be N or N,SEC\n"; return 1; }
+      if (slice_ns <= 0) { cerr << "ERROR: --threads slice must be > 0 seconds\n"; return 1; }
+    } else if (a.rfind("--chunk-cache=",0)==0) {
+      try { chunk_cache_mb = static_cast<size_t>(stoull(a.substr(14))); }
+      catch (...) { cerr << "ERROR: --chunk-cache must be MB\n"; return 1; }
+    } else if (a.rfind("--io=",0)==0) {
+      string v = a.substr(5);
+      size_t comma = v.find(',');
+      string kind = v.substr(0, comma);
+      IoOptions o;
+      if (kind=="pread") o.backend = IoBackend::Pread;
+      else if (kind=="mmap") o.backend = IoBackend::Mmap;
+      else if (kind=="uring") o.backend = IoBackend::Uring;
+      else { cerr << "ERROR: --io must be pread[,BUF], mmap or uring[,QD]\n"; return 1; }
+      if (comma != string::npos) {
+        unsigned long long n = 0;
+        try { n = stoull(v.substr(comma + 1)); } catch (...) { cerr << "ERROR: bad number in " << a << "\n"; return 1; }
+        if (o.backend == IoBackend::Uring) o.queue_depth = static_cast<unsigned>(n ? n : 1);
+        else o.buffer_size = static_cast<size_t>(n);
+      }
+      io = o;
+    } else if (a.rfind("--bars=",0)==0) {
+      double b = 0;
+      try { b = stod(a.substr(7)); } catch (...) { cerr << "ERROR: bad value in " << a << "\n"; return 1; }
+      if (b <= 0) { cerr << "ERROR: --bars must be > 0\n"; return 1; }
+      bars_ns = to_ns(b);
     } else if (a.rfind("--idx=",0)==0) {
       string v = a.substr(6);
       if (v=="printed") pcfg.idx_mode = IdxMode::Printed;
       else if (v=="raw") pcfg.idx_mode = IdxMode::Raw;
       else if (v=="none") pcfg.idx_mode = IdxMode::None;
       else { cerr << "ERROR: --idx must be printed|raw|none\n"; return 1; }
+    } else if (a.rfind("--out-format=",0)==0) {
+      string v = a.substr(13);
+      if (v=="text") out_format = OutFormat::Text;
+      else if (v=="arrow-ipc") out_format = OutFormat::ArrowIpc;
+      else if (v=="raw") out_format = OutFormat::Raw;
+      else { cerr << "ERROR: --out-format must be text|arrow-ipc|raw\n"; return 1; }
+    } else if (a.rfind("--out=",0)==0) {
+      out_path = a.substr(6);
+    } else if (a.rfind("--where=",0)==0) {
+      where = a.substr(8);
     } else if (a=="--debug") {
       debug = true;
     } else if (a.rfind("--seen_every=",0)==0 || a.rfind("--seen-every=",0)==0
@@ -730,7 +1358,8 @@ int main(int argc, char** argv)
   const int64_t end_ns   = to_ns(end_sec);
 
   ShardedDB::set_debug(debug);
-  ShardedDB::set_prefetch(prefetch);  // no-op if not implemented in your lib
+  ShardedDB::set_huge_pages(huge_pages);
+  ShardedDB::set_chunk_cache(chunk_cache_mb << 20);
 
   if (debug) {
     cerr << "[debug] root=" << root << " symb=" << symb << " type=" << T.base << "\n";
@@ -742,7 +1371,11 @@ int main(int argc, char** argv)
          << " pxqty=" << (pcfg.raw_override?"raw":"double")
          << " prec_px=" << pcfg.precision_px << " prec_qty=" << pcfg.precision_qty
          << " print_fn=" << (pcfg.print_fn?"yes":"no")
-         << " prefetch=" << (prefetch?"yes":"no")
+         << " readahead=" << (ra.enabled ? to_string(ra.budget_bytes >> 20) + "MB," + to_string(ra.files_ahead) : string("no"))
+         << " huge_pages=" << (huge_pages?"yes":"no")
+         << " pipeline=" << pipe.threads << "," << pipe.depth
+         << " threads=" << threads
+         << " io=" << (!io ? "default" : io->backend==IoBackend::Mmap ? "mmap" : io->backend==IoBackend::Uring ? "uring" : "pread")
          << " idx=" << (pcfg.idx_mode==IdxMode::Printed?"printed":pcfg.idx_mode==IdxMode::Raw?"raw":"none")
          << " header=" << (pcfg.header?"yes":"no")
          << " seen_every=" << seen_every << "\n";
@@ -750,27 +1383,60 @@ int main(int argc, char** argv)
     if (!os.empty()) cerr << "[debug] os=" << os << "\n";
   }
 
+  if (!where.empty() && (T.base == "depth" || bars_ns || (sampling && *sampling == "px"))) {
+    cerr << "ERROR: --where applies to top/trade rows only (not depth, --bars or px sampling)\n"; return 1;
+  }
+
+  const bool binary = out_format != OutFormat::Text;
+  if (binary && (pcfg.gap_ns || pcfg.header || pcfg.idx_mode != IdxMode::None || seen_every != 1
+                 || bars_ns || (sampling && *sampling == "px"))) {
+    cerr << "ERROR: --out-format=arrow-ipc|raw streams plain rows (no --gap, --header, --idx, --seen_every, --bars or px sampling)\n";
+    return 1;
+  }
+
+  if (bars_ns && !T.market) {
+    cerr << "ERROR: --bars requires a market-specific type: use trade_spot or trade_fut\n"; return 1;
+  }
+
+  // --threads: ordered parallel scan (text rows; bars stay sequential)
+  const bool ordered = threads > 1 && !binary && !bars_ns;
+
   // Fast path: top + px sampling -> read from top_px_{market}/... directly
   if (T.base == "top" && sampling && *sampling == "px") {
     if (!T.market) { cerr << "ERROR: px sampling requires market-specific type: use top_spot or top_fut\n"; return 1; }
     TopSelect sel{}; if (!columns_csv.empty()) sel = make_top_select_from_csv(columns_csv);
-    return dump_px_direct(root, symb, *T.market, start_ns, end_ns, seen_every, debug, sel, pcfg, prefetch);
+    return dump_px_direct(root, symb, *T.market, start_ns, end_ns, seen_every, debug, sel, pcfg, ra, io, threads);
   }
 
   // Otherwise delegate to ShardedDB (ticks, time-sampled tops, trades, depth)
   ShardedDB db(root, sampling);
+  db.set_pipeline(pipe);
+  db.set_batch(batch);
+  if (io) db.set_io(*io);
+  db.set_readahead(ra);
+  db.set_use_manifest(use_manifest);
+  TextOut out(stdout);
 
   // ================= TOP =================
   if (T.base == "top")
   {
     TopSelect sel{};
     if (!columns_csv.empty()) sel = make_top_select_from_csv(columns_csv);
+    try { sel.where = parse_where(where, top_field); }
+    catch (const exception& e) { cerr << "ERROR: " << e.what() << "\n"; return 1; }
     bool have_ts_to_print = sel.ts;
 
     TopSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
 
-    auto rdr = db.get_top_cols(start_ns, end_ns, symb, T.market, sel_int);
+    // (--threads opens one reader per slice below instead)
+    auto rdr = ordered ? nullptr : db.get_top_cols(start_ns, end_ns, symb, T.market, sel_int);
+
+    if (binary) {
+      dump_binary<ShardedDB::TopBatchReader, TopColsView>(*rdr, out_format, out_path);
+      if (debug) print_reader_stats("top", rdr->stats());
+      return 0;
+    }
 
     if (pcfg.header) {
       vector<string> names;
@@ -793,7 +1459,16 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out.put(header_from_names(names)); out.end_line();
+    }
+
+    if (ordered) {
+      const ReaderStats st = scan_ordered<TopColsView>(
+        make_slices(T.market, start_ns, end_ns, slice_ns), threads, out, pcfg, seen_every,
+        [&](const Slice& sl) { return db.get_top_cols(sl.start_ns, sl.end_ns, symb, sl.market, sel_int); },
+        [&](TextOut& os, const TopColsView& v, size_t i) { render_top_row(os, v, i, have_ts_to_print, pcfg); });
+      if (debug) print_reader_stats("top", st);
+      return 0;
     }
 
     TopColsView v{};
@@ -803,29 +1478,7 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
-      bool first = true;
-      auto put_sep=[&]{ if(!first) os<<';'; first=false; };
-
-      if (v.ts && have_ts_to_print) { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
-      if (v.ask_px){ put_sep(); print_px_val(os, v.ask_px[i], pcfg); }
-      if (v.ask_qty){ put_sep(); print_qty_val(os, v.ask_qty[i], pcfg); }
-      if (v.bid_px){ put_sep(); print_px_val(os, v.bid_px[i], pcfg); }
-      if (v.bid_qty){ put_sep(); print_qty_val(os, v.bid_qty[i], pcfg); }
-      if (v.valu){ put_sep(); os<<v.valu[i]; }
-
-      if (v.min_bid_px){ put_sep(); print_px_val(os, v.min_bid_px[i], pcfg); }
-      if (v.max_bid_px){ put_sep(); print_px_val(os, v.max_bid_px[i], pcfg); }
-      if (v.min_ask_px){ put_sep(); print_px_val(os, v.min_ask_px[i], pcfg); }
-      if (v.max_ask_px){ put_sep(); print_px_val(os, v.max_ask_px[i], pcfg); }
-
-      if (v.min_bid_ts){ put_sep(); os<<v.min_bid_ts[i]; }
-      if (v.max_bid_ts){ put_sep(); os<<v.max_bid_ts[i]; }
-      if (v.min_ask_ts){ put_sep(); os<<v.min_ask_ts[i]; }
-      if (v.max_ask_ts){ put_sep(); os<<v.max_ask_ts[i]; }
-      return os.str();
-    };
+    auto render_line = [&](TextOut& os, size_t i){ render_top_row(os, v, i, have_ts_to_print, pcfg); };
 
     if (!gap_mode) {
       uint64_t local_seen = 0;
@@ -838,102 +1491,77 @@ int main(int argc, char** argv)
           ++raw_idx;
           ++local_seen;
           if (local_seen % seen_every != 0) continue;
-          string line = render_line(i);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << line << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_line(out, i);
+          out.end_line();
         }
       }
       fnp.finish(raw_idx);
     } else {
-      // lazy strings in gap mode + FIRST/LAST edges
-      bool have_prev = false;
-      int64_t prev_ts = 0;
-      uint64_t prev_raw_idx = 0;
-      size_t prev_i = 0;
-      bool prev_str_ready = false;
-      string prev_str;
-
+      // gap mode: each batch through find_gaps (ChunkBuilder), FIRST/LAST and cross-batch edges in the emitter
+      OrderedEmitter em(out, pcfg, 1);
       while (rdr->next(v)) {
-        if (pcfg.print_fn) {
-          string fn = v.file ? v.file : string("-");
-          fnp.open(fn, raw_idx);
-        }
-        for (size_t i=0;i<v.n;++i) {
-          ++raw_idx;
-          int64_t t = v.ts ? v.ts[i] : 0;
-
-          if (!have_prev) {
-            // FIRST edge
-            string first_line = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
-
-            have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
-            prev_str = std::move(first_line); prev_str_ready = true;
-            continue;
-          }
-
-          if (t - prev_ts >= *pcfg.gap_ns) {
-            if (!prev_str_ready) { prev_str = render_line(prev_i); prev_str_ready = true; }
-            string cur = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-            optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
-          }
-
-          // slide window
-          prev_ts = t;
-          prev_i = i;
-          prev_raw_idx = raw_idx;
-          prev_str_ready = false;
-        }
-        // materialize prev for cross-block carry
-        if (have_prev && !prev_str_ready) {
-          prev_str = render_line(prev_i);
-          prev_str_ready = true;
-        }
+        Chunk c;
+        ChunkBuilder b(c, pcfg, em.needs_lines());
+        if (pcfg.print_fn) b.file(v.file ? v.file : string("-"));
+        b.block(v.ts, v.n, render_line);
+        em.emit(c);
       }
+      em.finish();
+    }
+    if (debug) print_reader_stats("top", rdr->stats());
+  }
+  // ================= TRADE BARS =================
+  else if (T.base == "trade" && bars_ns)
+  {
+    auto rdr = db.aggregate_trades(start_ns, end_ns, symb, *T.market, *bars_ns);
 
-      // LAST edge
-      if (have_prev) {
-        ++printed_idx;
-        optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-        optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
-                     printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
-      }
+    if (pcfg.header) {
+      out.put(header_from_names({"ts", "open", "high", "low", "close", "volume", "volume_market",
+                                 "volume_other", "vwap", "notional", "trades"}));
+      out.end_line();
+    }
 
-      fnp.finish(raw_idx);
+    const bool scaled = pcfg.pxqty_double && !pcfg.raw_override;
+    TradeBar b;
+    while (rdr->next(b)) {
+      print_ts_fmt(out, b.ts, pcfg.ts_fmt);
+      out.put(';'); print_px_val(out, b.open, pcfg);
+      out.put(';'); print_px_val(out, b.high, pcfg);
+      out.put(';'); print_px_val(out, b.low, pcfg);
+      out.put(';'); print_px_val(out, b.close, pcfg);
+      out.put(';'); print_qty_val(out, b.volume, pcfg);
+      out.put(';'); print_qty_val(out, b.volume_market, pcfg);
+      out.put(';'); print_qty_val(out, b.volume_other, pcfg);
+      out.put(';'); print_px_val(out, static_cast<int64_t>(llround(b.vwap)), pcfg);
+      out.put(';'); out.put_double_fixed(scaled ? b.notional / 1e16 : b.notional, scaled ? pcfg.precision_px : 0);
+      out.put(';'); out.put_u64(b.trades);
+      out.end_line();
     }
+    if (debug) print_reader_stats("trade", rdr->stats());
   }
   // ================= TRADE =================
   else if (T.base == "trade")
   {
     TradeSelect sel{};
     if (!columns_csv.empty()) sel = make_trade_select_from_csv(columns_csv);
+    try { sel.where = parse_where(where, trade_field); }
+    catch (const exception& e) { cerr << "ERROR: " << e.what() << "\n"; return 1; }
 
     TradeSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
 
-    auto rdr = db.get_trade_cols(start_ns, end_ns, symb, T.market, sel_int);
+    // (--threads opens one reader per slice below instead)
+    auto rdr = ordered ? nullptr : db.get_trade_cols(start_ns, end_ns, symb, T.market, sel_int);
+
+    if (binary) {
+      dump_binary<ShardedDB::TradeBatchReader, TradeColsView>(*rdr, out_format, out_path);
+      if (debug) print_reader_stats("trade", rdr->stats());
+      return 0;
+    }
 
     if (pcfg.header) {
       vector<string> names;
@@ -951,7 +1579,16 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out.put(header_from_names(names)); out.end_line();
+    }
+
+    if (ordered) {
+      const ReaderStats st = scan_ordered<TradeColsView>(
+        make_slices(T.market, start_ns, end_ns, slice_ns), threads, out, pcfg, seen_every,
+        [&](const Slice& sl) { return db.get_trade_cols(sl.start_ns, sl.end_ns, symb, sl.market, sel_int); },
+        [&](TextOut& os, const TradeColsView& v, size_t i) { render_trade_row(os, v, i, sel.ts, pcfg); });
+      if (debug) print_reader_stats("trade", st);
+      return 0;
     }
 
     TradeColsView v{};
@@ -961,21 +1598,7 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
-      bool first=true;
-      auto put_sep=[&]{ if(!first) os<<';'; first=false; };
-      if (v.ts && sel.ts)      { put_sep(); print_ts_fmt(os, v.ts[i], pcfg.ts_fmt); }
-      if (v.px)                { put_sep(); print_px_val(os, v.px[i], pcfg); }
-      if (v.qty)               { put_sep(); print_qty_val(os, v.qty[i], pcfg); }
-      if (v.tradeId)           { put_sep(); os<<v.tradeId[i]; }
-      if (v.buyerOrderId)      { put_sep(); os<<v.buyerOrderId[i]; }
-      if (v.sellerOrderId)     { put_sep(); os<<v.sellerOrderId[i]; }
-      if (v.tradeTime)         { put_sep(); os<<v.tradeTime[i]; }
-      if (v.isMarket)          { put_sep(); os<<int(v.isMarket[i]); }
-      if (v.eventTime)         { put_sep(); os<<v.eventTime[i]; }
-      return os.str();
-    };
+    auto render_line = [&](TextOut& os, size_t i){ render_trade_row(os, v, i, sel.ts, pcfg); };
 
     if (!gap_mode) {
       uint64_t local_seen = 0;
@@ -988,85 +1611,28 @@ int main(int argc, char** argv)
           ++raw_idx;
           ++local_seen;
           if (local_seen % seen_every != 0) continue;
-          string line = render_line(i);
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << line << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_line(out, i);
+          out.end_line();
         }
       }
       fnp.finish(raw_idx);
     } else {
-      bool have_prev = false;
-      int64_t prev_ts = 0;
-      uint64_t prev_raw_idx = 0;
-      size_t prev_i = 0;
-      bool prev_str_ready = false;
-      string prev_str;
-
+      // gap mode: each batch through find_gaps (ChunkBuilder), FIRST/LAST and cross-batch edges in the emitter
+      OrderedEmitter em(out, pcfg, 1);
       while (rdr->next(v)) {
-        if (pcfg.print_fn) {
-          string fn = v.file ? v.file : string("-");
-          fnp.open(fn, raw_idx);
-        }
-        for (size_t i=0;i<v.n;++i) {
-          ++raw_idx;
-          int64_t t = v.ts ? v.ts[i] : 0;
-
-          if (!have_prev) {
-            // FIRST edge
-            string first_line = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
-
-            have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
-            prev_str = std::move(first_line); prev_str_ready = true;
-            continue;
-          }
-
-          if (t - prev_ts >= *pcfg.gap_ns) {
-            if (!prev_str_ready) { prev_str = render_line(prev_i); prev_str_ready = true; }
-            string cur = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-            optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
-          }
-
-          prev_ts = t;
-          prev_i = i;
-          prev_raw_idx = raw_idx;
-          prev_str_ready = false;
-        }
-        if (have_prev && !prev_str_ready) { prev_str = render_line(prev_i); prev_str_ready = true; }
-      }
-
-      // LAST edge
-      if (have_prev) {
-        ++printed_idx;
-        optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-        optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
-                     printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
+        Chunk c;
+        ChunkBuilder b(c, pcfg, em.needs_lines());
+        if (pcfg.print_fn) b.file(v.file ? v.file : string("-"));
+        b.block(v.ts, v.n, render_line);
+        em.emit(c);
       }
-
-      fnp.finish(raw_idx);
+      em.finish();
     }
+    if (debug) print_reader_stats("trade", rdr->stats());
   }
   // ================= DEPTH =================
   else if (T.base == "depth")
@@ -1076,7 +1642,14 @@ int main(int argc, char** argv)
     DeltaSelect sel_int = sel;
     if (pcfg.gap_ns && !sel_int.ts) sel_int.ts = true;
 
-    auto rdr = db.get_depth_cols(start_ns, end_ns, symb, T.market, sel_int);
+    // (--threads opens one reader per slice below instead)
+    auto rdr = ordered ? nullptr : db.get_depth_cols(start_ns, end_ns, symb, T.market, sel_int);
+
+    if (binary) {
+      dump_binary<ShardedDB::DeltaBatchReader, DeltaColsView>(*rdr, out_format, out_path);
+      if (debug) print_reader_stats("depth", rdr->stats());
+      return 0;
+    }
 
     if (pcfg.header) {
       vector<string> names;
@@ -1091,7 +1664,16 @@ int main(int argc, char** argv)
       };
       if (pcfg.gap_ns) { add_cols("first_"); add_cols("last_"); names.push_back("gap"); }
       else { add_cols(""); }
-      cout << header_from_names(names) << '\n';
+      out.put(header_from_names(names)); out.end_line();
+    }
+
+    if (ordered) {
+      const ReaderStats st = scan_ordered<DeltaColsView>(
+        make_slices(T.market, start_ns, end_ns, slice_ns), threads, out, pcfg, 1,
+        [&](const Slice& sl) { return db.get_depth_cols(sl.start_ns, sl.end_ns, symb, sl.market, sel_int); },
+        [&](TextOut& os, const DeltaColsView& v, size_t i) { render_depth_row(os, v, i, pcfg); });
+      if (debug) print_reader_stats("depth", st);
+      return 0;
     }
 
     DeltaColsView v{};
@@ -1101,41 +1683,7 @@ int main(int argc, char** argv)
 
     FnPrinter fnp; fnp.enabled = pcfg.print_fn;
 
-    auto render_line = [&](size_t i)->string{
-      ostringstream os;
-      bool first=true;
-      auto putv=[&](const string& s){ if(!first) os<<';'; os<<s; first=false; };
-
-      if (v.ts) { ostringstream t; print_ts_fmt(t, v.ts[i], pcfg.ts_fmt); putv(t.str()); } else putv("0");
-      if (v.firstId) putv(std::to_string(v.firstId[i])); else putv("0");
-      if (v.lastId)  putv(std::to_string(v.lastId[i]));  else putv("0");
-      if (v.eventTime) putv(std::to_string(v.eventTime[i])); else putv("0");
-
-      os << ';';
-      if (v.ask_off && (v.ask_px || v.ask_qty)) {
-        uint32_t a0=v.ask_off[i], a1=v.ask_off[i+1];
-        for (uint32_t k=a0;k<a1;++k) {
-          if (k>a0) os<<',';
-          if (v.ask_px) { print_px_val(os, v.ask_px[k], pcfg); }
-          if (v.ask_px && v.ask_qty) os<<'(';
-          if (v.ask_qty) { print_qty_val(os, v.ask_qty[k], pcfg); }
-          if (v.ask_px && v.ask_qty) os<<')';
-        }
-      }
-
-      os << ';';
-      if (v.bid_off && (v.bid_px || v.bid_qty)) {
-        uint32_t b0=v.bid_off[i], b1=v.bid_off[i+1];
-        for (uint32_t k=b0;k<b1;++k) {
-          if (k>b0) os<<',';
-          if (v.bid_px) { print_px_val(os, v.bid_px[k], pcfg); }
-          if (v.bid_px && v.bid_qty) os<<'(';
-          if (v.bid_qty) { print_qty_val(os, v.bid_qty[k], pcfg); }
-          if (v.bid_px && v.bid_qty) os<<')';
-        }
-      }
-      return os.str();
-    };
+    auto render_line = [&](TextOut& os, size_t i){ render_depth_row(os, v, i, pcfg); };
 
     if (!gap_mode) {
       while (rdr->next(v)) {
@@ -1148,81 +1696,25 @@ int main(int argc, char** argv)
           ++printed_idx;
           optional<uint64_t> idx_print = (pcfg.idx_mode==IdxMode::Printed? optional<uint64_t>(printed_idx) :
                                           pcfg.idx_mode==IdxMode::Raw? optional<uint64_t>(raw_idx) : nullopt);
-          print_prefix(cout, pcfg, nullptr, nullptr, idx_print, nullopt);
-          cout << render_line(i) << '\n';
+          print_prefix(out, pcfg, nullptr, nullptr, idx_print, nullopt);
+          render_line(out, i);
+          out.end_line();
         }
       }
       fnp.finish(raw_idx);
     } else {
-      bool have_prev = false;
-      int64_t prev_ts = 0;
-      uint64_t prev_raw_idx = 0;
-      size_t prev_i = 0;
-      bool prev_str_ready = false;
-      string prev_str;
-
+      // gap mode: each batch through find_gaps (ChunkBuilder), FIRST/LAST and cross-batch edges in the emitter
+      OrderedEmitter em(out, pcfg, 1);
       while (rdr->next(v)) {
-        if (pcfg.print_fn) {
-          string fn = v.file ? v.file : string("-");
-          fnp.open(fn, raw_idx);
-        }
-        for (size_t i=0;i<v.n;++i) {
-          ++raw_idx;
-          int64_t t = v.ts ? v.ts[i] : 0;
-
-          if (!have_prev) {
-            // FIRST edge
-            string first_line = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-            cout << first_line << ';' << first_line << ';';
-            print_gap_s_ms(cout, 0);
-            cout << '\n';
-
-            have_prev = true; prev_ts = t; prev_i = i; prev_raw_idx = raw_idx;
-            prev_str = std::move(first_line); prev_str_ready = true;
-            continue;
-          }
-
-          if (t - prev_ts >= *pcfg.gap_ns) {
-            if (!prev_str_ready) { prev_str = render_line(prev_i); prev_str_ready = true; }
-            string cur = render_line(i);
-            ++printed_idx;
-            optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-            optional<uint64_t> raw1 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-            optional<uint64_t> raw2 = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(raw_idx) : nullopt;
-            print_prefix(cout, pcfg, nullptr, nullptr,
-                         printed_idx_opt.has_value()? printed_idx_opt : raw1, raw2);
-            cout << prev_str << ';' << cur << ';';
-            print_gap_s_ms(cout, t - prev_ts);
-            cout << '\n';
-          }
-
-          prev_ts = t;
-          prev_i = i;
-          prev_raw_idx = raw_idx;
-          prev_str_ready = false;
-        }
-        if (have_prev && !prev_str_ready) { prev_str = render_line(prev_i); prev_str_ready = true; }
+        Chunk c;
+        ChunkBuilder b(c, pcfg, em.needs_lines());
+        if (pcfg.print_fn) b.file(v.file ? v.file : string("-"));
+        b.block(v.ts, v.n, render_line);
+        em.emit(c);
       }
-
-      // LAST edge
-      if (have_prev) {
-        ++printed_idx;
-        optional<uint64_t> printed_idx_opt = (pcfg.idx_mode==IdxMode::Printed)? optional<uint64_t>(printed_idx) : nullopt;
-        optional<uint64_t> raw_same = (pcfg.idx_mode==IdxMode::Raw)? optional<uint64_t>(prev_raw_idx) : nullopt;
-        print_prefix(cout, pcfg, nullptr, nullptr,
-                     printed_idx_opt.has_value()? printed_idx_opt : raw_same, raw_same);
-        cout << prev_str << ';' << prev_str << ';';
-        print_gap_s_ms(cout, 0);
-        cout << '\n';
-      }
-
-      fnp.finish(raw_idx);
+      em.finish();
     }
+    if (debug) print_reader_stats("depth", rdr->stats());
   }
   else {
     cerr << "Internal error: unknown base type\n";
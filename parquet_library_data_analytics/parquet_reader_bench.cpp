@@ -0,0 +1,222 @@
+// parquet_reader_bench.cpp (rows/s of ShardedDB readers per I/O backend, cold vs warm page cache)
+// Build:
+//   g++ -std=gnu++23 -O3 -DNDEBUG parquet_reader_bench.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_reader_bench
+//   g++ -std=gnu++23 -O3 -DNDEBUG -DPQ_WITH_URING parquet_reader_bench.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -luring -o parquet_reader_bench
+//
+// Usage:
+//   parquet_reader_bench <root> <symb> <top|trade|depth> [--start=SEC] [--end=SEC]
+//                        [--market=spot|fut] [--sampling=100ms|1s|60s] [--buf=BYTES] [--qd=N]
+//                        [--reps=N] [--pipeline=N] [--backends=pread,bufread,mmap,uring]
+//                        [--decoders=bulk,legacy]
+//
+// "cold" evicts the shard files from the page cache (posix_fadvise DONTNEED; dirty
+// pages and other readers can keep some of them resident) before every rep,
+// "warm" reads the window once and then measures. Both print the best rep.
+//
+// For depth, --decoders=bulk,legacy runs every backend with both list decoders
+// (before/after of the bulk rep/def-level path), e.g. on the sample day:
+//   mkdir -p /tmp/pq/depth_spot/DFUSDT
+//   ln -s $PWD/bn_depth_spot_DFUSDT_2025_7_2.parquet /tmp/pq/depth_spot/DFUSDT/
+//   parquet_reader_bench /tmp/pq DFUSDT depth --market=spot --backends=pread --decoders=bulk,legacy
+
+#include "parquet_reader_lib.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+  #include <fcntl.h>
+  #include <unistd.h>
+#endif
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static int64_t to_ns(double sec) { return static_cast<int64_t>(sec * 1e9); }
+
+static volatile uint64_t g_sink = 0;  // keeps the per-row ts loop from being optimised away
+
+struct Backend
+{
+  string name;
+  IoOptions io;
+  bool legacy_depth = false;
+};
+
+// Drop cached pages of every parquet shard of symb under root
+static size_t evict_page_cache(const string& root, const string& symb)
+{
+  size_t n = 0;
+#if defined(__linux__)
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(root, ec); it != fs::recursive_directory_iterator(); it.increment(ec))
+  {
+    if (ec) break;
+    if (!it->is_regular_file(ec)) continue;
+    const string p = it->path().string();
+    if (it->path().extension() != ".parquet") continue;
+    if (it->path().filename().string().find(symb) == string::npos) continue;
+
+    int fd = ::open(p.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) continue;
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+    ++n;
+  }
+#else
+  (void)root; (void)symb;
+#endif
+  return n;
+}
+
+// Read the whole window once, touching every ts so the decode cannot be skipped
+static uint64_t run_once(const ShardedDB& db, const string& kind, int64_t s, int64_t e,
+                         const string& symb, const optional<string>& market, uint64_t& checksum)
+{
+  uint64_t rows = 0;
+  if (kind == "top")
+  {
+    auto rdr = db.get_top_cols(s, e, symb, market);
+    TopColsView v;
+    while (rdr->next(v)) { rows += v.n; for (size_t i = 0; i < v.n; ++i) checksum += static_cast<uint64_t>(v.ts[i]); }
+  }
+  else if (kind == "trade")
+  {
+    auto rdr = db.get_trade_cols(s, e, symb, market);
+    TradeColsView v;
+    while (rdr->next(v)) { rows += v.n; for (size_t i = 0; i < v.n; ++i) checksum += static_cast<uint64_t>(v.ts[i]); }
+  }
+  else
+  {
+    auto rdr = db.get_depth_cols(s, e, symb, market);
+    DeltaColsView v;
+    while (rdr->next(v)) { rows += v.n; for (size_t i = 0; i < v.n; ++i) checksum += static_cast<uint64_t>(v.ts[i]); }
+  }
+  return rows;
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4) {
+    cerr << "Usage: " << argv[0] << " <root> <symb> <top|trade|depth>\n"
+         << "        [--start=SEC] [--end=SEC] [--market=spot|fut] [--sampling=100ms|1s|60s]\n"
+         << "        [--buf=BYTES]   (buffer size of the 'bufread' backend; default: 1048576)\n"
+         << "        [--qd=N]        (io_uring queue depth; default: 64)\n"
+         << "        [--reps=N]      (default: 3)\n"
+         << "        [--pipeline=N]  (decode threads; default: 0)\n"
+         << "        [--backends=pread,bufread,mmap,uring]\n"
+         << "        [--decoders=bulk,legacy]  (depth list decoders to compare; default: bulk)\n";
+    return 1;
+  }
+
+  const string root = argv[1];
+  const string symb = argv[2];
+  const string kind = argv[3];
+  if (kind != "top" && kind != "trade" && kind != "depth") { cerr << "ERROR: type must be top|trade|depth\n"; return 1; }
+
+  double start_sec = 1672531200.0;  // 2023-01-01
+  double end_sec   = 2082758400.0;  // 2036-01-01
+  optional<string> market;
+  optional<string> sampling;
+  size_t buf = 1u << 20;
+  unsigned qd = 64;
+  int reps = 3;
+  PipelineOptions pipe;
+  string backends_csv = "pread,bufread,mmap,uring";
+  string decoders_csv = "bulk";
+
+  for (int i = 4; i < argc; ++i) {
+    string a = argv[i];
+    try {
+      if (a.rfind("--start=",0)==0)         start_sec = stod(a.substr(8));
+      else if (a.rfind("--end=",0)==0)      end_sec = stod(a.substr(6));
+      else if (a.rfind("--market=",0)==0)   market = a.substr(9);
+      else if (a.rfind("--sampling=",0)==0) sampling = a.substr(11);
+      else if (a.rfind("--buf=",0)==0)      buf = static_cast<size_t>(stoull(a.substr(6)));
+      else if (a.rfind("--qd=",0)==0)       qd = static_cast<unsigned>(stoul(a.substr(5)));
+      else if (a.rfind("--reps=",0)==0)     reps = max(1, stoi(a.substr(7)));
+      else if (a.rfind("--pipeline=",0)==0) pipe.threads = static_cast<unsigned>(stoul(a.substr(11)));
+      else if (a.rfind("--backends=",0)==0) backends_csv = a.substr(11);
+      else if (a.rfind("--decoders=",0)==0) decoders_csv = a.substr(11);
+      else { cerr << "ERROR: unknown argument " << a << "\n"; return 1; }
+    } catch (...) { cerr << "ERROR: bad value in " << a << "\n"; return 1; }
+  }
+  if (end_sec <= start_sec) { cerr << "ERROR: end <= start\n"; return 1; }
+
+  vector<bool> decoders;  // legacy_depth per run
+  {
+    stringstream ss(decoders_csv);
+    string d;
+    while (getline(ss, d, ',')) {
+      if (d == "bulk")        decoders.push_back(false);
+      else if (d == "legacy") decoders.push_back(true);
+      else { cerr << "ERROR: unknown decoder " << d << "\n"; return 1; }
+    }
+    if (kind != "depth") decoders.assign(1, false);
+  }
+
+  vector<Backend> backends;
+  {
+    stringstream ss(backends_csv);
+    string b;
+    while (getline(ss, b, ',')) {
+      Backend x{b, {}};
+      if (b == "pread")        x.io.backend = IoBackend::Pread;
+      else if (b == "bufread") { x.io.backend = IoBackend::Pread; x.io.buffer_size = buf; }
+      else if (b == "mmap")    x.io.backend = IoBackend::Mmap;
+      else if (b == "uring")   { x.io.backend = IoBackend::Uring; x.io.queue_depth = qd; }
+      else { cerr << "ERROR: unknown backend " << b << "\n"; return 1; }
+      for (bool legacy : decoders) {
+        x.legacy_depth = legacy;
+        if (kind == "depth") x.name = b + (legacy ? "/legacy" : "/bulk");
+        backends.push_back(x);
+      }
+    }
+  }
+
+  const int64_t s = to_ns(start_sec);
+  const int64_t e = to_ns(end_sec);
+
+  cout << left << setw(16) << "backend" << setw(6) << "cache"
+       << right << setw(14) << "rows" << setw(10) << "sec" << setw(12) << "Mrows/s" << "\n";
+
+  for (const auto& b : backends)
+  {
+    ShardedDB::set_legacy_depth_decode(b.legacy_depth);
+    ShardedDB db(root, sampling);
+    db.set_pipeline(pipe);
+    db.set_io(b.io);
+
+    for (const char* cache : {"cold", "warm"})
+    {
+      const bool cold = string(cache) == "cold";
+      uint64_t checksum = 0;
+      if (!cold) run_once(db, kind, s, e, symb, market, checksum);
+
+      double best = 0.0;
+      uint64_t rows = 0;
+      for (int r = 0; r < reps; ++r)
+      {
+        if (cold) evict_page_cache(root, symb);
+        auto t0 = chrono::steady_clock::now();
+        rows = run_once(db, kind, s, e, symb, market, checksum);
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - t0).count();
+        if (r == 0 || sec < best) best = sec;
+      }
+
+      cout << left << setw(16) << b.name << setw(6) << cache
+           << right << setw(14) << rows << setw(10) << fixed << setprecision(3) << best
+           << setw(12) << setprecision(2) << (best > 0 ? rows / best / 1e6 : 0.0) << "\n";
+      g_sink = g_sink + checksum;
+    }
+  }
+  return 0;
+}
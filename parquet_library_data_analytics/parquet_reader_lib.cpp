@@ -3,31 +3,65 @@
 
 #include "parquet_reader_lib.h"
 
+#include <arrow/buffer.h>
+#include <arrow/io/caching.h>
+#include <arrow/io/interfaces.h>
+#include <arrow/util/future.h>
 #include <parquet/api/reader.h>
 #include <parquet/schema.h>
+#include <parquet/statistics.h>
 
 #include <algorithm>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
 #include <cstdint>
+#include <cstdlib>
+#include <cstring>
 #include <ctime>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <functional>
+#include <future>
 #include <iomanip>
 #include <iostream>
+#include <limits>
+#include <list>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
+#include <queue>
+#include <span>
 #include <stdexcept>
 #include <sstream>
 #include <string>
+#include <thread>
+#include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 
 #if defined(__linux__)
   #include <fcntl.h>
+  #include <sys/mman.h>
   #include <sys/stat.h>
   #include <unistd.h>
 #endif
 
+#if defined(__SSE2__)
+  #include <emmintrin.h>
+#endif
+
+#if defined(PQ_WITH_URING) && defined(__linux__) && __has_include(<liburing.h>)
+  #include <liburing.h>
+  #define PQ_HAVE_URING 1
+#else
+  #define PQ_HAVE_URING 0
+#endif
+
 using namespace std;
 namespace fs = std::filesystem;
 
@@ -35,27 +69,613 @@ namespace fs = std::filesystem;
 static bool g_debug = false;
 void ShardedDB::set_debug(bool enabled) { g_debug = enabled; }
 
-static bool g_prefetch = false;
+static bool g_prefetch = false;  // read-ahead with default options for DBs without set_readahead
 void ShardedDB::set_prefetch(bool enabled) { g_prefetch = enabled; }
 
-// Small Linux prefetch helper (no-op elsewhere)
-static inline void prefetch_path(const std::string& path) {
-#if defined(__linux__)
-  if (!g_prefetch) return;
-  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
-  if (fd < 0) return;
-  struct stat st{};
-  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_SEQUENTIAL);
-    posix_fadvise(fd, 0, st.st_size, POSIX_FADV_WILLNEED);
-    readahead(fd, 0, static_cast<size_t>(st.st_size));
-  }
-  ::close(fd);
-#else
-  (void)path;
+static bool g_huge_pages = false;
+void ShardedDB::set_huge_pages(bool enabled) { g_huge_pages = enabled; }
+
+static bool g_legacy_depth = false;
+void ShardedDB::set_legacy_depth_decode(bool enabled) { g_legacy_depth = enabled; }
+
+// ======== I/O backends (see IoOptions) ========
+
+#if PQ_HAVE_URING
+// RandomAccessFile on top of one io_uring per open file. Single reads are
+// submitted and waited for one by one; ReadManyAsync (what the Parquet
+// pre-buffer cache calls with the coalesced column-chunk ranges) queues all
+// ranges at once and reaps them together.
+class UringFile final : public arrow::io::RandomAccessFile
+{
+public:
+  static shared_ptr<UringFile> Open(const string& path, unsigned entries)
+  {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) throw runtime_error("open failed: " + string(strerror(errno)));
+
+    shared_ptr<UringFile> f(new UringFile(fd));
+    struct stat st{};
+    if (::fstat(fd, &st) != 0) throw runtime_error("fstat failed: " + string(strerror(errno)));
+    f->size_ = st.st_size;
+
+    int rc = io_uring_queue_init(entries, &f->ring_, 0);
+    if (rc < 0) throw runtime_error("io_uring_queue_init: " + string(strerror(-rc)));
+    f->entries_ = entries;
+    return f;
+  }
+
+  ~UringFile() override { close_fd(); }
+
+  arrow::Status Close() override { close_fd(); return arrow::Status::OK(); }
+  bool closed() const override { return fd_ < 0; }
+  arrow::Result<int64_t> GetSize() override { return size_; }
+  arrow::Result<int64_t> Tell() const override { return pos_; }
+  arrow::Status Seek(int64_t pos) override { pos_ = pos; return arrow::Status::OK(); }
+
+  arrow::Result<int64_t> Read(int64_t nbytes, void* out) override
+  {
+    ARROW_ASSIGN_OR_RAISE(int64_t n, ReadAt(pos_, nbytes, out));
+    pos_ += n;
+    return n;
+  }
+
+  arrow::Result<shared_ptr<arrow::Buffer>> Read(int64_t nbytes) override
+  {
+    ARROW_ASSIGN_OR_RAISE(auto buf, ReadAt(pos_, nbytes));
+    pos_ += buf->size();
+    return buf;
+  }
+
+  arrow::Result<int64_t> ReadAt(int64_t pos, int64_t nbytes, void* out) override
+  {
+    lock_guard<mutex> lk(m_);
+    if (fd_ < 0) return arrow::Status::IOError("uring: file closed");
+    return read_locked(pos, nbytes, static_cast<uint8_t*>(out));
+  }
+
+  arrow::Result<shared_ptr<arrow::Buffer>> ReadAt(int64_t pos, int64_t nbytes) override
+  {
+    ARROW_ASSIGN_OR_RAISE(auto buf, arrow::AllocateResizableBuffer(nbytes));
+    ARROW_ASSIGN_OR_RAISE(int64_t n, ReadAt(pos, nbytes, buf->mutable_data()));
+    ARROW_RETURN_NOT_OK(buf->Resize(n));
+    return shared_ptr<arrow::Buffer>(move(buf));
+  }
+
+  vector<arrow::Future<shared_ptr<arrow::Buffer>>> ReadManyAsync(
+      const arrow::io::IOContext&, const vector<arrow::io::ReadRange>& ranges) override
+  {
+    vector<arrow::Future<shared_ptr<arrow::Buffer>>> out;
+    out.reserve(ranges.size());
+
+    vector<unique_ptr<arrow::ResizableBuffer>> bufs(ranges.size());
+    vector<int64_t> got(ranges.size(), 0);
+    vector<arrow::Status> err(ranges.size(), arrow::Status::OK());
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      auto r = arrow::AllocateResizableBuffer(ranges[i].length);
+      if (r.ok()) bufs[i] = move(*r);
+      else err[i] = r.status();
+    }
+
+    {
+      lock_guard<mutex> lk(m_);
+
+      // Submit up to entries_ reads at a time, then wait for the whole wave
+      for (size_t base = 0; base < ranges.size(); base += entries_)
+      {
+        const size_t end = min(ranges.size(), base + entries_);
+        unsigned queued = 0;
+        for (size_t i = base; i < end; ++i)
+        {
+          if (!bufs[i] || ranges[i].length == 0) continue;
+          io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+          if (!sqe) break;
+          io_uring_prep_read(sqe, fd_, bufs[i]->mutable_data(), static_cast<unsigned>(ranges[i].length),
+                             static_cast<uint64_t>(ranges[i].offset));
+          io_uring_sqe_set_data64(sqe, i);
+          ++queued;
+        }
+        if (queued == 0) continue;
+
+        int rc = io_uring_submit_and_wait(&ring_, queued);
+        if (rc < 0)
+        {
+          for (size_t i = base; i < end; ++i) err[i] = arrow::Status::IOError("uring submit: ", strerror(-rc));
+          continue;
+        }
+        for (unsigned k = 0; k < queued; ++k)
+        {
+          io_uring_cqe* cqe = nullptr;
+          if (io_uring_wait_cqe(&ring_, &cqe) < 0 || !cqe) break;
+          const size_t i = io_uring_cqe_get_data64(cqe);
+          if (cqe->res < 0) err[i] = arrow::Status::IOError("uring read: ", strerror(-cqe->res));
+          else got[i] = cqe->res;
+          io_uring_cqe_seen(&ring_, cqe);
+        }
+      }
+
+      // Short reads (or ranges that did not fit a wave) finish synchronously
+      for (size_t i = 0; i < ranges.size(); ++i)
+      {
+        if (!err[i].ok() || !bufs[i] || got[i] >= ranges[i].length) continue;
+        auto r = read_locked(ranges[i].offset + got[i], ranges[i].length - got[i], bufs[i]->mutable_data() + got[i]);
+        if (r.ok()) got[i] += *r;
+        else err[i] = r.status();
+      }
+    }
+
+    for (size_t i = 0; i < ranges.size(); ++i)
+    {
+      if (err[i].ok()) err[i] = bufs[i]->Resize(got[i]);
+      if (!err[i].ok()) out.push_back(arrow::Future<shared_ptr<arrow::Buffer>>::MakeFinished(err[i]));
+      else out.push_back(arrow::Future<shared_ptr<arrow::Buffer>>::MakeFinished(shared_ptr<arrow::Buffer>(move(bufs[i]))));
+    }
+    return out;
+  }
+
+private:
+  explicit UringFile(int fd) : fd_(fd) {}
+
+  arrow::Result<int64_t> read_locked(int64_t pos, int64_t nbytes, uint8_t* out)
+  {
+    int64_t done = 0;
+    while (done < nbytes)
+    {
+      io_uring_sqe* sqe = io_uring_get_sqe(&ring_);
+      if (!sqe) return arrow::Status::IOError("uring: submission queue full");
+      io_uring_prep_read(sqe, fd_, out + done, static_cast<unsigned>(nbytes - done), static_cast<uint64_t>(pos + done));
+
+      io_uring_cqe* cqe = nullptr;
+      int rc = io_uring_submit_and_wait(&ring_, 1);
+      if (rc >= 0) rc = io_uring_wait_cqe(&ring_, &cqe);
+      if (rc < 0) return arrow::Status::IOError("uring: ", strerror(-rc));
+
+      const int res = cqe->res;
+      io_uring_cqe_seen(&ring_, cqe);
+      if (res < 0) return arrow::Status::IOError("uring read: ", strerror(-res));
+      if (res == 0) break;  // EOF
+      done += res;
+    }
+    return done;
+  }
+
+  void close_fd()
+  {
+    lock_guard<mutex> lk(m_);
+    if (fd_ < 0) return;
+    if (entries_ > 0) io_uring_queue_exit(&ring_);
+    ::close(fd_);
+    fd_ = -1;
+  }
+
+  mutex m_;
+  io_uring ring_{};
+  unsigned entries_ = 0;
+  int fd_ = -1;
+  int64_t size_ = 0;
+  int64_t pos_ = 0;
+};
+#endif
+
+static unique_ptr<parquet::ParquetFileReader> open_parquet(const string& path, const IoOptions& io)
+{
+  parquet::ReaderProperties props = parquet::default_reader_properties();
+  if (io.buffer_size > 0)
+  {
+    props.enable_buffered_stream();
+    props.set_buffer_size(static_cast<int64_t>(io.buffer_size));
+  }
+
+  switch (io.backend)
+  {
+    case IoBackend::Mmap:
+      return parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/true, props);
+    case IoBackend::Uring:
+#if PQ_HAVE_URING
+      return parquet::ParquetFileReader::Open(UringFile::Open(path, io.queue_depth), props);
 #endif
+    case IoBackend::Pread:
+      break;
+  }
+  return parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false, props);
+}
+
+// ======== Open-file cache (per ShardedDB, see set_file_cache) ========
+//
+// Idle ParquetFileReaders with their parsed footers, most recently returned
+// first. A streamer takes a handle out for its whole lifetime and puts it back
+// when it closes, so a handle is never shared between readers (pre-buffering
+// and read state stay private); a concurrent query of the same file simply
+// opens a second one. Entries remember size + mtime and are dropped when the
+// file on disk changed.
+
+struct FileStamp
+{
+  int64_t size  = -1;
+  int64_t mtime = -1;
+  bool operator==(const FileStamp&) const = default;
+};
+
+static FileStamp file_stamp(const string& path)
+{
+  std::error_code ec;
+  FileStamp st;
+  auto sz = fs::file_size(path, ec);
+  if (!ec) st.size = static_cast<int64_t>(sz);
+  auto mt = fs::last_write_time(path, ec);
+  if (!ec) st.mtime = static_cast<int64_t>(mt.time_since_epoch().count());
+  return st;
+}
+
+struct OpenedFile
+{
+  unique_ptr<parquet::ParquetFileReader> reader;
+  shared_ptr<parquet::FileMetaData> md;
+  FileStamp stamp;
+};
+
+class FileHandleCache
+{
+public:
+  explicit FileHandleCache(size_t capacity) : capacity_(capacity) {}
+
+  // An idle handle for path (exclusively the caller's until put back), or a fresh open
+  OpenedFile take(const string& path, const IoOptions& io)
+  {
+    const string key = cache_key(path, io);
+    const FileStamp stamp = file_stamp(path);
+    OpenedFile stale;
+    {
+      lock_guard<mutex> lk(m_);
+      auto it = index_.find(key);
+      if (it != index_.end())
+      {
+        OpenedFile f = move(it->second->file);
+        lru_.erase(it->second);
+        index_.erase(it);
+        if (f.stamp == stamp)
+        {
+          ++hits_;
+          return f;
+        }
+        stale = move(f);  // closed outside the lock
+      }
+      ++misses_;
+    }
+
+    OpenedFile f;
+    f.reader = open_parquet(path, io);
+    f.md     = f.reader->metadata();
+    f.stamp  = stamp;
+    return f;
+  }
+
+  void put(const string& path, const IoOptions& io, OpenedFile f)
+  {
+    vector<OpenedFile> drop;  // closed outside the lock
+    {
+      lock_guard<mutex> lk(m_);
+      string key = cache_key(path, io);
+      if (capacity_ == 0 || index_.count(key))
+      {
+        drop.push_back(move(f));
+      }
+      else
+      {
+        lru_.push_front(Entry{key, move(f)});
+        index_.emplace(move(key), lru_.begin());
+        trim_locked(drop);
+      }
+    }
+  }
+
+  void set_capacity(size_t capacity)
+  {
+    vector<OpenedFile> drop;
+    lock_guard<mutex> lk(m_);
+    capacity_ = capacity;
+    trim_locked(drop);
+  }
+
+  FileCacheStats stats() const
+  {
+    lock_guard<mutex> lk(m_);
+    FileCacheStats st;
+    st.hits      = hits_;
+    st.misses    = misses_;
+    st.evictions = evictions_;
+    st.size      = lru_.size();
+    st.capacity  = capacity_;
+    return st;
+  }
+
+private:
+  struct Entry
+  {
+    string key;
+    OpenedFile file;
+  };
+
+  // Handles opened with different backends are not interchangeable
+  static string cache_key(const string& path, const IoOptions& io)
+  {
+    return path + '\0' + to_string(static_cast<int>(io.backend)) + ':' + to_string(io.buffer_size)
+         + ':' + to_string(io.queue_depth);
+  }
+
+  void trim_locked(vector<OpenedFile>& drop)
+  {
+    while (lru_.size() > capacity_)
+    {
+      index_.erase(lru_.back().key);
+      drop.push_back(move(lru_.back().file));
+      lru_.pop_back();
+      ++evictions_;
+    }
+  }
+
+  mutable mutex m_;
+  size_t capacity_;
+  list<Entry> lru_;
+  unordered_map<string, list<Entry>::iterator> index_;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+class ReadAhead;
+
+// How readers open shards: backend options + the owning DB's handle cache
+struct FileOpener
+{
+  IoOptions io;
+  shared_ptr<FileHandleCache> cache;  // null = always open afresh
+  shared_ptr<ReadAhead> readahead;    // null = no read-ahead of the next files
+};
+
+// ======== Decoded column-chunk cache (process-wide, see set_chunk_cache) ========
+//
+// Fully decoded required columns of one row group, keyed by file (path + size
+// + mtime), row group and leaf column, shared by every reader in the process.
+// Concurrent readers of a hot chunk decode it once: the first miss decodes,
+// later requests wait for its result, and each reader copies its row range
+// out. Entries are reference counted, so LRU eviction within the byte budget
+// never pulls a chunk from under a reader that is still copying from it.
+
+struct DecodedChunk
+{
+  vector<int64_t> i64;
+  vector<uint8_t> u8;  // BOOLEAN columns, 0/1
+
+  size_t bytes() const { return i64.size() * sizeof(int64_t) + u8.size(); }
+};
+
+class ChunkCache
+{
+public:
+  using Ptr = shared_ptr<const DecodedChunk>;
+
+  explicit ChunkCache(size_t budget) : budget_(budget) {}
+
+  // The chunk for key; on a miss decode() runs on the caller's thread
+  template <class Decode>
+  Ptr get(const string& key, Decode&& decode)
+  {
+    promise<Ptr> mine;
+    uint64_t id = 0;
+    {
+      unique_lock<mutex> lk(m_);
+      auto it = index_.find(key);
+      if (it != index_.end())
+      {
+        ++hits_;
+        lru_.splice(lru_.begin(), lru_, it->second);
+        shared_future<Ptr> f = it->second->value;
+        lk.unlock();  // an in-flight decode is waited for without the lock
+        return f.get();
+      }
+      ++misses_;
+      id = ++next_id_;
+      lru_.push_front(Entry{key, mine.get_future().share(), 0, id});
+      index_.emplace(key, lru_.begin());
+    }
+
+    try
+    {
+      Ptr p = make_shared<const DecodedChunk>(decode());
+      mine.set_value(p);
+
+      vector<Ptr> drop;  // freed outside the lock
+      lock_guard<mutex> lk(m_);
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second->id == id)
+      {
+        it->second->bytes = p->bytes();
+        it->second->ready = true;
+        bytes_ += p->bytes();
+        trim_locked(drop);
+      }
+      return p;
+    }
+    catch (...)
+    {
+      mine.set_exception(current_exception());
+      lock_guard<mutex> lk(m_);
+      auto it = index_.find(key);
+      if (it != index_.end() && it->second->id == id)
+      {
+        lru_.erase(it->second);
+        index_.erase(it);
+      }
+      throw;
+    }
+  }
+
+  void set_budget(size_t budget)
+  {
+    vector<Ptr> drop;
+    lock_guard<mutex> lk(m_);
+    budget_ = budget;
+    trim_locked(drop);
+  }
+
+  ChunkCacheStats stats() const
+  {
+    lock_guard<mutex> lk(m_);
+    ChunkCacheStats st;
+    st.hits         = hits_;
+    st.misses       = misses_;
+    st.evictions    = evictions_;
+    st.entries      = lru_.size();
+    st.bytes        = bytes_;
+    st.budget_bytes = budget_;
+    return st;
+  }
+
+private:
+  struct Entry
+  {
+    string key;
+    shared_future<Ptr> value;
+    size_t bytes = 0;  // 0 while the decode is in flight
+    uint64_t id = 0;
+    bool ready = false;  // decoded; in-flight entries hold no bytes and are never evicted
+  };
+
+  // Evict from the LRU tail, stepping over in-flight entries so readers that
+  // join a running decode keep finding it
+  void trim_locked(vector<Ptr>& drop)
+  {
+    auto it = lru_.end();
+    while (bytes_ > budget_ && it != lru_.begin())
+    {
+      --it;
+      if (!it->ready) continue;
+      drop.push_back(it->value.get());
+      bytes_ -= it->bytes;
+      index_.erase(it->key);
+      it = lru_.erase(it);
+      ++evictions_;
+    }
+  }
+
+  mutable mutex m_;
+  size_t budget_;
+  size_t bytes_ = 0;
+  list<Entry> lru_;
+  unordered_map<string, list<Entry>::iterator> index_;
+  uint64_t next_id_ = 0;
+  uint64_t hits_ = 0;
+  uint64_t misses_ = 0;
+  uint64_t evictions_ = 0;
+};
+
+static mutex g_chunk_cache_m;
+static shared_ptr<ChunkCache> g_chunk_cache;  // null = off
+
+static shared_ptr<ChunkCache> chunk_cache()
+{
+  lock_guard<mutex> lk(g_chunk_cache_m);
+  return g_chunk_cache;
+}
+
+void ShardedDB::set_chunk_cache(size_t budget_bytes)
+{
+  lock_guard<mutex> lk(g_chunk_cache_m);
+  if (budget_bytes == 0) g_chunk_cache.reset();  // readers holding it finish with it
+  else if (g_chunk_cache) g_chunk_cache->set_budget(budget_bytes);
+  else g_chunk_cache = make_shared<ChunkCache>(budget_bytes);
+}
+
+ChunkCacheStats ShardedDB::chunk_cache_stats()
+{
+  auto c = chunk_cache();
+  return c ? c->stats() : ChunkCacheStats{};
 }
 
+// ======== Scratch arena (per-row-group decode temporaries) ========
+//
+// Bump allocator owned by each decode buffer. reset() at the start of a row
+// group keeps the blocks, so once the arena has seen the widest row group,
+// decoding draws every temporary (unsorted ts copy, scatter columns, depth
+// cursor batches) without touching the heap. Block allocations are counted
+// and surface as ReaderStats::scratch_allocs.
+
+class ScratchArena
+{
+public:
+  static constexpr size_t ALIGN     = 64;         // cache line
+  static constexpr size_t HUGE_PAGE = 2u << 20;
+  static constexpr size_t MIN_BLOCK = 1u << 20;
+
+  // n uninitialised, ALIGN-aligned elements; valid until the next reset()
+  template <class T>
+  T* alloc(size_t n)
+  {
+    static_assert(is_trivially_copyable_v<T> && alignof(T) <= ALIGN);
+    const size_t need = round_up(n * sizeof(T), ALIGN);
+    while (cur_ < blocks_.size() && off_ + need > blocks_[cur_].cap) { ++cur_; off_ = 0; }
+    if (cur_ == blocks_.size()) add_block(need);
+
+    T* p = reinterpret_cast<T*>(blocks_[cur_].mem.get() + off_);
+    off_ += need;
+    return p;
+  }
+
+  // Start over. A row group that spilled into several blocks gets them folded
+  // into one, so a steady stream of similar row groups bumps through a single block.
+  void reset()
+  {
+    if (blocks_.size() > 1)
+    {
+      size_t total = 0;
+      for (const auto& b : blocks_) total += b.cap;
+      blocks_.clear();
+      add_block(total);
+    }
+    cur_ = 0;
+    off_ = 0;
+  }
+
+  // Block allocations since the previous call
+  uint64_t take_allocs() { return exchange(allocs_, 0); }
+
+private:
+  struct FreeBlock { void operator()(uint8_t* p) const { free(p); } };
+  struct Block
+  {
+    unique_ptr<uint8_t, FreeBlock> mem;
+    size_t cap = 0;
+  };
+
+  static size_t round_up(size_t n, size_t a) { return (n + a - 1) / a * a; }
+
+  void add_block(size_t need)
+  {
+    size_t cap = max(need, MIN_BLOCK);
+    if (!blocks_.empty()) cap = max(cap, blocks_.back().cap * 2);
+
+    const size_t align = g_huge_pages ? HUGE_PAGE : ALIGN;
+    cap = round_up(cap, align);
+    void* p = aligned_alloc(align, cap);
+    if (!p) throw bad_alloc();
+#if defined(__linux__) && defined(MADV_HUGEPAGE)
+    if (g_huge_pages) madvise(p, cap, MADV_HUGEPAGE);
+#endif
+
+    blocks_.push_back(Block{unique_ptr<uint8_t, FreeBlock>(static_cast<uint8_t*>(p)), cap});
+    cur_ = blocks_.size() - 1;
+    off_ = 0;
+    ++allocs_;
+  }
+
+  vector<Block> blocks_;
+  size_t cur_ = 0;
+  size_t off_ = 0;
+  uint64_t allocs_ = 0;
+};
+
 // ======== Internal low-level batched cursor (used by nested depth path) ========
 
 struct Entry
@@ -79,9 +699,9 @@ struct Int64Cursor
   Entry pending;
 
   static constexpr int64_t BATCH = 65536;
-  vector<int16_t> defbuf;
-  vector<int16_t> repbuf;
-  vector<int64_t> valbuf;
+  int16_t* defbuf = nullptr;  // batch buffers live in the caller's ScratchArena
+  int16_t* repbuf = nullptr;
+  int64_t* valbuf = nullptr;
   int64_t levels_in_buf = 0;
   int64_t level_idx = 0;
   int64_t values_in_buf = 0;
@@ -89,7 +709,7 @@ struct Int64Cursor
 
   Int64Cursor() = default;
 
-  Int64Cursor(shared_ptr<parquet::ColumnReader> col, const parquet::ColumnDescriptor* descr)
+  Int64Cursor(shared_ptr<parquet::ColumnReader> col, const parquet::ColumnDescriptor* descr, ScratchArena& scratch)
   :
     holder(move(col))
   {
@@ -102,9 +722,9 @@ struct Int64Cursor
     max_def = descr->max_definition_level();
     max_rep = descr->max_repetition_level();
 
-    if (max_def) defbuf.resize(BATCH);
-    if (max_rep) repbuf.resize(BATCH);
-    valbuf.resize(BATCH);
+    if (max_def) defbuf = scratch.alloc<int16_t>(BATCH);
+    if (max_rep) repbuf = scratch.alloc<int16_t>(BATCH);
+    valbuf = scratch.alloc<int64_t>(BATCH);
   }
 
   bool refill()
@@ -114,9 +734,9 @@ struct Int64Cursor
     int64_t values_read = 0;
     levels_in_buf = r->ReadBatch(
         BATCH,
-        max_def ? defbuf.data() : nullptr,
-        max_rep ? repbuf.data() : nullptr,
-        valbuf.data(),
+        max_def ? defbuf : nullptr,
+        max_rep ? repbuf : nullptr,
+        valbuf,
         &values_read);
 
     if (levels_in_buf == 0)
@@ -180,18 +800,6 @@ struct Int64Cursor
   }
 };
 
-static int find_col_idx(const parquet::SchemaDescriptor* schema, const string& name)
-{
-  for (int i = 0; i < schema->num_columns(); ++i)
-  {
-    if (schema->Column(i)->path()->ToDotString() == name)
-    {
-      return i;
-    }
-  }
-  return -1;
-}
-
 // Read LIST from a single leaf. Returns count appended.
 static uint32_t append_list_from_leaf_for_row(
     Int64Cursor& leaf,
@@ -263,60 +871,284 @@ static uint32_t append_list_pairs_for_row_typed(
   return count;
 }
 
-// ======== Date helpers & file mapping (chronological order) ========
-
-struct YMD { int year; int month; int day; };
+// ---- Bulk LIST<int64> decoding (nested depth path)
+//
+// A whole row group of a list leaf is read with one ReadBatch run into scratch
+// level/value buffers and converted in a single pass: row starts are the
+// rep == 0 levels, entries whose def reaches the repeated node are elements.
+// Null elements decode as 0, like the cursor path above.
 
-static YMD ymd_utc_from_ns(int64_t ns)
+// Def level of the leaf's repeated ancestor; entries at or above it are list elements
+static int16_t repeated_def_level(const parquet::ColumnDescriptor* descr)
 {
-  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
-  tm tm{};
-  gmtime_r(&s, &tm);
-  return {tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday};
+  const parquet::schema::Node* node = descr->schema_node().get();
+  while (node && !node->is_repeated()) node = node->parent();
+  if (!node) throw runtime_error("column is not a list leaf");
+
+  int16_t level = 0;
+  for (; node && node->parent(); node = node->parent())  // the schema root holds no level
+    if (!node->is_required()) ++level;
+  return level;
 }
 
-static int64_t floor_day_ns(int64_t ns)
+// Indices of rep == 0 in rep[0, n) into out (capacity cap); returns the count
+static size_t find_row_starts(const int16_t* rep, size_t n, uint32_t* out, size_t cap)
 {
-  int64_t sec = ns / 1'000'000'000LL;
-  int64_t day_sec = sec - (sec % 86400LL);
-  return day_sec * 1'000'000'000LL;
-}
+  size_t k = 0;
+  size_t i = 0;
+  auto emit = [&](size_t pos)
+  {
+    if (k == cap) throw runtime_error("list: more rows than the row group holds");
+    out[k++] = static_cast<uint32_t>(pos);
+  };
 
-static int64_t ymd_utc_start_ns(int Y, int M, int D)
-{
-  tm tm{};
-  tm.tm_year = Y - 1900;
-  tm.tm_mon  = M - 1;
-  tm.tm_mday = D;
-  tm.tm_hour = 0; tm.tm_min = 0; tm.tm_sec = 0;
-  time_t s = timegm(&tm); // GNU extension: UTC mktime
-  if (s == (time_t)-1) return 0;
-  return static_cast<int64_t>(s) * 1'000'000'000LL;
+#if defined(__SSE2__)
+  const __m128i zero = _mm_setzero_si128();
+  for (; i + 8 <= n; i += 8)
+  {
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rep + i));
+    unsigned m = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi16(v, zero)));
+    while (m)
+    {
+      const int bit = __builtin_ctz(m);
+      emit(i + static_cast<size_t>(bit) / 2);
+      m &= ~(3u << bit);  // two mask bits per 16-bit lane
+    }
+  }
+#endif
+  for (; i < n; ++i)
+    if (rep[i] == 0) emit(i);
+  return k;
 }
 
-static string iso_from_ns(int64_t ns)
+struct ListColumn
 {
-  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
-  tm tm{}; gmtime_r(&s, &tm);
-  ostringstream o;
-  o << setfill('0')
-    << setw(4) << (tm.tm_year + 1900) << '-'
-    << setw(2) << (tm.tm_mon + 1) << '-'
-    << setw(2) << tm.tm_mday << 'T'
-    << setw(2) << tm.tm_hour << ':'
-    << setw(2) << tm.tm_min  << ':'
-    << setw(2) << tm.tm_sec  << 'Z';
-  return o.str();
-}
+  const uint32_t* starts = nullptr;  // rows + 1 entries into vals
+  const int64_t*  vals   = nullptr;
+};
 
-struct Candidate
+static ListColumn decode_list_i64(parquet::RowGroupReader& rg, int col_idx, const parquet::ColumnDescriptor* descr,
+                                  int64_t rows, ScratchArena& scratch)
 {
-  string  path;
-  int64_t file_start_ns = 0;
-  int64_t file_end_ns   = 0;
-};
+  const int64_t levels = rg.metadata()->ColumnChunk(col_idx)->num_values();
+  const int16_t max_def = descr->max_definition_level();
+  const int16_t elem_def = repeated_def_level(descr);
 
-static string to_lower(string s) { for (auto& c:s) c=(char)tolower((unsigned char)c); return s; }
+  int16_t* def  = scratch.alloc<int16_t>(static_cast<size_t>(levels));
+  int16_t* rep  = scratch.alloc<int16_t>(static_cast<size_t>(levels));
+  int64_t* vals = scratch.alloc<int64_t>(static_cast<size_t>(levels));
+
+  shared_ptr<parquet::ColumnReader> holder = rg.Column(col_idx);
+  auto* r = dynamic_cast<parquet::Int64Reader*>(holder.get());
+  if (!r) throw runtime_error("Column is not INT64");
+
+  int64_t got = 0;
+  int64_t nvals = 0;
+  while (got < levels)
+  {
+    int64_t values_read = 0;
+    const int64_t n = r->ReadBatch(levels - got, def + got, rep + got, vals + nvals, &values_read);
+    if (n == 0) break;
+    got += n;
+    nvals += values_read;
+  }
+  if (got != levels) throw runtime_error("Short read in list column");
+
+  uint32_t* starts = scratch.alloc<uint32_t>(static_cast<size_t>(rows) + 1);
+  ListColumn out;
+  out.starts = starts;
+
+  if (nvals == levels)
+  {
+    // Every level is a present element: values are already packed and the
+    // element index of a row start is its level index.
+    if (static_cast<int64_t>(find_row_starts(rep, static_cast<size_t>(levels), starts, static_cast<size_t>(rows))) != rows)
+      throw runtime_error("list: row count mismatch");
+    starts[rows] = static_cast<uint32_t>(levels);
+    out.vals = vals;
+    return out;
+  }
+
+  // Empty/null lists or null elements: pack elements into a separate buffer
+  int64_t* packed = scratch.alloc<int64_t>(static_cast<size_t>(levels));
+  int64_t row = 0;
+  int64_t w = 0;
+  int64_t vi = 0;
+  for (int64_t i = 0; i < levels; ++i)
+  {
+    if (rep[i] == 0)
+    {
+      if (row == rows) throw runtime_error("list: more rows than the row group holds");
+      starts[row++] = static_cast<uint32_t>(w);
+    }
+    if (def[i] >= elem_def) packed[w++] = (def[i] == max_def) ? vals[vi++] : 0;
+  }
+  if (row != rows) throw runtime_error("list: row count mismatch");
+  starts[rows] = static_cast<uint32_t>(w);
+  out.vals = packed;
+  return out;
+}
+
+// ======== Gap scan (find_gaps) ========
+//
+// The threshold test takes four ts pairs per SSE2 step: ts[i] - ts[i - 1] by
+// 64-bit lane subtraction, then "gap < threshold" from the sign of gap -
+// threshold with the overflow folded in (SSE2 has no 64-bit compare), and one
+// movemask of the lanes that are gaps. Stats are a separate branch-free pass,
+// only when asked for. Gaps wrap like two's complement int64 subtraction.
+
+static inline int64_t ts_gap(int64_t t, int64_t prev)
+{
+  return static_cast<int64_t>(static_cast<uint64_t>(t) - static_cast<uint64_t>(prev));
+}
+
+// Rows ts[0, n), ts[0] following prev
+static void add_gap_stats(const int64_t* ts, size_t n, int64_t prev, GapStats& st)
+{
+  if (n == 0) return;
+  if (st.hist.size() != st.bins_ns.size()) st.hist.assign(st.bins_ns.size(), 0);
+
+  uint64_t non_mono = 0, rep = 0, mx = st.max_gap_ns, sum = 0;
+  auto add = [&](int64_t d)
+  {
+    const uint64_t g = d > 0 ? static_cast<uint64_t>(d) : 0;
+    non_mono += d < 0;
+    rep += d == 0;
+    mx = max(mx, g);
+    sum += g;
+  };
+  add(ts_gap(ts[0], prev));
+  for (size_t i = 1; i < n; ++i) add(ts_gap(ts[i], ts[i - 1]));
+
+  if (!st.bins_ns.empty())
+  {
+    const int64_t* b = st.bins_ns.data();
+    const size_t nb = st.bins_ns.size();
+    for (size_t i = 0; i < n; ++i)
+    {
+      const int64_t d = ts_gap(ts[i], i ? ts[i - 1] : prev);
+      const uint64_t g = d > 0 ? static_cast<uint64_t>(d) : 0;
+      size_t k = 0;
+      for (size_t j = 0; j < nb; ++j) k += g >= static_cast<uint64_t>(b[j]);
+      if (k) ++st.hist[k - 1];
+    }
+  }
+
+  st.pairs += n;
+  st.non_monotonic += non_mono;
+  st.repeated += rep;
+  st.max_gap_ns = mx;
+  st.sum_gap_ns += sum;
+}
+
+size_t find_gaps(const int64_t* ts, size_t n, int64_t threshold_ns, GapCarry& carry,
+                 vector<uint32_t>* gaps, GapStats* stats)
+{
+  if (gaps) gaps->clear();
+  if (n == 0) return 0;
+  if (n > numeric_limits<uint32_t>::max()) throw runtime_error("find_gaps: batch too large");
+
+  size_t count = 0;
+  auto emit = [&](size_t i)
+  {
+    ++count;
+    if (gaps) gaps->push_back(static_cast<uint32_t>(i));
+  };
+
+  if (carry.have_prev)
+  {
+    if (stats) add_gap_stats(ts, n, carry.prev_ts, *stats);
+    if (ts_gap(ts[0], carry.prev_ts) >= threshold_ns) emit(0);
+  }
+  else if (stats)
+  {
+    add_gap_stats(ts + 1, n - 1, ts[0], *stats);
+  }
+
+  size_t i = 1;
+#if defined(__SSE2__)
+  const __m128i thr = _mm_set1_epi64x(threshold_ns);
+  // Lanes with gap >= threshold as mask bits
+  auto gap_mask = [&thr](const int64_t* p)
+  {
+    const __m128i d = _mm_sub_epi64(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)),
+                                    _mm_loadu_si128(reinterpret_cast<const __m128i*>(p - 1)));
+    const __m128i x = _mm_sub_epi64(d, thr);
+    const __m128i lt = _mm_xor_si128(x, _mm_and_si128(_mm_xor_si128(d, thr), _mm_xor_si128(x, d)));
+    return ~static_cast<unsigned>(_mm_movemask_pd(_mm_castsi128_pd(lt))) & 3u;
+  };
+  for (; i + 4 <= n; i += 4)
+  {
+    unsigned m = gap_mask(ts + i) | (gap_mask(ts + i + 2) << 2);
+    while (m)
+    {
+      emit(i + static_cast<size_t>(__builtin_ctz(m)));
+      m &= m - 1;
+    }
+  }
+#endif
+  for (; i < n; ++i)
+    if (ts_gap(ts[i], ts[i - 1]) >= threshold_ns) emit(i);
+
+  carry.have_prev = true;
+  carry.prev_ts = ts[n - 1];
+  return count;
+}
+
+// ======== Date helpers & file mapping (chronological order) ========
+
+struct YMD { int year; int month; int day; };
+
+static YMD ymd_utc_from_ns(int64_t ns)
+{
+  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
+  tm tm{};
+  gmtime_r(&s, &tm);
+  return {tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday};
+}
+
+static int64_t floor_day_ns(int64_t ns)
+{
+  int64_t sec = ns / 1'000'000'000LL;
+  int64_t day_sec = sec - (sec % 86400LL);
+  return day_sec * 1'000'000'000LL;
+}
+
+static int64_t ymd_utc_start_ns(int Y, int M, int D)
+{
+  tm tm{};
+  tm.tm_year = Y - 1900;
+  tm.tm_mon  = M - 1;
+  tm.tm_mday = D;
+  tm.tm_hour = 0; tm.tm_min = 0; tm.tm_sec = 0;
+  time_t s = timegm(&tm); // GNU extension: UTC mktime
+  if (s == (time_t)-1) return 0;
+  return static_cast<int64_t>(s) * 1'000'000'000LL;
+}
+
+static string iso_from_ns(int64_t ns)
+{
+  time_t s = static_cast<time_t>(ns / 1'000'000'000LL);
+  tm tm{}; gmtime_r(&s, &tm);
+  ostringstream o;
+  o << setfill('0')
+    << setw(4) << (tm.tm_year + 1900) << '-'
+    << setw(2) << (tm.tm_mon + 1) << '-'
+    << setw(2) << tm.tm_mday << 'T'
+    << setw(2) << tm.tm_hour << ':'
+    << setw(2) << tm.tm_min  << ':'
+    << setw(2) << tm.tm_sec  << 'Z';
+  return o.str();
+}
+
+struct Candidate
+{
+  string  path;
+  int64_t file_start_ns = 0;
+  int64_t file_end_ns   = 0;
+};
+
+static string to_lower(string s) { for (auto& c:s) c=(char)tolower((unsigned char)c); return s; }
 
 // Normalize/accept market input
 static optional<string> norm_market(optional<string> m)
@@ -338,26 +1170,281 @@ static void debug_try_path(const string& p, int64_t s_ns, int64_t e_ns)
        << "] " << (ex ? "EXISTS" : "missing") << "\n";
 }
 
+// ======== Shard manifests (one per <kind>_<market>/<SYMB> directory) ========
+//
+// <root>/<kind>_<market>/<SYMB>/_manifest.tsv lists the shard files that exist
+// with their day bounds, size/mtime, row count and per-row-group ts min/max:
+//
+//   # parquet_reader manifest v1
+//   F <rel path> <day start ns> <day end ns> <size> <mtime> <rows> <row groups>
+//   R <rows> <ts min> <ts max>          (one per row group; '-' when no stats)
+//
+// Discovery reads it instead of stat-ing every day of the window; only the
+// listed files in the window are stat-ed, to check them against their entry.
+// A listed file that is gone is dropped, one rewritten since (size/mtime
+// differ) stays a candidate without row-group pruning. Days after the last
+// listed file are still probed on disk, so appending new days only needs an
+// update_manifest() run to make their row-group bounds known. Days backfilled
+// before the last listed file are not probed: run update_manifest() first.
+
+struct RgBound
+{
+  int64_t rows = 0;
+  bool has_ts = false;
+  int64_t ts_min = 0;
+  int64_t ts_max = 0;
+};
+
+struct ManifestEntry
+{
+  string rel;                 // relative to the manifest directory
+  int64_t file_start_ns = 0;
+  int64_t file_end_ns   = 0;
+  FileStamp stamp;
+  int64_t rows = 0;
+  vector<RgBound> rgs;
+
+  // False only when every row group has stats and none overlaps [s, e)
+  bool may_match(int64_t s, int64_t e) const
+  {
+    for (const auto& rg : rgs)
+      if (!rg.has_ts || (rg.ts_max >= s && rg.ts_min < e)) return true;
+    return rgs.empty();
+  }
+};
+
+using Manifest = vector<ManifestEntry>;  // sorted by file_start_ns
+
+static const char* MANIFEST_NAME = "_manifest.tsv";
+
+static string shard_dir(const string& root, const string& kind, const string& mkt, const string& symb)
+{
+  return root + '/' + kind + '_' + mkt + '/' + symb;
+}
+
+static bool load_manifest(const string& path, Manifest& out)
+{
+  ifstream in(path);
+  if (!in) return false;
+
+  out.clear();
+  string line;
+  while (getline(in, line))
+  {
+    if (line.empty() || line[0] == '#') continue;
+    istringstream ls(line);
+    string tag;
+    ls >> tag;
+    if (tag == "F")
+    {
+      ManifestEntry e;
+      size_t n_rgs = 0;
+      if (!(ls >> e.rel >> e.file_start_ns >> e.file_end_ns >> e.stamp.size >> e.stamp.mtime >> e.rows >> n_rgs))
+        throw runtime_error("manifest: bad F line in " + path);
+      e.rgs.reserve(n_rgs);
+      out.push_back(move(e));
+    }
+    else if (tag == "R")
+    {
+      if (out.empty()) throw runtime_error("manifest: R line before F in " + path);
+      RgBound rg;
+      string lo, hi;
+      if (!(ls >> rg.rows >> lo >> hi)) throw runtime_error("manifest: bad R line in " + path);
+      if (lo != "-" && hi != "-")
+      {
+        rg.has_ts = true;
+        rg.ts_min = stoll(lo);
+        rg.ts_max = stoll(hi);
+      }
+      out.back().rgs.push_back(rg);
+    }
+  }
+  sort(out.begin(), out.end(), [](const ManifestEntry& a, const ManifestEntry& b) { return a.file_start_ns < b.file_start_ns; });
+  return true;
+}
+
+// Written to a temp file and renamed, so concurrent readers see old or new, never half
+static void save_manifest(const string& path, const Manifest& m)
+{
+  const string tmp = path + ".tmp";
+  {
+    ofstream out(tmp, ios::trunc);
+    if (!out) throw runtime_error("manifest: cannot write " + tmp);
+    out << "# parquet_reader manifest v1\n";
+    for (const auto& e : m)
+    {
+      out << "F\t" << e.rel << '\t' << e.file_start_ns << '\t' << e.file_end_ns << '\t'
+          << e.stamp.size << '\t' << e.stamp.mtime << '\t' << e.rows << '\t' << e.rgs.size() << '\n';
+      for (const auto& rg : e.rgs)
+      {
+        out << "R\t" << rg.rows << '\t';
+        if (rg.has_ts) out << rg.ts_min << '\t' << rg.ts_max << '\n';
+        else out << "-\t-\n";
+      }
+    }
+    if (!out) throw runtime_error("manifest: write failed " + tmp);
+  }
+  fs::rename(tmp, path);
+}
+
+// Day of a strict-layout file name: bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
+static bool day_from_name(const string& name, int64_t& start_ns)
+{
+  string stem = fs::path(name).stem().string();
+  int ymd[3];
+  for (int k = 2; k >= 0; --k)
+  {
+    size_t us = stem.rfind('_');
+    if (us == string::npos) return false;
+    try { ymd[k] = stoi(stem.substr(us + 1)); } catch (...) { return false; }
+    stem.resize(us);
+  }
+  start_ns = ymd_utc_start_ns(ymd[0], ymd[1], ymd[2]);
+  return true;
+}
+
+static ManifestEntry scan_shard(const string& path, const string& rel, int64_t day_start_ns, FileStamp stamp)
+{
+  ManifestEntry e;
+  e.rel           = rel;
+  e.file_start_ns = day_start_ns;
+  e.file_end_ns   = day_start_ns + 86'400'000'000'000LL;
+  e.stamp         = stamp;
+
+  auto reader = open_parquet(path, IoOptions{});
+  auto md = reader->metadata();
+  e.rows = md->num_rows();
+  const int ts_i = md->schema()->ColumnIndex("ts");
+  for (int i = 0; i < md->num_row_groups(); ++i)
+  {
+    auto rmd = md->RowGroup(i);
+    RgBound rg;
+    rg.rows = rmd->num_rows();
+    if (ts_i >= 0)
+    {
+      auto cc = rmd->ColumnChunk(ts_i);
+      if (cc && cc->is_stats_set())
+      {
+        auto st = dynamic_pointer_cast<parquet::Int64Statistics>(cc->statistics());
+        if (st && st->HasMinMax())
+        {
+          rg.has_ts = true;
+          rg.ts_min = st->min();
+          rg.ts_max = st->max();
+        }
+      }
+    }
+    e.rgs.push_back(rg);
+  }
+  return e;
+}
+
+// Loaded manifests of one ShardedDB, reloaded when the manifest file changes
+class ManifestCache
+{
+public:
+  // nullptr when the directory has no (readable) manifest
+  shared_ptr<const Manifest> get(const string& dir)
+  {
+    const string path = dir + '/' + MANIFEST_NAME;
+    const FileStamp st = file_stamp(path);
+
+    lock_guard<mutex> lk(m_);
+    auto& slot = loaded_[dir];
+    if (slot.manifest && slot.stamp == st) return slot.manifest;
+    slot = {};
+    if (st.size < 0) return nullptr;
+
+    auto m = make_shared<Manifest>();
+    try
+    {
+      if (!load_manifest(path, *m)) return nullptr;
+    }
+    catch (const exception& e)
+    {
+      cerr << "WARN: ignoring manifest: " << e.what() << "\n";
+      return nullptr;
+    }
+    slot.stamp = st;
+    slot.manifest = move(m);
+    return slot.manifest;
+  }
+
+private:
+  struct Slot
+  {
+    FileStamp stamp;
+    shared_ptr<const Manifest> manifest;
+  };
+
+  mutex m_;
+  map<string, Slot> loaded_;
+};
+
+// Rebuild the manifest of one directory: unchanged files (same size + mtime)
+// keep their entries, new or rewritten ones get their footer scanned.
+static size_t update_manifest_dir(const string& dir)
+{
+  const string path = dir + '/' + MANIFEST_NAME;
+  Manifest old;
+  try { load_manifest(path, old); } catch (const exception&) { old.clear(); }
+  map<string, const ManifestEntry*> by_rel;
+  for (const auto& e : old) by_rel[e.rel] = &e;
+
+  Manifest out;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+  {
+    if (!it->is_regular_file(ec) || it->path().extension() != ".parquet") continue;
+
+    const string full = it->path().string();
+    const string rel  = fs::relative(it->path(), dir, ec).generic_string();
+    int64_t day_start = 0;
+    if (ec || !day_from_name(full, day_start)) continue;
+
+    const FileStamp st = file_stamp(full);
+    auto hit = by_rel.find(rel);
+    if (hit != by_rel.end() && hit->second->stamp == st)
+    {
+      out.push_back(*hit->second);
+      continue;
+    }
+
+    try
+    {
+      out.push_back(scan_shard(full, rel, day_start, st));
+      if (g_debug) cerr << "[debug] manifest: scanned " << full << "\n";
+    }
+    catch (const exception& e)
+    {
+      cerr << "WARN: manifest: skipping " << full << " : " << e.what() << "\n";
+    }
+  }
+  if (ec) throw runtime_error("manifest: cannot walk " + dir + " : " + ec.message());
+
+  sort(out.begin(), out.end(), [](const ManifestEntry& a, const ManifestEntry& b) { return a.file_start_ns < b.file_start_ns; });
+  save_manifest(path, out);
+  return out.size();
+}
+
 // STRICT layout only:
 //   <root>/<kind>_<market>/<SYMB>/<Y>/<M>/bn_<kind>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
 // Non-padded month/day (e.g., 2025/9/3)
-// kind: "top" | "trade" | "depth"
+// kind: "top" | "trade" | "depth" | "top_<sampling>" (e.g. top_1s, see parquet_top_resample)
+// With a manifest cache, directories that carry a manifest are listed from it
+// (see Shard manifests above) and only days past its last file are probed;
+// backfilled earlier days need update_manifest() before they are found.
 static vector<Candidate> candidate_files_strict(const string& root,
                                                 const string& symb,
                                                 const string& base_type,
                                                 optional<string> market,
                                                 int64_t start_ns,
                                                 int64_t end_ns,
-                                                const optional<string>& sampling)
+                                                ManifestCache* manifests = nullptr)
 {
   vector<Candidate> out;
   if (start_ns >= end_ns) return out;
 
-  // sampling not used in strict layout; warn in debug to avoid confusion
-  if (g_debug && sampling.has_value()) {
-    cerr << "[debug] note: --sampling is ignored for strict layout discovery\n";
-  }
-
   vector<string> markets;
   if (market) {
     auto nm = norm_market(market);
@@ -373,6 +1460,28 @@ static vector<Candidate> candidate_files_strict(const string& root,
 
   for (const string& mkt : markets)
   {
+    if (auto m = manifests ? manifests->get(shard_dir(root, base_type, mkt, symb)) : nullptr)
+    {
+      const string dir = shard_dir(root, base_type, mkt, symb) + '/';
+      size_t listed = 0, pruned = 0, stale = 0, gone = 0;
+      for (const auto& e : *m)
+      {
+        if (e.file_end_ns <= start_ns || e.file_start_ns >= end_ns) continue;
+        ++listed;
+        const FileStamp st = file_stamp(dir + e.rel);
+        if (st.size < 0) { ++gone; continue; }
+        if (!(st == e.stamp)) ++stale;  // bounds unknown: keep it
+        else if (!e.may_match(start_ns, end_ns)) { ++pruned; continue; }
+        out.push_back(Candidate{dir + e.rel, e.file_start_ns, e.file_end_ns});
+      }
+      if (!m->empty()) cur = max(cur, floor_day_ns(m->back().file_start_ns) + day_ns);
+      if (g_debug) {
+        cerr << "[debug] manifest " << dir << MANIFEST_NAME << ": " << listed << " files in window, "
+             << pruned << " pruned by row-group ts bounds, " << stale << " changed since listed, "
+             << gone << " gone\n";
+      }
+    }
+
     while (cur <= end_floor)
     {
       auto ymd = ymd_utc_from_ns(cur);
@@ -416,143 +1525,349 @@ static vector<Candidate> candidate_files_strict(const string& root,
   return out;
 }
 
-// ======== RowGroup -> column vectors (decode once per RG) ========
+// ======== Decoded batch buffers (one filtered row group each) ========
 
-struct FileStreamerTopCols
+template <class T>
+static size_t vec_bytes(const vector<T>& v) { return v.size() * sizeof(T); }
+
+struct TopBuf
 {
-  unique_ptr<parquet::ParquetFileReader> reader;
-  shared_ptr<parquet::FileMetaData> md;
-  const parquet::SchemaDescriptor* schema = nullptr;
-  int rg_idx = 0;
+  vector<int64_t> ts, apx, aq, bpx, bq, val;
+  // sampled extras
+  vector<int64_t> min_bpx, max_bpx, min_apx, max_apx;
+  vector<int64_t> min_bts, max_bts, min_ats, max_ats;
+  string file; // basename of the file the rows came from
+  ScratchArena scratch; // decode temporaries, reset per row group
 
-  explicit FileStreamerTopCols(string path)
+  size_t bytes() const
   {
-    //cerr << path << endl; // print file when processing
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
-    md     = reader->metadata();
-    schema = md->schema();
+    return vec_bytes(ts) + vec_bytes(apx) + vec_bytes(aq) + vec_bytes(bpx) + vec_bytes(bq) + vec_bytes(val)
+         + vec_bytes(min_bpx) + vec_bytes(max_bpx) + vec_bytes(min_apx) + vec_bytes(max_apx)
+         + vec_bytes(min_bts) + vec_bytes(max_bts) + vec_bytes(min_ats) + vec_bytes(max_ats);
   }
+};
 
-  static void read_required_i64_column(
-      parquet::RowGroupReader& rg, int col_idx, vector<int64_t>& out)
-  {
-    const int64_t rows = rg.metadata()->num_rows();
-    out.resize(rows);
+struct TradeBuf
+{
+  vector<int64_t> ts, px, qty, tid, boid, soid, ttime, evt;
+  vector<uint8_t> isMkt;
+  string file;
+  ScratchArena scratch; // decode temporaries, reset per row group
 
-    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
-    auto* r = static_cast<parquet::Int64Reader*>(col.get());
+  size_t bytes() const
+  {
+    return vec_bytes(ts) + vec_bytes(px) + vec_bytes(qty) + vec_bytes(tid) + vec_bytes(boid)
+         + vec_bytes(soid) + vec_bytes(ttime) + vec_bytes(evt) + vec_bytes(isMkt);
+  }
+};
 
-    int64_t done = 0;
-    while (done < rows)
-    {
-      int64_t values_read = 0;
-      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr, out.data() + done, &values_read);
-      if (levels == 0 && values_read == 0) break;
-      done += values_read;
-    }
+struct DeltaBuf
+{
+  vector<int64_t>  ts, fid, lid, evt;
+  vector<uint32_t> ask_off, bid_off;
+  vector<int64_t>  ask_px, ask_qty, bid_px, bid_qty;
+  string file;
+  ScratchArena scratch; // decode temporaries, reset per row group
 
-    if (done != rows) throw runtime_error("Short read in required column");
+  size_t bytes() const
+  {
+    return vec_bytes(ts) + vec_bytes(fid) + vec_bytes(lid) + vec_bytes(evt)
+         + vec_bytes(ask_off) + vec_bytes(bid_off)
+         + vec_bytes(ask_px) + vec_bytes(ask_qty) + vec_bytes(bid_px) + vec_bytes(bid_qty);
   }
+};
 
-  bool next_rg(
-      int64_t start_ns, int64_t end_ns, const TopSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_apx, vector<int64_t>& v_aq,
-      vector<int64_t>& v_bpx, vector<int64_t>& v_bq, vector<int64_t>& v_val,
-      // sampled extras
-      vector<int64_t>& v_min_bpx, vector<int64_t>& v_max_bpx,
-      vector<int64_t>& v_min_apx, vector<int64_t>& v_max_apx,
-      vector<int64_t>& v_min_bts, vector<int64_t>& v_max_bts,
-      vector<int64_t>& v_min_ats, vector<int64_t>& v_max_ats)
-  {
-    while (true)
-    {
-      if (rg_idx >= md->num_row_groups()) return false;
+static void fill_view(const TopBuf& b, const TopSelect& sel, TopColsView& out)
+{
+  out.ts        = sel.ts        ? b.ts.data()  : nullptr;
+  out.ask_px    = sel.ask_px    ? b.apx.data() : nullptr;
+  out.ask_qty   = sel.ask_qty   ? b.aq.data()  : nullptr;
+  out.bid_px    = sel.bid_px    ? b.bpx.data() : nullptr;
+  out.bid_qty   = sel.bid_qty   ? b.bq.data()  : nullptr;
+  out.valu      = sel.valu      ? b.val.data() : nullptr;
+
+  out.min_bid_px = sel.min_bid_px ? b.min_bpx.data() : nullptr;
+  out.max_bid_px = sel.max_bid_px ? b.max_bpx.data() : nullptr;
+  out.min_ask_px = sel.min_ask_px ? b.min_apx.data() : nullptr;
+  out.max_ask_px = sel.max_ask_px ? b.max_apx.data() : nullptr;
+  out.min_bid_ts = sel.min_bid_ts ? b.min_bts.data() : nullptr;
+  out.max_bid_ts = sel.max_bid_ts ? b.max_bts.data() : nullptr;
+  out.min_ask_ts = sel.min_ask_ts ? b.min_ats.data() : nullptr;
+  out.max_ask_ts = sel.max_ask_ts ? b.max_ats.data() : nullptr;
+
+  out.file = b.file.c_str();
+  out.n    = b.ts.size();
+}
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
+static void fill_view(const TradeBuf& b, const TradeSelect& sel, TradeColsView& out)
+{
+  out.ts            = sel.ts            ? b.ts.data()    : nullptr;
+  out.px            = sel.px            ? b.px.data()    : nullptr;
+  out.qty           = sel.qty           ? b.qty.data()   : nullptr;
+  out.tradeId       = sel.tradeId       ? b.tid.data()   : nullptr;
+  out.buyerOrderId  = sel.buyerOrderId  ? b.boid.data()  : nullptr;
+  out.sellerOrderId = sel.sellerOrderId ? b.soid.data()  : nullptr;
+  out.tradeTime     = sel.tradeTime     ? b.ttime.data() : nullptr;
+  out.isMarket      = sel.isMarket      ? b.isMkt.data() : nullptr;
+  out.eventTime     = sel.eventTime     ? b.evt.data()   : nullptr;
+
+  out.file = b.file.c_str();
+  out.n    = b.ts.size();
+}
 
-      const int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("top: missing ts");
+static void fill_view(const DeltaBuf& b, const DeltaSelect& sel, DeltaColsView& out)
+{
+  out.ts        = sel.ts        ? b.ts.data()  : nullptr;
+  out.firstId   = sel.firstId   ? b.fid.data() : nullptr;
+  out.lastId    = sel.lastId    ? b.lid.data() : nullptr;
+  out.eventTime = sel.eventTime ? b.evt.data() : nullptr;
 
-      vector<int64_t> ts_all;
-      read_required_i64_column(*rg, ts_i, ts_all);
+  bool have_asks = sel.ask_px || sel.ask_qty;
+  bool have_bids = sel.bid_px || sel.bid_qty;
 
-      size_t cnt = 0;
-      for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
-      if (cnt == 0) continue;
+  out.ask_off = have_asks  ? b.ask_off.data() : nullptr;
+  out.ask_px  = sel.ask_px  ? b.ask_px.data()  : nullptr;
+  out.ask_qty = sel.ask_qty ? b.ask_qty.data() : nullptr;
 
-      v_ts.resize(cnt);
-      if (sel.ask_px)     v_apx.resize(cnt);    else v_apx.clear();
-      if (sel.ask_qty)    v_aq.resize(cnt);     else v_aq.clear();
-      if (sel.bid_px)     v_bpx.resize(cnt);    else v_bpx.clear();
-      if (sel.bid_qty)    v_bq.resize(cnt);     else v_bq.clear();
-      if (sel.valu)       v_val.resize(cnt);    else v_val.clear();
+  out.bid_off = have_bids  ? b.bid_off.data() : nullptr;
+  out.bid_px  = sel.bid_px  ? b.bid_px.data()  : nullptr;
+  out.bid_qty = sel.bid_qty ? b.bid_qty.data() : nullptr;
 
-      if (sel.min_bid_px) v_min_bpx.resize(cnt); else v_min_bpx.clear();
-      if (sel.max_bid_px) v_max_bpx.resize(cnt); else v_max_bpx.clear();
-      if (sel.min_ask_px) v_min_apx.resize(cnt); else v_min_apx.clear();
-      if (sel.max_ask_px) v_max_apx.resize(cnt); else v_max_apx.clear();
-      if (sel.min_bid_ts) v_min_bts.resize(cnt); else v_min_bts.clear();
-      if (sel.max_bid_ts) v_max_bts.resize(cnt); else v_max_bts.clear();
-      if (sel.min_ask_ts) v_min_ats.resize(cnt); else v_min_ats.clear();
-      if (sel.max_ask_ts) v_max_ats.resize(cnt); else v_max_ats.clear();
+  out.file = b.file.c_str();
+  out.n    = b.ts.size();
+}
 
-      {
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) v_ts[w++] = t;
-        }
-      }
+// ---- Zero-copy row ranges of a view (batch slicing, merged reads)
 
-      auto read_and_scatter = [&](const char* name, vector<int64_t>& out_vec)
-      {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("top: missing ") + name);
-        vector<int64_t> tmp;
-        read_required_i64_column(*rg, idx, tmp);
-
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) out_vec[w++] = tmp[i];
-        }
-      };
+template <class T>
+static const T* at(const T* p, size_t k) { return p ? p + k : nullptr; }
 
-      if (sel.ask_px)     read_and_scatter("ask_px", v_apx);
-      if (sel.ask_qty)    read_and_scatter("ask_qty", v_aq);
-      if (sel.bid_px)     read_and_scatter("bid_px", v_bpx);
-      if (sel.bid_qty)    read_and_scatter("bid_qty", v_bq);
-      if (sel.valu)       read_and_scatter("valu",   v_val);
-
-      if (sel.min_bid_px) read_and_scatter("min_bid_px", v_min_bpx);
-      if (sel.max_bid_px) read_and_scatter("max_bid_px", v_max_bpx);
-      if (sel.min_ask_px) read_and_scatter("min_ask_px", v_min_apx);
-      if (sel.max_ask_px) read_and_scatter("max_ask_px", v_max_apx);
-      if (sel.min_bid_ts) read_and_scatter("min_bid_ts", v_min_bts);
-      if (sel.max_bid_ts) read_and_scatter("max_bid_ts", v_max_bts);
-      if (sel.min_ask_ts) read_and_scatter("min_ask_ts", v_min_ats);
-      if (sel.max_ask_ts) read_and_scatter("max_ask_ts", v_max_ats);
+static TopColsView slice_view(const TopColsView& v, size_t b, size_t n)
+{
+  TopColsView o = v;
+  o.ts = at(v.ts, b); o.ask_px = at(v.ask_px, b); o.ask_qty = at(v.ask_qty, b);
+  o.bid_px = at(v.bid_px, b); o.bid_qty = at(v.bid_qty, b); o.valu = at(v.valu, b);
+  o.min_bid_px = at(v.min_bid_px, b); o.max_bid_px = at(v.max_bid_px, b);
+  o.min_ask_px = at(v.min_ask_px, b); o.max_ask_px = at(v.max_ask_px, b);
+  o.min_bid_ts = at(v.min_bid_ts, b); o.max_bid_ts = at(v.max_bid_ts, b);
+  o.min_ask_ts = at(v.min_ask_ts, b); o.max_ask_ts = at(v.max_ask_ts, b);
+  o.n = n;
+  return o;
+}
 
-      return true;
-    }
-  }
-};
+static TradeColsView slice_view(const TradeColsView& v, size_t b, size_t n)
+{
+  TradeColsView o = v;
+  o.ts = at(v.ts, b); o.px = at(v.px, b); o.qty = at(v.qty, b); o.tradeId = at(v.tradeId, b);
+  o.buyerOrderId = at(v.buyerOrderId, b); o.sellerOrderId = at(v.sellerOrderId, b);
+  o.tradeTime = at(v.tradeTime, b); o.isMarket = at(v.isMarket, b); o.eventTime = at(v.eventTime, b);
+  o.n = n;
+  return o;
+}
 
-struct FileStreamerTradeCols
+// Level arrays stay at the batch base: the shifted offsets still index them
+static DeltaColsView slice_view(const DeltaColsView& v, size_t b, size_t n)
 {
-  unique_ptr<parquet::ParquetFileReader> reader;
-  shared_ptr<parquet::FileMetaData> md;
-  const parquet::SchemaDescriptor* schema = nullptr;
-  int rg_idx = 0;
+  DeltaColsView o = v;
+  o.ts = at(v.ts, b); o.firstId = at(v.firstId, b); o.lastId = at(v.lastId, b);
+  o.eventTime = at(v.eventTime, b);
+  o.ask_off = at(v.ask_off, b); o.bid_off = at(v.bid_off, b);
+  o.n = n;
+  return o;
+}
 
-  explicit FileStreamerTradeCols(string path)
+// ---- Row-group coalescing (BatchOptions::target_rows): append b's rows to a
+
+template <class T>
+static void append_col(vector<T>& a, const vector<T>& b) { a.insert(a.end(), b.begin(), b.end()); }
+
+// b's offsets rebased onto a's level arrays (both n + 1 entries from 0, or empty)
+static void append_offsets(vector<uint32_t>& a, const vector<uint32_t>& b)
+{
+  if (b.empty()) return;
+  const uint32_t base = a.back();
+  for (size_t i = 1; i < b.size(); ++i) a.push_back(base + b[i]);
+}
+
+static void append_rows(TopBuf& a, const TopBuf& b)
+{
+  append_col(a.ts, b.ts); append_col(a.apx, b.apx); append_col(a.aq, b.aq);
+  append_col(a.bpx, b.bpx); append_col(a.bq, b.bq); append_col(a.val, b.val);
+  append_col(a.min_bpx, b.min_bpx); append_col(a.max_bpx, b.max_bpx);
+  append_col(a.min_apx, b.min_apx); append_col(a.max_apx, b.max_apx);
+  append_col(a.min_bts, b.min_bts); append_col(a.max_bts, b.max_bts);
+  append_col(a.min_ats, b.min_ats); append_col(a.max_ats, b.max_ats);
+}
+
+static void append_rows(TradeBuf& a, const TradeBuf& b)
+{
+  append_col(a.ts, b.ts); append_col(a.px, b.px); append_col(a.qty, b.qty);
+  append_col(a.tid, b.tid); append_col(a.boid, b.boid); append_col(a.soid, b.soid);
+  append_col(a.ttime, b.ttime); append_col(a.isMkt, b.isMkt); append_col(a.evt, b.evt);
+}
+
+static void append_rows(DeltaBuf& a, const DeltaBuf& b)
+{
+  append_col(a.ts, b.ts); append_col(a.fid, b.fid); append_col(a.lid, b.lid); append_col(a.evt, b.evt);
+  append_offsets(a.ask_off, b.ask_off); append_col(a.ask_px, b.ask_px); append_col(a.ask_qty, b.ask_qty);
+  append_offsets(a.bid_off, b.bid_off); append_col(a.bid_px, b.bid_px); append_col(a.bid_qty, b.bid_qty);
+}
+
+// ======== Column plans (names resolved once per distinct schema) ========
+
+// Leaf column indices one streamer kind needs: slot k holds the index of
+// names[k], -1 when the file has no such column. Slot 0 is always "ts".
+struct ColumnPlan
+{
+  vector<int> idx;
+};
+
+// FNV-1a over the leaf layout: full path (walked through the node parents, so
+// no dotted strings are built), physical type and levels of every leaf column.
+static uint64_t schema_fingerprint(const parquet::SchemaDescriptor* schema)
+{
+  uint64_t h = 1469598103934665603ull;
+  auto mix = [&h](const void* p, size_t n)
+  {
+    const auto* c = static_cast<const unsigned char*>(p);
+    for (size_t i = 0; i < n; ++i) { h ^= c[i]; h *= 1099511628211ull; }
+  };
+
+  const int n = schema->num_columns();
+  mix(&n, sizeof n);
+  for (int i = 0; i < n; ++i)
+  {
+    const parquet::ColumnDescriptor* d = schema->Column(i);
+    for (const parquet::schema::Node* node = d->schema_node().get(); node; node = node->parent())
+    {
+      const string& name = node->name();
+      mix(name.data(), name.size());
+      mix("/", 1);
+    }
+    const int32_t meta[3] = { static_cast<int32_t>(d->physical_type()),
+                              d->max_definition_level(), d->max_repetition_level() };
+    mix(meta, sizeof meta);
+  }
+  return h;
+}
+
+// Plans are shared by every file with the same layout (so a year of daily
+// shards resolves its column names once), keyed by names table + fingerprint.
+static shared_ptr<const ColumnPlan> resolve_plan(const parquet::SchemaDescriptor* schema,
+                                                 span<const char* const> names)
+{
+  static mutex m;
+  static map<pair<const void*, uint64_t>, shared_ptr<const ColumnPlan>> cache;
+
+  const auto key = make_pair(static_cast<const void*>(names.data()), schema_fingerprint(schema));
+  {
+    lock_guard<mutex> lk(m);
+    auto it = cache.find(key);
+    if (it != cache.end()) return it->second;
+  }
+
+  auto plan = make_shared<ColumnPlan>();
+  plan->idx.assign(names.size(), -1);
+  for (int i = 0; i < schema->num_columns(); ++i)
+  {
+    const string path = schema->Column(i)->path()->ToDotString();
+    for (size_t k = 0; k < names.size(); ++k)
+      if (plan->idx[k] < 0 && path == names[k]) plan->idx[k] = i;
+  }
+
+  lock_guard<mutex> lk(m);
+  return cache.emplace(key, move(plan)).first->second;
+}
+
+// ======== RowGroup -> column vectors (decode once per RG) ========
+//
+// read_rg() only touches the output buffer, so distinct row groups of one file
+// may be decoded concurrently (the underlying file is read with positional I/O).
+
+struct FileStreamerBase
+{
+  static constexpr size_t MAX_SLOTS = 16;  // plan slots of the widest streamer
+
+  // Compiled Select::where term: value of slot a (minus slot b, if b >= 0) op v
+  struct FilterTerm
+  {
+    int a;
+    int b = -1;
+    CmpOp op;
+    int64_t v;
+    bool is_bool = false;  // slot a is a BOOLEAN column
+  };
+
+  // Rows of one row group that pass the ts window and the filter. direct: they
+  // are exactly rows [base, base + n) and columns decode straight into place
+  // (sorted ts, no filter); otherwise rows [base, base + len) are decoded to
+  // scratch and compacted through mask (one byte per row, so the compare and
+  // count loops vectorize; mask[i] keeps row base + i).
+  struct RowSel
+  {
+    bool direct = true;
+    size_t base = 0;
+    size_t len  = 0;
+    size_t n    = 0;
+    int rg      = -1;  // row group index, for the chunk cache
+    uint8_t* mask = nullptr;
+    const void* dec[MAX_SLOTS] = {};  // slots already decoded over [base, base + len) for the filter
+  };
+
+  unique_ptr<parquet::ParquetFileReader> reader;
+  shared_ptr<parquet::FileMetaData> md;
+  const parquet::SchemaDescriptor* schema = nullptr;
+  shared_ptr<const ColumnPlan> plan;
+  vector<FilterTerm> filter;  // set by open_streamer from the Select
+  int rg_idx = 0;
+
+  string path_;
+  FileOpener open_;
+  FileStamp stamp_;
+  span<const char* const> names_;
+  shared_ptr<ChunkCache> chunks_;  // process-wide decoded chunks; null = off
+  string chunk_key_;               // path + stamp prefix of this file's chunk keys
+
+  FileStreamerBase(const string& path, const FileOpener& open, span<const char* const> col_names)
+  : path_(path), open_(open), names_(col_names)
   {
-    //cerr << path << endl;
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
-    md     = reader->metadata();
+    //cerr << path << endl; // print file when processing
+    OpenedFile f;
+    if (open_.cache)
+    {
+      f = open_.cache->take(path_, open_.io);
+    }
+    else
+    {
+      f.reader = open_parquet(path_, open_.io);
+      f.md     = f.reader->metadata();
+    }
+    reader = move(f.reader);
+    md     = move(f.md);
+    stamp_ = f.stamp;
     schema = md->schema();
+    plan   = resolve_plan(schema, col_names);
+
+    chunks_ = chunk_cache();
+    if (chunks_)
+    {
+      if (stamp_.size < 0) stamp_ = file_stamp(path_);
+      chunk_key_ = path_ + '\0' + to_string(stamp_.size) + ':' + to_string(stamp_.mtime) + ':';
+    }
   }
 
+  // Hand the open reader back to the DB's cache for the next query
+  ~FileStreamerBase()
+  {
+    if (open_.cache && reader) open_.cache->put(path_, open_.io, OpenedFile{move(reader), md, stamp_});
+  }
+
+  FileStreamerBase(const FileStreamerBase&) = delete;
+  FileStreamerBase& operator=(const FileStreamerBase&) = delete;
+
+  // Leaf index of plan slot c; -1 if this file lacks the column
+  int col(int c) const { return plan->idx[c]; }
+
   static void read_required_i64_column(
       parquet::RowGroupReader& rg, int col_idx, vector<int64_t>& out)
   {
@@ -574,689 +1889,3047 @@ struct FileStreamerTradeCols
     if (done != rows) throw runtime_error("Short read in required column");
   }
 
-  static void read_required_bool_column(
-      parquet::RowGroupReader& rg, int col_idx, vector<uint8_t>& out)
+  // Rows [first, first + count) of a required column, decoded straight into out
+  template <class Reader, class T>
+  static void read_required_range(Reader* r, int64_t first, int64_t count, T* out)
   {
-    static_assert(sizeof(bool) == 1, "bool must be 1 byte");
-    const int64_t rows = rg.metadata()->num_rows();
-    out.resize(rows);
-
-    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
-    auto* r = static_cast<parquet::BoolReader*>(col.get());
+    int64_t skipped = 0;
+    while (skipped < first)
+    {
+      int64_t k = r->Skip(first - skipped);
+      if (k == 0) break;
+      skipped += k;
+    }
+    if (skipped != first) throw runtime_error("Short skip in required column");
 
     int64_t done = 0;
-    while (done < rows)
+    while (done < count)
     {
       int64_t values_read = 0;
-      int64_t levels = r->ReadBatch(rows - done, nullptr, nullptr,
-                                    reinterpret_cast<bool*>(out.data()) + done,
-                                    &values_read);
+      int64_t levels = r->ReadBatch(count - done, nullptr, nullptr, out + done, &values_read);
       if (levels == 0 && values_read == 0) break;
       done += values_read;
     }
-
-    if (done != rows) throw runtime_error("Short read in required bool column");
+    if (done != count) throw runtime_error("Short read in required column");
   }
 
-  bool next_rg(
-      int64_t start_ns, int64_t end_ns, const TradeSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_px, vector<int64_t>& v_qty,
-      vector<int64_t>& v_tid, vector<int64_t>& v_boid, vector<int64_t>& v_soid,
-      vector<int64_t>& v_ttime, vector<uint8_t>& v_isMkt, vector<int64_t>& v_evt)
+  static void read_required_i64_range(
+      parquet::RowGroupReader& rg, int col_idx, int64_t first, int64_t count, int64_t* out)
   {
-    while (true)
-    {
-      if (rg_idx >= md->num_row_groups()) return false;
+    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+    read_required_range(static_cast<parquet::Int64Reader*>(col.get()), first, count, out);
+  }
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
+  static void read_required_bool_range(
+      parquet::RowGroupReader& rg, int col_idx, int64_t first, int64_t count, uint8_t* out)
+  {
+    shared_ptr<parquet::ColumnReader> col = rg.Column(col_idx);
+    read_required_range(static_cast<parquet::BoolReader*>(col.get()), first, count, reinterpret_cast<bool*>(out));
+  }
 
-      const int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("trade: missing ts");
+  // Whole leaf column of row group rg_i from the chunk cache (decoded on a
+  // miss); null when the cache is off
+  ChunkCache::Ptr cached_chunk(parquet::RowGroupReader& rg, int rg_i, int leaf, bool is_bool) const
+  {
+    if (!chunks_) return nullptr;
+    return chunks_->get(chunk_key_ + to_string(rg_i) + ':' + to_string(leaf), [&]
+    {
+      const int64_t rows = rg.metadata()->num_rows();
+      DecodedChunk d;
+      if (is_bool)
+      {
+        d.u8.resize(static_cast<size_t>(rows));
+        read_required_bool_range(rg, leaf, 0, rows, d.u8.data());
+      }
+      else
+      {
+        d.i64.resize(static_cast<size_t>(rows));
+        read_required_i64_range(rg, leaf, 0, rows, d.i64.data());
+      }
+      return d;
+    });
+  }
 
-      vector<int64_t> ts_all;
-      read_required_i64_column(*rg, ts_i, ts_all);
+  // Rows [first, first + count) of a required column; copied out of the chunk
+  // cache when it is on, else decoded straight into out
+  void read_i64(parquet::RowGroupReader& rg, int rg_i, int leaf, int64_t first, int64_t count, int64_t* out) const
+  {
+    if (auto c = cached_chunk(rg, rg_i, leaf, false))
+    {
+      if (static_cast<size_t>(first + count) > c->i64.size()) throw runtime_error("Short read in required column");
+      copy_n(c->i64.data() + first, count, out);
+      return;
+    }
+    read_required_i64_range(rg, leaf, first, count, out);
+  }
 
-      size_t cnt = 0;
-      for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
-      if (cnt == 0) continue;
+  void read_bool(parquet::RowGroupReader& rg, int rg_i, int leaf, int64_t first, int64_t count, uint8_t* out) const
+  {
+    if (auto c = cached_chunk(rg, rg_i, leaf, true))
+    {
+      if (static_cast<size_t>(first + count) > c->u8.size()) throw runtime_error("Short read in required column");
+      copy_n(c->u8.data() + first, count, out);
+      return;
+    }
+    read_required_bool_range(rg, leaf, first, count, out);
+  }
 
-      v_ts.resize(cnt);
-      if (sel.px)            v_px.resize(cnt);     else v_px.clear();
-      if (sel.qty)           v_qty.resize(cnt);    else v_qty.clear();
-      if (sel.tradeId)       v_tid.resize(cnt);    else v_tid.clear();
-      if (sel.buyerOrderId)  v_boid.resize(cnt);   else v_boid.clear();
-      if (sel.sellerOrderId) v_soid.resize(cnt);   else v_soid.clear();
-      if (sel.tradeTime)     v_ttime.resize(cnt);  else v_ttime.clear();
-      if (sel.isMarket)      v_isMkt.resize(cnt);  else v_isMkt.clear();
-      if (sel.eventTime)     v_evt.resize(cnt);    else v_evt.clear();
+  // ts is decoded straight into the output column. Inside a day file it is
+  // monotonic, so the window is one [lo, lo + cnt) slice found by binary search;
+  // the other columns are then decoded directly into place. A row group that is
+  // not sorted falls back to a per-row filter: ts_all receives a scratch copy of
+  // the full column and the caller scatters the matching rows. Returns cnt
+  // (0 = nothing matched).
+  size_t slice_ts(parquet::RowGroupReader& rg, int rg_i, int ts_i, int64_t start_ns, int64_t end_ns,
+                  vector<int64_t>& ts, bool& sorted, size_t& lo,
+                  ScratchArena& scratch, span<const int64_t>& ts_all) const
+  {
+    if (chunks_)
+    {
+      ts.resize(static_cast<size_t>(rg.metadata()->num_rows()));
+      read_i64(rg, rg_i, ts_i, 0, static_cast<int64_t>(ts.size()), ts.data());
+    }
+    else read_required_i64_column(rg, ts_i, ts);
 
-      {
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) v_ts[w++] = t;
-        }
-      }
+    sorted = is_sorted(ts.begin(), ts.end());
+    if (sorted)
+    {
+      auto first = lower_bound(ts.begin(), ts.end(), start_ns);
+      auto last  = lower_bound(first, ts.end(), end_ns);
+      lo = static_cast<size_t>(first - ts.begin());
+      const size_t cnt = static_cast<size_t>(last - first);
+      if (lo > 0) copy(first, last, ts.begin());
+      ts.resize(cnt);
+      return cnt;
+    }
 
-      auto read_and_scatter_i64 = [&](const char* name, vector<int64_t>& out_vec)
-      {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("trade: missing ") + name);
-        vector<int64_t> tmp;
-        read_required_i64_column(*rg, idx, tmp);
-
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) out_vec[w++] = tmp[i];
-        }
-      };
+    int64_t* all = scratch.alloc<int64_t>(ts.size());
+    copy(ts.begin(), ts.end(), all);
+    ts_all = span<const int64_t>(all, ts.size());
 
-      auto read_and_scatter_bool = [&](const char* name, vector<uint8_t>& out_vec)
-      {
-        const int idx = find_col_idx(schema, name);
-        if (idx < 0) throw runtime_error(string("trade: missing ") + name);
-        vector<uint8_t> tmp;
-        read_required_bool_column(*rg, idx, tmp);
-
-        size_t w = 0;
-        for (size_t i = 0; i < ts_all.size(); ++i) {
-          int64_t t = ts_all[i];
-          if (t >= start_ns && t < end_ns) out_vec[w++] = tmp[i];
-        }
-      };
+    size_t cnt = 0;
+    for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ++cnt;
+    ts.resize(cnt);
 
-      if (sel.px)            read_and_scatter_i64("px", v_px);
-      if (sel.qty)           read_and_scatter_i64("qty", v_qty);
-      if (sel.tradeId)       read_and_scatter_i64("tradeId", v_tid);
-      if (sel.buyerOrderId)  read_and_scatter_i64("buyerOrderId", v_boid);
-      if (sel.sellerOrderId) read_and_scatter_i64("sellerOrderId", v_soid);
-      if (sel.tradeTime)     read_and_scatter_i64("tradeTime", v_ttime);
-      if (sel.isMarket)      read_and_scatter_bool("isMarket", v_isMkt);
-      if (sel.eventTime)     read_and_scatter_i64("eventTime", v_evt);
+    size_t w = 0;
+    for (int64_t t : ts_all) if (t >= start_ns && t < end_ns) ts[w++] = t;
+    return cnt;
+  }
 
-      return true;
+  // m[i] &= (x[i] op v)
+  template <class T>
+  static void and_mask(uint8_t* m, const T* x, size_t n, CmpOp op, int64_t v)
+  {
+    switch (op)
+    {
+      case CmpOp::Lt: for (size_t i = 0; i < n; ++i) m[i] &= x[i] <  v; break;
+      case CmpOp::Le: for (size_t i = 0; i < n; ++i) m[i] &= x[i] <= v; break;
+      case CmpOp::Gt: for (size_t i = 0; i < n; ++i) m[i] &= x[i] >  v; break;
+      case CmpOp::Ge: for (size_t i = 0; i < n; ++i) m[i] &= x[i] >= v; break;
+      case CmpOp::Eq: for (size_t i = 0; i < n; ++i) m[i] &= x[i] == v; break;
+      case CmpOp::Ne: for (size_t i = 0; i < n; ++i) m[i] &= x[i] != v; break;
     }
   }
-};
 
-struct FileStreamerDeltaCols
-{
-  unique_ptr<parquet::ParquetFileReader> reader;
-  shared_ptr<parquet::FileMetaData> md;
-  const parquet::SchemaDescriptor* schema = nullptr;
-  int rg_idx = 0;
+  // m[i] &= (x[i] - y[i] op v), the difference taken in 128 bits so extreme
+  // px cannot overflow it
+  static void and_mask_diff(uint8_t* m, const int64_t* x, const int64_t* y, size_t n, CmpOp op, int64_t v)
+  {
+    using W = __int128;
+    switch (op)
+    {
+      case CmpOp::Lt: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] <  v; break;
+      case CmpOp::Le: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] <= v; break;
+      case CmpOp::Gt: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] >  v; break;
+      case CmpOp::Ge: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] >= v; break;
+      case CmpOp::Eq: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] == v; break;
+      case CmpOp::Ne: for (size_t i = 0; i < n; ++i) m[i] &= W{x[i]} - y[i] != v; break;
+    }
+  }
 
-  explicit FileStreamerDeltaCols(string path)
+  // Kept rows of src[0, n) to dst (may alias src); returns the count
+  template <class T>
+  static size_t compact(const T* src, const uint8_t* mask, size_t n, T* dst)
   {
-    //cerr << path << endl;
-    reader = parquet::ParquetFileReader::OpenFile(path, /*memory_map=*/false);
-    md     = reader->metadata();
-    schema = md->schema();
+    size_t w = 0;
+    for (size_t i = 0; i < n; ++i)
+      if (mask[i]) dst[w++] = src[i];
+    return w;
   }
 
-  bool next_rg(
-      int64_t start_ns, int64_t end_ns, const DeltaSelect& sel,
-      vector<int64_t>& v_ts, vector<int64_t>& v_fid, vector<int64_t>& v_lid, vector<int64_t>& v_evt,
-      vector<uint32_t>& ask_off, vector<int64_t>& ask_px, vector<int64_t>& ask_qty,
-      vector<uint32_t>& bid_off, vector<int64_t>& bid_px, vector<int64_t>& bid_qty)
+  // Slot c over [rs.base, rs.base + rs.len), decoded once per row group
+  template <class T>
+  const T* decoded(parquet::RowGroupReader& rg, int c, RowSel& rs, ScratchArena& scratch) const
   {
-    while (true)
-    {
-      if (rg_idx >= md->num_row_groups()) return false;
+    if (rs.dec[c]) return static_cast<const T*>(rs.dec[c]);
+    if (col(c) < 0) throw runtime_error(string("filter: missing ") + names_[c]);
 
-      shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_idx++);
-      auto rmd = rg->metadata();
-      int64_t rows = rmd->num_rows();
+    T* tmp = scratch.alloc<T>(rs.len);
+    if constexpr (is_same_v<T, uint8_t>)
+      read_bool(rg, rs.rg, col(c), static_cast<int64_t>(rs.base), static_cast<int64_t>(rs.len), tmp);
+    else
+      read_i64(rg, rs.rg, col(c), static_cast<int64_t>(rs.base), static_cast<int64_t>(rs.len), tmp);
+    rs.dec[c] = tmp;
+    return tmp;
+  }
 
-      int ts_i = find_col_idx(schema, "ts");
-      if (ts_i < 0) throw runtime_error("depth: missing ts");
-      Int64Cursor ts(rg->Column(ts_i), schema->Column(ts_i));
+  // Decode ts, apply the window and the filter; ts ends up holding the kept
+  // rows and rs tells gather() which rows those are. Returns rs.n (0 = none).
+  size_t select_rows(parquet::RowGroupReader& rg, int rg_i, int64_t start_ns, int64_t end_ns,
+                     vector<int64_t>& ts, ScratchArena& scratch, RowSel& rs) const
+  {
+    bool sorted = false;
+    size_t lo = 0;
+    span<const int64_t> ts_all;
+    rs = RowSel{};
+    rs.rg = rg_i;
+    const size_t cnt = slice_ts(rg, rg_i, col(0), start_ns, end_ns, ts, sorted, lo, scratch, ts_all);
+    if (cnt == 0) return 0;
+    if (sorted && filter.empty())
+    {
+      rs.base = lo;
+      rs.len  = rs.n = cnt;
+      return cnt;
+    }
 
-      optional<Int64Cursor> fid;
-      optional<Int64Cursor> lid;
-      optional<Int64Cursor> evt;
+    rs.direct = false;
+    rs.base = sorted ? lo : 0;
+    rs.len  = sorted ? cnt : ts_all.size();
+    rs.mask = scratch.alloc<uint8_t>(rs.len);
+    if (sorted)
+    {
+      fill_n(rs.mask, rs.len, uint8_t{1});
+      rs.dec[0] = ts.data();
+    }
+    else
+    {
+      for (size_t i = 0; i < rs.len; ++i) rs.mask[i] = ts_all[i] >= start_ns && ts_all[i] < end_ns;
+      rs.dec[0] = ts_all.data();
+    }
 
-      if (sel.firstId)
-      {
-        int fid_i = find_col_idx(schema, "firstId");
-        if (fid_i < 0) throw runtime_error("depth: missing firstId");
-        fid.emplace(rg->Column(fid_i), schema->Column(fid_i));
-      }
-      if (sel.lastId)
-      {
-        int lid_i = find_col_idx(schema, "lastId");
-        if (lid_i < 0) throw runtime_error("depth: missing lastId");
-        lid.emplace(rg->Column(lid_i), schema->Column(lid_i));
-      }
-      if (sel.eventTime)
+    for (const FilterTerm& t : filter)
+    {
+      if (t.is_bool)
       {
-        int evt_i = find_col_idx(schema, "eventTime");
-        if (evt_i < 0) throw runtime_error("depth: missing eventTime");
-        evt.emplace(rg->Column(evt_i), schema->Column(evt_i));
+        and_mask(rs.mask, decoded<uint8_t>(rg, t.a, rs, scratch), rs.len, t.op, t.v);
+        continue;
       }
+      const int64_t* x = decoded<int64_t>(rg, t.a, rs, scratch);
+      if (t.b >= 0) and_mask_diff(rs.mask, x, decoded<int64_t>(rg, t.b, rs, scratch), rs.len, t.op, t.v);
+      else and_mask(rs.mask, x, rs.len, t.op, t.v);
+    }
 
-      bool need_asks = (sel.ask_px || sel.ask_qty);
-      bool need_bids = (sel.bid_px || sel.bid_qty);
+    size_t n = 0;
+    for (size_t i = 0; i < rs.len; ++i) n += rs.mask[i];
+    rs.n = n;
 
-      optional<Int64Cursor> apx;
-      optional<Int64Cursor> aqty;
-      optional<Int64Cursor> bpx;
-      optional<Int64Cursor> bqty;
+    compact(sorted ? ts.data() : ts_all.data(), rs.mask, rs.len, ts.data());
+    ts.resize(n);
+    rs.dec[0] = nullptr;
+    return n;
+  }
 
-      if (need_asks)
-      {
-        if (sel.ask_px)
-        {
-          int apx_i = find_col_idx(schema, "ask.list.element.px");
-          if (apx_i < 0) throw runtime_error("depth: missing ask px");
-          apx.emplace(rg->Column(apx_i), schema->Column(apx_i));
-        }
-        if (sel.ask_qty)
-        {
-          int aqty_i = find_col_idx(schema, "ask.list.element.qty");
-          if (aqty_i < 0) throw runtime_error("depth: missing ask qty");
-          aqty.emplace(rg->Column(aqty_i), schema->Column(aqty_i));
-        }
-      }
+  // Kept rows of plan slot c into out (rs.n elements)
+  template <class T>
+  void gather(parquet::RowGroupReader& rg, int c, RowSel& rs, ScratchArena& scratch, T* out) const
+  {
+    if (rs.direct)
+    {
+      if constexpr (is_same_v<T, uint8_t>)
+        read_bool(rg, rs.rg, col(c), static_cast<int64_t>(rs.base), static_cast<int64_t>(rs.n), out);
+      else
+        read_i64(rg, rs.rg, col(c), static_cast<int64_t>(rs.base), static_cast<int64_t>(rs.n), out);
+      return;
+    }
+    compact(decoded<T>(rg, c, rs, scratch), rs.mask, rs.len, out);
+  }
 
-      if (need_bids)
-      {
-        if (sel.bid_px)
-        {
-          int bpx_i = find_col_idx(schema, "bid.list.element.px");
-          if (bpx_i < 0) throw runtime_error("depth: missing bid px");
-          bpx.emplace(rg->Column(bpx_i), schema->Column(bpx_i));
-        }
-        if (sel.bid_qty)
-        {
-          int bqty_i = find_col_idx(schema, "bid.list.element.qty");
-          if (bqty_i < 0) throw runtime_error("depth: missing bid qty");
-          bqty.emplace(rg->Column(bqty_i), schema->Column(bqty_i));
-        }
-      }
+  // Leaf indices of the wanted plan slots present in a file (for pre-buffering / read-ahead)
+  static vector<int> plan_cols(const ColumnPlan& plan, span<const bool> want)
+  {
+    vector<int> out;
+    for (size_t k = 0; k < want.size(); ++k)
+      if (want[k] && plan.idx[k] >= 0) out.push_back(plan.idx[k]);
+    return out;
+  }
 
-      v_ts.clear();
-      v_fid.clear();
-      v_lid.clear();
-      v_evt.clear();
-      ask_off.clear();
-      ask_px.clear();
-      ask_qty.clear();
-      bid_off.clear();
-      bid_px.clear();
-      bid_qty.clear();
-
-      v_ts.reserve(rows);
-      if (sel.firstId)   v_fid.reserve(rows);
-      if (sel.lastId)    v_lid.reserve(rows);
-      if (sel.eventTime) v_evt.reserve(rows);
-      if (need_asks) { ask_off.reserve(rows + 1); ask_off.push_back(0); }
-      if (need_bids) { bid_off.reserve(rows + 1); bid_off.push_back(0); }
-
-      for (int64_t r = 0; r < rows; ++r)
-      {
-        Entry e_ts = ts.take();
+  int num_row_groups() const { return md->num_row_groups(); }
+  int64_t rg_rows(int rg_i) const { return md->RowGroup(rg_i)->num_rows(); }
 
-        Entry e_fid{};
-        Entry e_lid{};
-        Entry e_evt{};
-        if (sel.firstId)   e_fid = fid->take();
-        if (sel.lastId)    e_lid = lid->take();
-        if (sel.eventTime) e_evt = evt->take();
+  // ts [min, max] of a row group from the footer statistics, if the writer stored them
+  optional<pair<int64_t, int64_t>> rg_ts_bounds(int rg_i) const { return ts_bounds(*md, col(0), rg_i); }
 
-        bool in_range = (e_ts.value >= start_ns && e_ts.value < end_ns);
+  static optional<pair<int64_t, int64_t>> ts_bounds(const parquet::FileMetaData& md, int ts_i, int rg_i)
+  {
+    return i64_bounds(md, ts_i, rg_i);
+  }
 
-        uint32_t asks_added = 0;
-        uint32_t bids_added = 0;
+  // [min, max] of an INT64 leaf column in a row group, if the writer stored them
+  static optional<pair<int64_t, int64_t>> i64_bounds(const parquet::FileMetaData& md, int col_i, int rg_i)
+  {
+    if (col_i < 0) return nullopt;
 
-        if (need_asks)
-        {
-          if (sel.ask_px && sel.ask_qty)
-          {
-            asks_added = append_list_pairs_for_row_typed(
-                *apx, *aqty,
-                in_range ? &ask_px : nullptr,
-                in_range ? &ask_qty : nullptr);
-          }
-          else if (sel.ask_px)
-          {
-            asks_added = append_list_from_leaf_for_row(*apx, in_range ? &ask_px : nullptr);
-          }
-          else if (sel.ask_qty)
-          {
-            asks_added = append_list_from_leaf_for_row(*aqty, in_range ? &ask_qty : nullptr);
-          }
-        }
+    auto cc = md.RowGroup(rg_i)->ColumnChunk(col_i);
+    if (!cc || !cc->is_stats_set()) return nullopt;
 
-        if (need_bids)
-        {
-          if (sel.bid_px && sel.bid_qty)
-          {
-            bids_added = append_list_pairs_for_row_typed(
-                *bpx, *bqty,
-                in_range ? &bid_px : nullptr,
-                in_range ? &bid_qty : nullptr);
-          }
-          else if (sel.bid_px)
-          {
-            bids_added = append_list_from_leaf_for_row(*bpx, in_range ? &bid_px : nullptr);
-          }
-          else if (sel.bid_qty)
-          {
-            bids_added = append_list_from_leaf_for_row(*bqty, in_range ? &bid_qty : nullptr);
-          }
-        }
+    auto st = dynamic_pointer_cast<parquet::Int64Statistics>(cc->statistics());
+    if (!st || !st->HasMinMax()) return nullopt;
+    return make_pair(st->min(), st->max());
+  }
 
-        if (in_range)
-        {
-          v_ts.push_back(e_ts.value);
-          if (sel.firstId)   v_fid.push_back(e_fid.value);
-          if (sel.lastId)    v_lid.push_back(e_lid.value);
-          if (sel.eventTime) v_evt.push_back(e_evt.value);
+  // False only when the statistics prove no row of rg_i falls into [start_ns, end_ns)
+  // or passes every filter term
+  bool rg_may_match(int rg_i, int64_t start_ns, int64_t end_ns) const
+  {
+    auto b = rg_ts_bounds(rg_i);
+    if (b && (b->second < start_ns || b->first >= end_ns)) return false;
 
-          if (need_asks) ask_off.push_back(ask_off.back() + asks_added);
-          if (need_bids) bid_off.push_back(bid_off.back() + bids_added);
-        }
+    for (const FilterTerm& t : filter)
+    {
+      if (t.is_bool) continue;
+      auto x = i64_bounds(*md, col(t.a), rg_i);
+      if (!x) continue;
+      // a - b bounds in 128 bits: raw statistics may sit near the int64 limits
+      __int128 lo = x->first, hi = x->second;
+      if (t.b >= 0)
+      {
+        auto y = i64_bounds(*md, col(t.b), rg_i);
+        if (!y) continue;
+        lo -= y->second;
+        hi -= y->first;
       }
 
-      if (!v_ts.empty()) return true;
+      bool may = true;
+      switch (t.op)
+      {
+        case CmpOp::Lt: may = lo <  t.v; break;
+        case CmpOp::Le: may = lo <= t.v; break;
+        case CmpOp::Gt: may = hi >  t.v; break;
+        case CmpOp::Ge: may = hi >= t.v; break;
+        case CmpOp::Eq: may = lo <= t.v && t.v <= hi; break;
+        case CmpOp::Ne: may = !(lo == t.v && hi == t.v); break;
+      }
+      if (!may) return false;
     }
+    return true;
   }
 };
 
-// ======== ShardedDB (PIMPL) ========
-
-struct ShardedDB::Impl
+struct FileStreamerTopCols : FileStreamerBase
 {
-  string root_;
-  optional<string> sampling_;
+  enum Col { TS, ASK_PX, ASK_QTY, BID_PX, BID_QTY, VALU,
+             MIN_BID_PX, MAX_BID_PX, MIN_ASK_PX, MAX_ASK_PX,
+             MIN_BID_TS, MAX_BID_TS, MIN_ASK_TS, MAX_ASK_TS, NCOLS };
+  static constexpr const char* COL_NAMES[NCOLS] = {
+    "ts", "ask_px", "ask_qty", "bid_px", "bid_qty", "valu",
+    "min_bid_px", "max_bid_px", "min_ask_px", "max_ask_px",
+    "min_bid_ts", "max_bid_ts", "min_ask_ts", "max_ask_ts" };
+
+  explicit FileStreamerTopCols(const string& path, const FileOpener& open = {})
+  : FileStreamerBase(path, open, COL_NAMES) {}
+
+  static vector<int> selected_cols(const ColumnPlan& plan, const TopSelect& sel)
+  {
+    bool want[NCOLS] = { true, sel.ask_px, sel.ask_qty, sel.bid_px, sel.bid_qty, sel.valu,
+                         sel.min_bid_px, sel.max_bid_px, sel.min_ask_px, sel.max_ask_px,
+                         sel.min_bid_ts, sel.max_bid_ts, sel.min_ask_ts, sel.max_ask_ts };
+    for (const FilterTerm& t : filter_terms(sel))
+    {
+      want[t.a] = true;
+      if (t.b >= 0) want[t.b] = true;
+    }
+    return plan_cols(plan, want);
+  }
 
-  Impl(string root, optional<string> sampling)
-  : root_(move(root)), sampling_(move(sampling)) {}
+  // TopField k is plan slot k, spread is ask_px - bid_px
+  static vector<FilterTerm> filter_terms(const TopSelect& sel)
+  {
+    vector<FilterTerm> out;
+    for (const auto& t : sel.where)
+    {
+      if (t.col == TopField::spread) out.push_back(FilterTerm{ASK_PX, BID_PX, t.op, t.value});
+      else out.push_back(FilterTerm{static_cast<int>(t.col), -1, t.op, t.value});
+    }
+    return out;
+  }
 
-  unique_ptr<TopBatchReader>   get_top  (int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const;
-  unique_ptr<TradeBatchReader> get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const;
-  unique_ptr<DeltaBatchReader> get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const;
+  // Decode row group rg_i filtered to [start_ns, end_ns) and sel.where; false if no row matched.
+  bool read_rg(int rg_i, int64_t start_ns, int64_t end_ns, const TopSelect& sel, TopBuf& b) const
+  {
+    shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_i);
+
+    if (col(TS) < 0) throw runtime_error("top: missing ts");
+
+    RowSel rs;
+    b.scratch.reset();
+    const size_t cnt = select_rows(*rg, rg_i, start_ns, end_ns, b.ts, b.scratch, rs);
+    if (cnt == 0) return false;
+
+    if (sel.ask_px)     b.apx.resize(cnt);    else b.apx.clear();
+    if (sel.ask_qty)    b.aq.resize(cnt);     else b.aq.clear();
+    if (sel.bid_px)     b.bpx.resize(cnt);    else b.bpx.clear();
+    if (sel.bid_qty)    b.bq.resize(cnt);     else b.bq.clear();
+    if (sel.valu)       b.val.resize(cnt);    else b.val.clear();
+
+    if (sel.min_bid_px) b.min_bpx.resize(cnt); else b.min_bpx.clear();
+    if (sel.max_bid_px) b.max_bpx.resize(cnt); else b.max_bpx.clear();
+    if (sel.min_ask_px) b.min_apx.resize(cnt); else b.min_apx.clear();
+    if (sel.max_ask_px) b.max_apx.resize(cnt); else b.max_apx.clear();
+    if (sel.min_bid_ts) b.min_bts.resize(cnt); else b.min_bts.clear();
+    if (sel.max_bid_ts) b.max_bts.resize(cnt); else b.max_bts.clear();
+    if (sel.min_ask_ts) b.min_ats.resize(cnt); else b.min_ats.clear();
+    if (sel.max_ask_ts) b.max_ats.resize(cnt); else b.max_ats.clear();
+
+    auto read_and_scatter = [&](Col c, vector<int64_t>& out_vec)
+    {
+      if (col(c) < 0) throw runtime_error(string("top: missing ") + COL_NAMES[c]);
+      gather(*rg, c, rs, b.scratch, out_vec.data());
+    };
+
+    if (sel.ask_px)     read_and_scatter(ASK_PX, b.apx);
+    if (sel.ask_qty)    read_and_scatter(ASK_QTY, b.aq);
+    if (sel.bid_px)     read_and_scatter(BID_PX, b.bpx);
+    if (sel.bid_qty)    read_and_scatter(BID_QTY, b.bq);
+    if (sel.valu)       read_and_scatter(VALU, b.val);
+
+    if (sel.min_bid_px) read_and_scatter(MIN_BID_PX, b.min_bpx);
+    if (sel.max_bid_px) read_and_scatter(MAX_BID_PX, b.max_bpx);
+    if (sel.min_ask_px) read_and_scatter(MIN_ASK_PX, b.min_apx);
+    if (sel.max_ask_px) read_and_scatter(MAX_ASK_PX, b.max_apx);
+    if (sel.min_bid_ts) read_and_scatter(MIN_BID_TS, b.min_bts);
+    if (sel.max_bid_ts) read_and_scatter(MAX_BID_TS, b.max_bts);
+    if (sel.min_ask_ts) read_and_scatter(MIN_ASK_TS, b.min_ats);
+    if (sel.max_ask_ts) read_and_scatter(MAX_ASK_TS, b.max_ats);
+
+    return true;
+  }
 };
 
-struct ShardedDB::TopBatchReader::Impl
+struct FileStreamerTradeCols : FileStreamerBase
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerTopCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
-  TopSelect sel_;
-
-  // batch buffers
-  vector<int64_t> ts_;
-  vector<int64_t> apx_;
-  vector<int64_t> aq_;
-  vector<int64_t> bpx_;
-  vector<int64_t> bq_;
-  vector<int64_t> val_;
-  // sampled extras
-  vector<int64_t> min_bpx_, max_bpx_, min_apx_, max_apx_;
-  vector<int64_t> min_bts_, max_bts_, min_ats_, max_ats_;
+  enum Col { TS, PX, QTY, TRADE_ID, BUYER_ORDER_ID, SELLER_ORDER_ID, TRADE_TIME, IS_MARKET, EVENT_TIME, NCOLS };
+  static constexpr const char* COL_NAMES[NCOLS] = {
+    "ts", "px", "qty", "tradeId", "buyerOrderId", "sellerOrderId", "tradeTime", "isMarket", "eventTime" };
 
-  // current file basename (lifetime until next() is called again)
-  string cur_file_base_;
+  explicit FileStreamerTradeCols(const string& path, const FileOpener& open = {})
+  : FileStreamerBase(path, open, COL_NAMES) {}
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, TopSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  static vector<int> selected_cols(const ColumnPlan& plan, const TradeSelect& sel)
   {
-    if (g_debug) {
-      cerr << "[debug] top: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
-    }
+    bool want[NCOLS] = { true, sel.px, sel.qty, sel.tradeId, sel.buyerOrderId, sel.sellerOrderId,
+                         sel.tradeTime, sel.isMarket, sel.eventTime };
+    for (const FilterTerm& t : filter_terms(sel)) want[t.a] = true;
+    return plan_cols(plan, want);
   }
 
-  bool next(TopColsView& out)
+  // TradeField k is plan slot k
+  static vector<FilterTerm> filter_terms(const TradeSelect& sel)
   {
-    while (true)
+    vector<FilterTerm> out;
+    for (const auto& t : sel.where)
     {
-      if (!fs_)
-      {
-        if (file_idx_ >= files_.size()) return false;
+      const int c = static_cast<int>(t.col);
+      out.push_back(FilterTerm{c, -1, t.op, t.value, c == IS_MARKET});
+    }
+    return out;
+  }
 
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+  // Decode row group rg_i filtered to [start_ns, end_ns) and sel.where; false if no row matched.
+  bool read_rg(int rg_i, int64_t start_ns, int64_t end_ns, const TradeSelect& sel, TradeBuf& b) const
+  {
+    shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_i);
 
-        try
-        {
-          fs_ = make_unique<FileStreamerTopCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
-      }
+    if (col(TS) < 0) throw runtime_error("trade: missing ts");
 
-      bool ok = false;
+    RowSel rs;
+    b.scratch.reset();
+    const size_t cnt = select_rows(*rg, rg_i, start_ns, end_ns, b.ts, b.scratch, rs);
+    if (cnt == 0) return false;
 
-      try
-      {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, apx_, aq_, bpx_, bq_, val_,
-            min_bpx_, max_bpx_, min_apx_, max_apx_,
-            min_bts_, max_bts_, min_ats_, max_ats_);
-      }
-      catch (const exception& e)
-      {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
-      }
+    if (sel.px)            b.px.resize(cnt);     else b.px.clear();
+    if (sel.qty)           b.qty.resize(cnt);    else b.qty.clear();
+    if (sel.tradeId)       b.tid.resize(cnt);    else b.tid.clear();
+    if (sel.buyerOrderId)  b.boid.resize(cnt);   else b.boid.clear();
+    if (sel.sellerOrderId) b.soid.resize(cnt);   else b.soid.clear();
+    if (sel.tradeTime)     b.ttime.resize(cnt);  else b.ttime.clear();
+    if (sel.isMarket)      b.isMkt.resize(cnt);  else b.isMkt.clear();
+    if (sel.eventTime)     b.evt.resize(cnt);    else b.evt.clear();
 
-      if (!ok)
-      {
-        fs_.reset();
-        ++file_idx_;
-        continue;
-      }
+    auto read_and_scatter_i64 = [&](Col c, vector<int64_t>& out_vec)
+    {
+      if (col(c) < 0) throw runtime_error(string("trade: missing ") + COL_NAMES[c]);
+      gather(*rg, c, rs, b.scratch, out_vec.data());
+    };
 
-      if (ts_.empty()) continue;
-
-      out.ts        = sel_.ts        ? ts_.data()       : nullptr;
-      out.ask_px    = sel_.ask_px    ? apx_.data()      : nullptr;
-      out.ask_qty   = sel_.ask_qty   ? aq_.data()       : nullptr;
-      out.bid_px    = sel_.bid_px    ? bpx_.data()      : nullptr;
-      out.bid_qty   = sel_.bid_qty   ? bq_.data()       : nullptr;
-      out.valu      = sel_.valu      ? val_.data()      : nullptr;
-
-      out.min_bid_px = sel_.min_bid_px ? min_bpx_.data() : nullptr;
-      out.max_bid_px = sel_.max_bid_px ? max_bpx_.data() : nullptr;
-      out.min_ask_px = sel_.min_ask_px ? min_apx_.data() : nullptr;
-      out.max_ask_px = sel_.max_ask_px ? max_apx_.data() : nullptr;
-      out.min_bid_ts = sel_.min_bid_ts ? min_bts_.data() : nullptr;
-      out.max_bid_ts = sel_.max_bid_ts ? max_bts_.data() : nullptr;
-      out.min_ask_ts = sel_.min_ask_ts ? min_ats_.data() : nullptr;
-      out.max_ask_ts = sel_.max_ask_ts ? max_ats_.data() : nullptr;
-
-      out.file = cur_file_base_.c_str();
-      out.n = ts_.size();
-      return true;
-    }
+    auto read_and_scatter_bool = [&](Col c, vector<uint8_t>& out_vec)
+    {
+      if (col(c) < 0) throw runtime_error(string("trade: missing ") + COL_NAMES[c]);
+      gather(*rg, c, rs, b.scratch, out_vec.data());
+    };
+
+    if (sel.px)            read_and_scatter_i64(PX, b.px);
+    if (sel.qty)           read_and_scatter_i64(QTY, b.qty);
+    if (sel.tradeId)       read_and_scatter_i64(TRADE_ID, b.tid);
+    if (sel.buyerOrderId)  read_and_scatter_i64(BUYER_ORDER_ID, b.boid);
+    if (sel.sellerOrderId) read_and_scatter_i64(SELLER_ORDER_ID, b.soid);
+    if (sel.tradeTime)     read_and_scatter_i64(TRADE_TIME, b.ttime);
+    if (sel.isMarket)      read_and_scatter_bool(IS_MARKET, b.isMkt);
+    if (sel.eventTime)     read_and_scatter_i64(EVENT_TIME, b.evt);
+
+    return true;
   }
 };
 
-struct ShardedDB::TradeBatchReader::Impl
+struct FileStreamerDeltaCols : FileStreamerBase
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerTradeCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
-  TradeSelect sel_;
+  enum Col { TS, FIRST_ID, LAST_ID, EVENT_TIME, ASK_PX, ASK_QTY, BID_PX, BID_QTY, NCOLS };
+  static constexpr const char* COL_NAMES[NCOLS] = {
+    "ts", "firstId", "lastId", "eventTime",
+    "ask.list.element.px", "ask.list.element.qty", "bid.list.element.px", "bid.list.element.qty" };
 
-  vector<int64_t> ts_;
-  vector<int64_t> px_;
-  vector<int64_t> qty_;
-  vector<int64_t> tid_;
-  vector<int64_t> boid_;
-  vector<int64_t> soid_;
-  vector<int64_t> ttime_;
-  vector<uint8_t> isMkt_;
-  vector<int64_t> evt_;
+  explicit FileStreamerDeltaCols(const string& path, const FileOpener& open = {})
+  : FileStreamerBase(path, open, COL_NAMES) {}
 
-  string cur_file_base_;
+  // Depth rows carry per-level lists; no row filters
+  static vector<FilterTerm> filter_terms(const DeltaSelect&) { return {}; }
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, TradeSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  static vector<int> selected_cols(const ColumnPlan& plan, const DeltaSelect& sel)
   {
-    if (g_debug) {
-      cerr << "[debug] trade: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
-    }
+    const bool want[NCOLS] = { true, sel.firstId, sel.lastId, sel.eventTime,
+                               sel.ask_px, sel.ask_qty, sel.bid_px, sel.bid_qty };
+    return plan_cols(plan, want);
   }
 
-  bool next(TradeColsView& out)
+  // Decode row group rg_i filtered to [start_ns, end_ns); false if no row matched.
+  bool read_rg(int rg_i, int64_t start_ns, int64_t end_ns, const DeltaSelect& sel, DeltaBuf& b) const
   {
-    while (true)
+    if (g_legacy_depth) return read_rg_legacy(rg_i, start_ns, end_ns, sel, b);
+
+    shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_i);
+    const int64_t rows = rg->metadata()->num_rows();
+
+    const int ts_i = col(TS);
+    if (ts_i < 0) throw runtime_error("depth: missing ts");
+
+    b.fid.clear();
+    b.lid.clear();
+    b.evt.clear();
+    b.ask_off.clear();
+    b.ask_px.clear();
+    b.ask_qty.clear();
+    b.bid_off.clear();
+    b.bid_px.clear();
+    b.bid_qty.clear();
+
+    bool sorted = false;
+    size_t lo = 0;
+    span<const int64_t> ts_all;
+    b.scratch.reset();
+    const size_t cnt = slice_ts(*rg, rg_i, ts_i, start_ns, end_ns, b.ts, sorted, lo, b.scratch, ts_all);
+    if (cnt == 0) return false;
+
+    auto in_range = [&](size_t r) { return ts_all[r] >= start_ns && ts_all[r] < end_ns; };
+
+    auto read_and_scatter_i64 = [&](Col c, vector<int64_t>& out_vec)
     {
-      if (!fs_)
+      const int idx = col(c);
+      if (idx < 0) throw runtime_error(string("depth: missing ") + COL_NAMES[c]);
+      out_vec.resize(cnt);
+      if (sorted)
       {
-        if (file_idx_ >= files_.size()) return false;
+        read_i64(*rg, rg_i, idx, static_cast<int64_t>(lo), static_cast<int64_t>(cnt), out_vec.data());
+        return;
+      }
+      int64_t* tmp = b.scratch.alloc<int64_t>(ts_all.size());
+      read_i64(*rg, rg_i, idx, 0, static_cast<int64_t>(ts_all.size()), tmp);
 
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+      size_t w = 0;
+      for (size_t i = 0; i < ts_all.size(); ++i)
+        if (in_range(i)) out_vec[w++] = tmp[i];
+    };
 
-        try
-        {
-          fs_ = make_unique<FileStreamerTradeCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
+    // One book side: offsets of the kept rows + their packed px/qty elements
+    auto read_side = [&](Col px_c, Col qty_c, bool want_px, bool want_qty,
+                         vector<uint32_t>& off, vector<int64_t>& px, vector<int64_t>& qty)
+    {
+      if (!want_px && !want_qty) return;
+
+      auto read_list = [&](Col c)
+      {
+        const int idx = col(c);
+        if (idx < 0) throw runtime_error(string("depth: missing ") + COL_NAMES[c]);
+        return decode_list_i64(*rg, idx, schema->Column(idx), rows, b.scratch);
+      };
+      ListColumn lp, lq;
+      if (want_px)  lp = read_list(px_c);
+      if (want_qty) lq = read_list(qty_c);
+      if (want_px && want_qty && !equal(lp.starts, lp.starts + rows + 1, lq.starts))
+        throw runtime_error("depth: px/qty list layouts differ");
+      const uint32_t* starts = want_px ? lp.starts : lq.starts;
+
+      off.resize(cnt + 1);
+      off[0] = 0;
+      if (sorted)
+      {
+        const uint32_t first = starts[lo];
+        const uint32_t last  = starts[lo + cnt];
+        for (size_t k = 1; k <= cnt; ++k) off[k] = starts[lo + k] - first;
+        if (want_px)  px.assign(lp.vals + first, lp.vals + last);
+        if (want_qty) qty.assign(lq.vals + first, lq.vals + last);
+        return;
       }
 
-      bool ok = false;
+      size_t w = 0;
+      for (size_t r = 0; r < ts_all.size(); ++r)
+      {
+        if (!in_range(r)) continue;
+        const uint32_t a = starts[r];
+        const uint32_t z = starts[r + 1];
+        if (want_px)  px.insert(px.end(), lp.vals + a, lp.vals + z);
+        if (want_qty) qty.insert(qty.end(), lq.vals + a, lq.vals + z);
+        off[w + 1] = off[w] + (z - a);
+        ++w;
+      }
+    };
 
-      try
+    if (sel.firstId)   read_and_scatter_i64(FIRST_ID, b.fid);
+    if (sel.lastId)    read_and_scatter_i64(LAST_ID, b.lid);
+    if (sel.eventTime) read_and_scatter_i64(EVENT_TIME, b.evt);
+    read_side(ASK_PX, ASK_QTY, sel.ask_px, sel.ask_qty, b.ask_off, b.ask_px, b.ask_qty);
+    read_side(BID_PX, BID_QTY, sel.bid_px, sel.bid_qty, b.bid_off, b.bid_px, b.bid_qty);
+
+    return true;
+  }
+
+  // Per-entry cursor decoder kept for comparison (see ShardedDB::set_legacy_depth_decode)
+  bool read_rg_legacy(int rg_i, int64_t start_ns, int64_t end_ns, const DeltaSelect& sel, DeltaBuf& b) const
+  {
+    shared_ptr<parquet::RowGroupReader> rg = reader->RowGroup(rg_i);
+    auto rmd = rg->metadata();
+    int64_t rows = rmd->num_rows();
+
+    int ts_i = col(TS);
+    if (ts_i < 0) throw runtime_error("depth: missing ts");
+    b.scratch.reset();
+    Int64Cursor ts(rg->Column(ts_i), schema->Column(ts_i), b.scratch);
+
+    optional<Int64Cursor> fid;
+    optional<Int64Cursor> lid;
+    optional<Int64Cursor> evt;
+
+    if (sel.firstId)
+    {
+      int fid_i = col(FIRST_ID);
+      if (fid_i < 0) throw runtime_error("depth: missing firstId");
+      fid.emplace(rg->Column(fid_i), schema->Column(fid_i), b.scratch);
+    }
+    if (sel.lastId)
+    {
+      int lid_i = col(LAST_ID);
+      if (lid_i < 0) throw runtime_error("depth: missing lastId");
+      lid.emplace(rg->Column(lid_i), schema->Column(lid_i), b.scratch);
+    }
+    if (sel.eventTime)
+    {
+      int evt_i = col(EVENT_TIME);
+      if (evt_i < 0) throw runtime_error("depth: missing eventTime");
+      evt.emplace(rg->Column(evt_i), schema->Column(evt_i), b.scratch);
+    }
+
+    bool need_asks = (sel.ask_px || sel.ask_qty);
+    bool need_bids = (sel.bid_px || sel.bid_qty);
+
+    optional<Int64Cursor> apx;
+    optional<Int64Cursor> aqty;
+    optional<Int64Cursor> bpx;
+    optional<Int64Cursor> bqty;
+
+    if (need_asks)
+    {
+      if (sel.ask_px)
       {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, px_, qty_, tid_, boid_, soid_, ttime_, isMkt_, evt_);
+        int apx_i = col(ASK_PX);
+        if (apx_i < 0) throw runtime_error("depth: missing ask px");
+        apx.emplace(rg->Column(apx_i), schema->Column(apx_i), b.scratch);
       }
-      catch (const exception& e)
+      if (sel.ask_qty)
       {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
+        int aqty_i = col(ASK_QTY);
+        if (aqty_i < 0) throw runtime_error("depth: missing ask qty");
+        aqty.emplace(rg->Column(aqty_i), schema->Column(aqty_i), b.scratch);
       }
+    }
 
-      if (!ok)
+    if (need_bids)
+    {
+      if (sel.bid_px)
       {
-        fs_.reset();
-        ++file_idx_;
-        continue;
+        int bpx_i = col(BID_PX);
+        if (bpx_i < 0) throw runtime_error("depth: missing bid px");
+        bpx.emplace(rg->Column(bpx_i), schema->Column(bpx_i), b.scratch);
+      }
+      if (sel.bid_qty)
+      {
+        int bqty_i = col(BID_QTY);
+        if (bqty_i < 0) throw runtime_error("depth: missing bid qty");
+        bqty.emplace(rg->Column(bqty_i), schema->Column(bqty_i), b.scratch);
       }
+    }
 
-      if (ts_.empty()) continue;
+    b.ts.clear();
+    b.fid.clear();
+    b.lid.clear();
+    b.evt.clear();
+    b.ask_off.clear();
+    b.ask_px.clear();
+    b.ask_qty.clear();
+    b.bid_off.clear();
+    b.bid_px.clear();
+    b.bid_qty.clear();
+
+    b.ts.reserve(rows);
+    if (sel.firstId)   b.fid.reserve(rows);
+    if (sel.lastId)    b.lid.reserve(rows);
+    if (sel.eventTime) b.evt.reserve(rows);
+    if (need_asks) { b.ask_off.reserve(rows + 1); b.ask_off.push_back(0); }
+    if (need_bids) { b.bid_off.reserve(rows + 1); b.bid_off.push_back(0); }
+
+    for (int64_t r = 0; r < rows; ++r)
+    {
+      Entry e_ts = ts.take();
 
-      out.ts            = sel_.ts            ? ts_.data()     : nullptr;
-      out.px            = sel_.px            ? px_.data()     : nullptr;
-      out.qty           = sel_.qty           ? qty_.data()    : nullptr;
-      out.tradeId       = sel_.tradeId       ? tid_.data()    : nullptr;
-      out.buyerOrderId  = sel_.buyerOrderId  ? boid_.data()   : nullptr;
-      out.sellerOrderId = sel_.sellerOrderId ? soid_.data()   : nullptr;
-      out.tradeTime     = sel_.tradeTime     ? ttime_.data()  : nullptr;
-      out.isMarket      = sel_.isMarket      ? isMkt_.data()  : nullptr;
-      out.eventTime     = sel_.eventTime     ? evt_.data()    : nullptr;
+      Entry e_fid{};
+      Entry e_lid{};
+      Entry e_evt{};
+      if (sel.firstId)   e_fid = fid->take();
+      if (sel.lastId)    e_lid = lid->take();
+      if (sel.eventTime) e_evt = evt->take();
 
-      out.file = cur_file_base_.c_str();
-      out.n    = ts_.size();
-      return true;
+      bool in_range = (e_ts.value >= start_ns && e_ts.value < end_ns);
+
+      uint32_t asks_added = 0;
+      uint32_t bids_added = 0;
+
+      if (need_asks)
+      {
+        if (sel.ask_px && sel.ask_qty)
+        {
+          asks_added = append_list_pairs_for_row_typed(
+              *apx, *aqty,
+              in_range ? &b.ask_px : nullptr,
+              in_range ? &b.ask_qty : nullptr);
+        }
+        else if (sel.ask_px)
+        {
+          asks_added = append_list_from_leaf_for_row(*apx, in_range ? &b.ask_px : nullptr);
+        }
+        else if (sel.ask_qty)
+        {
+          asks_added = append_list_from_leaf_for_row(*aqty, in_range ? &b.ask_qty : nullptr);
+        }
+      }
+
+      if (need_bids)
+      {
+        if (sel.bid_px && sel.bid_qty)
+        {
+          bids_added = append_list_pairs_for_row_typed(
+              *bpx, *bqty,
+              in_range ? &b.bid_px : nullptr,
+              in_range ? &b.bid_qty : nullptr);
+        }
+        else if (sel.bid_px)
+        {
+          bids_added = append_list_from_leaf_for_row(*bpx, in_range ? &b.bid_px : nullptr);
+        }
+        else if (sel.bid_qty)
+        {
+          bids_added = append_list_from_leaf_for_row(*bqty, in_range ? &b.bid_qty : nullptr);
+        }
+      }
+
+      if (in_range)
+      {
+        b.ts.push_back(e_ts.value);
+        if (sel.firstId)   b.fid.push_back(e_fid.value);
+        if (sel.lastId)    b.lid.push_back(e_lid.value);
+        if (sel.eventTime) b.evt.push_back(e_evt.value);
+
+        if (need_asks) b.ask_off.push_back(b.ask_off.back() + asks_added);
+        if (need_bids) b.bid_off.push_back(b.bid_off.back() + bids_added);
+      }
     }
+
+    return !b.ts.empty();
   }
 };
 
-struct ShardedDB::DeltaBatchReader::Impl
+// Open a shard for [s, e) with the configured backend. Uring readers pre-buffer
+// the selected column chunks of every row group that can match, so the cache
+// hands the coalesced ranges to UringFile::ReadManyAsync in one go.
+template <class Streamer, class Select>
+static unique_ptr<Streamer> open_streamer(const string& path, const FileOpener& open, int64_t start_ns, int64_t end_ns, const Select& sel)
 {
-  vector<Candidate> files_;
-  size_t file_idx_ = 0;
-  unique_ptr<FileStreamerDeltaCols> fs_;
-  int64_t start_ns_;
-  int64_t end_ns_;
-  DeltaSelect sel_;
+  auto fs = make_unique<Streamer>(path, open);
+  fs->filter = Streamer::filter_terms(sel);
+#if PQ_HAVE_URING
+  if (open.io.backend == IoBackend::Uring)
+  {
+    vector<int> rgs;
+    for (int i = 0; i < fs->num_row_groups(); ++i)
+      if (fs->rg_may_match(i, start_ns, end_ns)) rgs.push_back(i);
+    vector<int> cols = Streamer::selected_cols(*fs->plan, sel);
+    if (!rgs.empty() && !cols.empty())
+      fs->reader->PreBuffer(rgs, cols, arrow::io::default_io_context(), arrow::io::CacheOptions::Defaults());
+  }
+#else
+  (void)start_ns; (void)end_ns;
+#endif
+  return fs;
+}
 
-  vector<int64_t> ts_;
-  vector<int64_t> fid_;
-  vector<int64_t> lid_;
-  vector<int64_t> evt_;
-  vector<uint32_t> ask_off_;
-  vector<uint32_t> bid_off_;
-  vector<int64_t>  ask_px_;
-  vector<int64_t>  ask_qty_;
-  vector<int64_t>  bid_px_;
-  vector<int64_t>  bid_qty_;
+// ======== Async read-ahead (see ReadAheadOptions) ========
+//
+// One background thread per DB. For each queued file it takes a reader from the
+// handle cache (so the footer gets parsed off the consumer's thread), works out
+// the byte ranges of the column chunks the reader's Select will decode in the
+// row groups whose ts statistics overlap the window, hints those ranges to the
+// kernel (up to the per-file byte budget) and parks the reader in the cache for
+// the streamer that opens the file next.
 
-  string cur_file_base_;
+class ReadAhead
+{
+public:
+  ReadAhead(ReadAheadOptions opt, shared_ptr<FileHandleCache> cache)
+  : opt_(opt), cache_(move(cache)), worker_([this] { run(); }) {}
 
-  Impl(vector<Candidate> files, int64_t s, int64_t e, DeltaSelect sel)
-  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel)
+  ~ReadAhead()
   {
-    if (g_debug) {
-      cerr << "[debug] depth: " << files_.size() << " candidate files\n";
-      for (const auto& c : files_) {
-        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
-             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
-      }
+    {
+      lock_guard<mutex> lk(m_);
+      stop_ = true;
     }
+    cv_.notify_all();
+    worker_.join();
   }
 
-  bool next(DeltaColsView& out)
+  ReadAhead(const ReadAhead&) = delete;
+  ReadAhead& operator=(const ReadAhead&) = delete;
+
+  const ReadAheadOptions& options() const { return opt_; }
+
+  // Queue path for warming with the columns a Streamer decodes for sel in [start_ns, end_ns)
+  template <class Streamer, class Select>
+  void request(const string& path, const IoOptions& io, int64_t start_ns, int64_t end_ns, const Select& sel)
   {
-    while (true)
+    Job j{path, io, start_ns, end_ns, Streamer::COL_NAMES,
+          [sel](const ColumnPlan& plan) { return Streamer::selected_cols(plan, sel); }};
     {
-      if (!fs_)
-      {
-        if (file_idx_ >= files_.size()) return false;
+      lock_guard<mutex> lk(m_);
+      if (jobs_.size() >= MAX_QUEUED) jobs_.pop_front();  // the consumer has passed the oldest by now
+      jobs_.push_back(move(j));
+    }
+    cv_.notify_one();
+  }
 
-        // Prefetch next file (if any)
-        if (file_idx_ + 1 < files_.size()) prefetch_path(files_[file_idx_ + 1].path);
+private:
+  static constexpr size_t MAX_QUEUED = 32;
 
-        try
-        {
-          fs_ = make_unique<FileStreamerDeltaCols>(files_[file_idx_].path);
-          cur_file_base_ = fs::path(files_[file_idx_].path).filename().string();
-        }
-        catch (const exception& e)
-        {
-          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-          ++file_idx_;
-          continue;
-        }
+  struct Job
+  {
+    string path;
+    IoOptions io;
+    int64_t start_ns;
+    int64_t end_ns;
+    span<const char* const> names;
+    function<vector<int>(const ColumnPlan&)> cols;
+  };
+
+  void run()
+  {
+    while (true)
+    {
+      Job j;
+      {
+        unique_lock<mutex> lk(m_);
+        cv_.wait(lk, [&] { return stop_ || !jobs_.empty(); });
+        if (stop_) return;
+        j = move(jobs_.front());
+        jobs_.pop_front();
       }
 
-      bool ok = false;
-
       try
       {
-        ok = fs_->next_rg(
-            start_ns_, end_ns_, sel_,
-            ts_, fid_, lid_, evt_,
-            ask_off_, ask_px_, ask_qty_,
-            bid_off_, bid_px_, bid_qty_);
+        warm(j);
       }
       catch (const exception& e)
       {
-        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
-        ok = false;
-      }
-
-      if (!ok)
-      {
-        fs_.reset();
-        ++file_idx_;
-        continue;
+        if (g_debug) cerr << "[debug] readahead: " << j.path << " : " << e.what() << "\n";
       }
+    }
+  }
 
-      if (ts_.empty()) continue;
+  void warm(const Job& j)
+  {
+    OpenedFile f;
+    if (cache_) f = cache_->take(j.path, j.io);
+    else
+    {
+      f.reader = open_parquet(j.path, j.io);
+      f.md     = f.reader->metadata();
+    }
 
-      out.ts        = sel_.ts        ? ts_.data()  : nullptr;
-      out.firstId   = sel_.firstId   ? fid_.data() : nullptr;
-      out.lastId    = sel_.lastId    ? lid_.data() : nullptr;
-      out.eventTime = sel_.eventTime ? evt_.data() : nullptr;
+    auto plan = resolve_plan(f.md->schema(), j.names);
+    const vector<int> cols = j.cols(*plan);
+    const int ts_i = plan->idx[0];
 
-      bool have_asks = sel_.ask_px || sel_.ask_qty;
-      bool have_bids = sel_.bid_px || sel_.bid_qty;
+    vector<pair<int64_t, int64_t>> ranges;  // (offset, length)
+    uint64_t budget = opt_.budget_bytes;
+    for (int rg_i = 0; rg_i < f.md->num_row_groups() && budget > 0; ++rg_i)
+    {
+      auto b = FileStreamerBase::ts_bounds(*f.md, ts_i, rg_i);
+      if (b && (b->second < j.start_ns || b->first >= j.end_ns)) continue;
 
-      out.ask_off = have_asks ? ask_off_.data() : nullptr;
-      out.ask_px  = sel_.ask_px ? ask_px_.data() : nullptr;
-      out.ask_qty = sel_.ask_qty ? ask_qty_.data() : nullptr;
+      auto rmd = f.md->RowGroup(rg_i);
+      for (int c : cols)
+      {
+        auto cc = rmd->ColumnChunk(c);
+        int64_t off = cc->data_page_offset();
+        if (cc->has_dictionary_page() && cc->dictionary_page_offset() > 0 && cc->dictionary_page_offset() < off)
+          off = cc->dictionary_page_offset();
+        const uint64_t len = min<uint64_t>(static_cast<uint64_t>(cc->total_compressed_size()), budget);
+        if (len == 0) continue;
+        ranges.emplace_back(off, static_cast<int64_t>(len));
+        budget -= len;
+        if (budget == 0) break;
+      }
+    }
 
-      out.bid_off = have_bids ? bid_off_.data() : nullptr;
-      out.bid_px  = sel_.bid_px ? bid_px_.data() : nullptr;
-      out.bid_qty = sel_.bid_qty ? bid_qty_.data() : nullptr;
+    const uint64_t hinted = hint_ranges(j.path, ranges);
+    if (g_debug)
+      cerr << "[debug] readahead: " << j.path << " cols=" << cols.size() << " ranges=" << ranges.size()
+           << " bytes=" << hinted << "\n";
 
-      out.file = cur_file_base_.c_str();
-      out.n    = ts_.size();
-      return true;
-    }
+    if (cache_) cache_->put(j.path, j.io, move(f));
   }
-};
 
-// ---- ShardedDB methods
+  // Coalesce touching ranges and ask the kernel to start reading them; returns bytes hinted
+  static uint64_t hint_ranges(const string& path, vector<pair<int64_t, int64_t>>& ranges)
+  {
+    if (ranges.empty()) return 0;
+    sort(ranges.begin(), ranges.end());
 
-ShardedDB::ShardedDB(std::string root, std::optional<std::string> sampling)
-: impl_(make_unique<Impl>(move(root), move(sampling))) {}
+    size_t w = 0;
+    for (size_t i = 1; i < ranges.size(); ++i)
+    {
+      auto& cur = ranges[w];
+      if (ranges[i].first <= cur.first + cur.second)
+        cur.second = max(cur.second, ranges[i].first + ranges[i].second - cur.first);
+      else
+        ranges[++w] = ranges[i];
+    }
+    ranges.resize(w + 1);
 
-ShardedDB::~ShardedDB() = default;
-ShardedDB::ShardedDB(ShardedDB&&) noexcept = default;
-ShardedDB& ShardedDB::operator=(ShardedDB&&) noexcept = default;
+    uint64_t total = 0;
+#if defined(__linux__)
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return 0;
+    for (const auto& [off, len] : ranges)
+      if (posix_fadvise(fd, off, len, POSIX_FADV_WILLNEED) == 0) total += static_cast<uint64_t>(len);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+    return total;
+  }
 
-ShardedDB::TopBatchReader::TopBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
-ShardedDB::TopBatchReader::TopBatchReader(TopBatchReader&&) noexcept = default;
-ShardedDB::TopBatchReader& ShardedDB::TopBatchReader::operator=(TopBatchReader&&) noexcept = default;
-ShardedDB::TopBatchReader::~TopBatchReader() = default;
-bool ShardedDB::TopBatchReader::next(TopColsView& out) { return impl_->next(out); }
+  ReadAheadOptions opt_;
+  shared_ptr<FileHandleCache> cache_;
 
-ShardedDB::TradeBatchReader::TradeBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
-ShardedDB::TradeBatchReader::TradeBatchReader(TradeBatchReader&&) noexcept = default;
-ShardedDB::TradeBatchReader& ShardedDB::TradeBatchReader::operator=(TradeBatchReader&&) noexcept = default;
-ShardedDB::TradeBatchReader::~TradeBatchReader() = default;
-bool ShardedDB::TradeBatchReader::next(TradeColsView& out) { return impl_->next(out); }
+  mutex m_;
+  condition_variable cv_;
+  deque<Job> jobs_;
+  bool stop_ = false;
 
-ShardedDB::DeltaBatchReader::DeltaBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
-ShardedDB::DeltaBatchReader::DeltaBatchReader(DeltaBatchReader&&) noexcept = default;
-ShardedDB::DeltaBatchReader& ShardedDB::DeltaBatchReader::operator=(DeltaBatchReader&&) noexcept = default;
-ShardedDB::DeltaBatchReader::~DeltaBatchReader() = default;
-bool ShardedDB::DeltaBatchReader::next(DeltaColsView& out) { return impl_->next(out); }
+  thread worker_;  // last: started once everything above is constructed
+};
 
-// Market-aware
-unique_ptr<ShardedDB::TopBatchReader> ShardedDB::Impl::get_top(int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const
-{
-  auto files = candidate_files_strict(root_, symb, "top", market, s, e, sampling_);
-  auto impl = make_unique<TopBatchReader::Impl>(move(files), s, e, sel);
-  return make_unique<TopBatchReader>(move(impl));
-}
-unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::Impl::get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const
+// Queue the files after the one a reader is about to open. `next` is the
+// reader's high-water mark, so each file is requested at most once.
+template <class Streamer, class Select>
+static void read_ahead(const FileOpener& open, const vector<Candidate>& files, size_t from, size_t& next,
+                       int64_t start_ns, int64_t end_ns, const Select& sel)
 {
-  auto files = candidate_files_strict(root_, symb, "trade", market, s, e, nullopt);
-  auto impl = make_unique<TradeBatchReader::Impl>(move(files), s, e, sel);
-  return make_unique<TradeBatchReader>(move(impl));
+  if (!open.readahead) return;
+  const size_t upto = min(files.size(), from + open.readahead->options().files_ahead);
+  for (size_t k = max(from, next); k < upto; ++k)
+    open.readahead->request<Streamer>(files[k].path, open.io, start_ns, end_ns, sel);
+  next = max(next, upto);
 }
-unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::Impl::get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const
+
+// ======== Reader counters (shared with pipeline workers) ========
+
+struct ReaderCounters
 {
-  auto files = candidate_files_strict(root_, symb, "depth", market, s, e, nullopt);
-  auto impl = make_unique<DeltaBatchReader::Impl>(move(files), s, e, sel);
-  return make_unique<DeltaBatchReader>(move(impl));
-}
+  atomic<uint64_t> files_opened{0};
+  atomic<uint64_t> rg_skipped{0};
+  atomic<uint64_t> rg_decoded{0};
+  atomic<uint64_t> rows_decoded{0};
+  atomic<uint64_t> scratch_allocs{0};
+  atomic<uint64_t> rows_emitted{0};
+  atomic<uint64_t> batches{0};
+
+  ReaderStats snapshot() const
+  {
+    ReaderStats st;
+    st.files_opened       = files_opened.load(memory_order_relaxed);
+    st.row_groups_skipped = rg_skipped.load(memory_order_relaxed);
+    st.row_groups_decoded = rg_decoded.load(memory_order_relaxed);
+    st.rows_decoded       = rows_decoded.load(memory_order_relaxed);
+    st.scratch_allocs     = scratch_allocs.load(memory_order_relaxed);
+    st.rows_emitted       = rows_emitted.load(memory_order_relaxed);
+    st.batches            = batches.load(memory_order_relaxed);
+    return st;
+  }
+};
 
-// Public API (market-aware)
-unique_ptr<ShardedDB::TopBatchReader>
-ShardedDB::get_top_cols(int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const
+// Advance fs.rg_idx past row groups the ts statistics rule out; false at end of file
+template <class Streamer>
+static bool skip_pruned_rgs(Streamer& fs, int& rg_idx, int64_t start_ns, int64_t end_ns, ReaderCounters& c)
 {
-  return impl_->get_top(s, e, symb, move(market), sel);
+  while (rg_idx < fs.num_row_groups() && !fs.rg_may_match(rg_idx, start_ns, end_ns))
+  {
+    ++rg_idx;
+    c.rg_skipped.fetch_add(1, memory_order_relaxed);
+  }
+  return rg_idx < fs.num_row_groups();
 }
-unique_ptr<ShardedDB::TradeBatchReader>
-ShardedDB::get_trade_cols(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const
+
+// Sequential: decode row groups of fs until one has rows in the window
+template <class Streamer, class Select, class Buf>
+static bool next_rg(Streamer& fs, int64_t start_ns, int64_t end_ns, const Select& sel, Buf& b, ReaderCounters& c)
 {
-  return impl_->get_trade(s, e, symb, move(market), sel);
+  while (skip_pruned_rgs(fs, fs.rg_idx, start_ns, end_ns, c))
+  {
+    const int rg_i = fs.rg_idx++;
+    c.rg_decoded.fetch_add(1, memory_order_relaxed);
+    c.rows_decoded.fetch_add(static_cast<uint64_t>(fs.rg_rows(rg_i)), memory_order_relaxed);
+    const bool hit = fs.read_rg(rg_i, start_ns, end_ns, sel, b);
+    c.scratch_allocs.fetch_add(b.scratch.take_allocs(), memory_order_relaxed);
+    if (hit) return true;
+  }
+  return false;
 }
-unique_ptr<ShardedDB::DeltaBatchReader>
-ShardedDB::get_depth_cols(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const
+
+// ======== Background row-group pipeline (opt-in, see PipelineOptions) ========
+//
+// Row groups are claimed in (file, row group) order and tagged with a sequence
+// number; workers decode them concurrently and pop() hands them out strictly in
+// sequence order, so the consumer sees exactly what the sequential path yields.
+
+template <class Streamer, class Select, class Buf>
+class RowGroupPipeline
 {
-  return impl_->get_depth(s, e, symb, move(market), sel);
-}
+public:
+  RowGroupPipeline(const vector<Candidate>& files, int64_t s, int64_t e, Select sel, PipelineOptions opt,
+                   FileOpener open, ReaderCounters& counters)
+  : files_(files), start_ns_(s), end_ns_(e), sel_(sel), opt_(opt), open_(move(open)), counters_(counters)
+  {
+    if (opt_.depth == 0) opt_.depth = 1;
+    for (unsigned i = 0; i < opt_.threads; ++i) workers_.emplace_back([this] { work(); });
+  }
 
-// Backward compatible (search both markets)
-unique_ptr<ShardedDB::TopBatchReader>   ShardedDB::get_top_cols  (int64_t s, int64_t e, const string& symb, TopSelect sel) const   { return impl_->get_top(s, e, symb, nullopt, sel); }
-unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::get_trade_cols(int64_t s, int64_t e, const string& symb, TradeSelect sel) const { return impl_->get_trade(s, e, symb, nullopt, sel); }
-unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::get_depth_cols(int64_t s, int64_t e, const string& symb, DeltaSelect sel) const { return impl_->get_depth(s, e, symb, nullopt, sel); }
+  ~RowGroupPipeline()
+  {
+    {
+      lock_guard<mutex> lk(m_);
+      stop_ = true;
+    }
+    cv_work_.notify_all();
+    for (thread& t : workers_) t.join();
+  }
+
+  RowGroupPipeline(const RowGroupPipeline&) = delete;
+  RowGroupPipeline& operator=(const RowGroupPipeline&) = delete;
+
+  // Next non-empty row group in order. The previous contents of `out` are
+  // recycled as a decode buffer. Returns false when everything is consumed.
+  bool pop(Buf& out)
+  {
+    unique_lock<mutex> lk(m_);
+    while (true)
+    {
+      cv_ready_.wait(lk, [&] { return ready_.count(pop_seq_) || (exhausted_ && in_flight_ == 0); });
+
+      auto it = ready_.find(pop_seq_);
+      if (it == ready_.end()) return false;
+
+      Slot slot = move(it->second);
+      ready_.erase(it);
+      ++pop_seq_;
+      bytes_ -= slot.bytes;
+      cv_work_.notify_all();
+
+      if (!slot.has_rows)
+      {
+        free_.push_back(move(slot.buf));
+        continue;
+      }
+
+      swap(out, slot.buf);
+      free_.push_back(move(slot.buf));
+      return true;
+    }
+  }
+
+private:
+  struct OpenFile
+  {
+    unique_ptr<Streamer> fs;
+    string path;
+    string base;
+    atomic<bool> failed{false};
+  };
+
+  struct Task
+  {
+    uint64_t seq = 0;
+    shared_ptr<OpenFile> file;
+    int rg = 0;
+  };
+
+  struct Slot
+  {
+    Buf buf;
+    bool has_rows = false;
+    size_t bytes = 0;
+  };
+
+  // Depth and memory cap; a single oversized batch is still let through so the
+  // consumer can always make progress.
+  bool has_room_locked() const
+  {
+    if (in_flight_ + ready_.size() >= opt_.depth) return false;
+    return bytes_ < opt_.max_bytes || ready_.empty();
+  }
+
+  // Next (file, row group) in order, opening files as needed. Called with claim_m_ held.
+  bool claim(Task& t)
+  {
+    while (true)
+    {
+      if (cur_ && !cur_->failed.load() && skip_pruned_rgs(*cur_->fs, cur_rg_, start_ns_, end_ns_, counters_))
+      {
+        t.seq  = next_seq_++;
+        t.file = cur_;
+        t.rg   = cur_rg_++;
+        return true;
+      }
+
+      cur_.reset();
+      if (file_idx_ >= files_.size()) return false;
 
+      const string& path = files_[file_idx_].path;
+      read_ahead<Streamer>(open_, files_, file_idx_ + 1, ra_next_, start_ns_, end_ns_, sel_);
+      ++file_idx_;
 
+      try
+      {
+        auto f  = make_shared<OpenFile>();
+        f->fs   = open_streamer<Streamer>(path, open_, start_ns_, end_ns_, sel_);
+        f->path = path;
+        f->base = fs::path(path).filename().string();
+        cur_    = move(f);
+        cur_rg_ = 0;
+        counters_.files_opened.fetch_add(1, memory_order_relaxed);
+      }
+      catch (const exception& e)
+      {
+        cerr << "WARN: open failed: " << path << " : " << e.what() << "\n";
+      }
+    }
+  }
+
+  void work()
+  {
+    while (true)
+    {
+      Slot slot;
+      {
+        unique_lock<mutex> lk(m_);
+        cv_work_.wait(lk, [&] { return stop_ || exhausted_ || has_room_locked(); });
+        if (stop_ || exhausted_) return;
+        ++in_flight_;
+        if (!free_.empty())
+        {
+          slot.buf = move(free_.back());
+          free_.pop_back();
+        }
+      }
+
+      Task t;
+      bool got = false;
+      {
+        lock_guard<mutex> ck(claim_m_);
+        got = claim(t);
+      }
+
+      if (!got)
+      {
+        {
+          lock_guard<mutex> lk(m_);
+          --in_flight_;
+          exhausted_ = true;
+        }
+        cv_ready_.notify_all();
+        cv_work_.notify_all();
+        return;
+      }
+
+      if (!t.file->failed.load())
+      {
+        counters_.rg_decoded.fetch_add(1, memory_order_relaxed);
+        counters_.rows_decoded.fetch_add(static_cast<uint64_t>(t.file->fs->rg_rows(t.rg)), memory_order_relaxed);
+        try
+        {
+          slot.has_rows = t.file->fs->read_rg(t.rg, start_ns_, end_ns_, sel_, slot.buf);
+        }
+        catch (const exception& e)
+        {
+          // Same policy as the sequential path: a read error drops the rest of the file
+          if (!t.file->failed.exchange(true))
+            cerr << "WARN: read failed: " << t.file->path << " : " << e.what() << "\n";
+          slot.has_rows = false;
+        }
+        counters_.scratch_allocs.fetch_add(slot.buf.scratch.take_allocs(), memory_order_relaxed);
+      }
+      slot.buf.file = t.file->base;
+      slot.bytes = slot.has_rows ? slot.buf.bytes() : 0;
+
+      {
+        lock_guard<mutex> lk(m_);
+        --in_flight_;
+        bytes_ += slot.bytes;
+        ready_.emplace(t.seq, move(slot));
+      }
+      cv_ready_.notify_all();
+    }
+  }
+
+  const vector<Candidate>& files_;
+  const int64_t start_ns_;
+  const int64_t end_ns_;
+  const Select sel_;
+  PipelineOptions opt_;
+  FileOpener open_;
+  ReaderCounters& counters_;
+
+  // claim state (claim_m_)
+  mutex claim_m_;
+  size_t file_idx_ = 0;
+  size_t ra_next_ = 0;
+  shared_ptr<OpenFile> cur_;
+  int cur_rg_ = 0;
+  uint64_t next_seq_ = 0;
+
+  // queue state (m_)
+  mutex m_;
+  condition_variable cv_work_;
+  condition_variable cv_ready_;
+  map<uint64_t, Slot> ready_;
+  vector<Buf> free_;
+  uint64_t pop_seq_ = 0;
+  size_t in_flight_ = 0;
+  size_t bytes_ = 0;
+  bool exhausted_ = false;
+  bool stop_ = false;
+
+  vector<thread> workers_;
+};
+
+// ======== Arrow C Data Interface export (see export_arrow) ========
+//
+// Every exported node, array or schema, owns a heap node in private_data.
+// Array nodes share the batch's column storage through `keep`, so the buffers
+// stay put until the consumer has released every node. Children may be moved
+// out and released on their own, as the interface allows.
+
+struct ArrowArrayNode
+{
+  shared_ptr<const void> keep;
+  const void* buffers[2] = {};
+  vector<ArrowArray> children;
+  vector<ArrowArray*> child_ptrs;
+};
+
+struct ArrowSchemaNode
+{
+  string format;
+  string name;
+  vector<ArrowSchema> children;
+  vector<ArrowSchema*> child_ptrs;
+};
+
+static void release_array(ArrowArray* a)
+{
+  auto* node = static_cast<ArrowArrayNode*>(a->private_data);
+  for (ArrowArray& c : node->children)
+    if (c.release) c.release(&c);
+  delete node;
+  a->release = nullptr;
+}
+
+static void release_schema(ArrowSchema* s)
+{
+  auto* node = static_cast<ArrowSchemaNode*>(s->private_data);
+  for (ArrowSchema& c : node->children)
+    if (c.release) c.release(&c);
+  delete node;
+  s->release = nullptr;
+}
+
+// No validity bitmap (every column is required), so buffers[0] is always null
+static ArrowArray make_array(int64_t length, const shared_ptr<const void>& keep, const void* values,
+                             int64_t n_buffers, vector<ArrowArray> children = {}, int64_t offset = 0)
+{
+  auto* node = new ArrowArrayNode{keep, {nullptr, values}, move(children), {}};
+  for (ArrowArray& c : node->children) node->child_ptrs.push_back(&c);
+
+  ArrowArray a{};
+  a.length     = length;
+  a.offset     = offset;
+  a.n_buffers  = n_buffers;
+  a.n_children = static_cast<int64_t>(node->children.size());
+  a.buffers    = node->buffers;
+  a.children   = node->child_ptrs.empty() ? nullptr : node->child_ptrs.data();
+  a.release    = release_array;
+  a.private_data = node;
+  return a;
+}
+
+static ArrowSchema make_schema(string format, string name, vector<ArrowSchema> children = {})
+{
+  auto* node = new ArrowSchemaNode{move(format), move(name), move(children), {}};
+  for (ArrowSchema& c : node->children) node->child_ptrs.push_back(&c);
+
+  ArrowSchema s{};
+  s.format     = node->format.c_str();
+  s.name       = node->name.c_str();
+  s.n_children = static_cast<int64_t>(node->children.size());
+  s.children   = node->child_ptrs.empty() ? nullptr : node->child_ptrs.data();
+  s.release    = release_schema;
+  s.private_data = node;
+  return s;
+}
+
+// Columns of one batch, collected as (array, schema) children of a struct
+class ArrowBatchExport
+{
+public:
+  // Rows [offset, offset + n) of the batch columns passed in
+  ArrowBatchExport(size_t n, shared_ptr<const void> keep, size_t offset = 0)
+  : n_(static_cast<int64_t>(n)), off_(static_cast<int64_t>(offset)), keep_(move(keep)) {}
+
+  ~ArrowBatchExport()
+  {
+    for (ArrowArray& a : arrays_) if (a.release) a.release(&a);
+    for (ArrowSchema& s : schemas_) if (s.release) s.release(&s);
+  }
+
+  ArrowBatchExport(const ArrowBatchExport&) = delete;
+  ArrowBatchExport& operator=(const ArrowBatchExport&) = delete;
+
+  void column(const char* name, const int64_t* p) { if (p) add(make_array(n_, keep_, p, 2, {}, off_), make_schema("l", name)); }
+  void column(const char* name, const uint8_t* p) { if (p) add(make_array(n_, keep_, p, 2, {}, off_), make_schema("C", name)); }
+
+  // list<struct<px, qty>> over n + 1 row offsets into the level arrays
+  void levels(const char* name, const uint32_t* off, const int64_t* px, const int64_t* qty)
+  {
+    if (!off) return;
+    if (off[off_ + n_] > static_cast<uint32_t>(numeric_limits<int32_t>::max()))
+      throw runtime_error("arrow export: more than 2^31 levels in one batch");
+
+    const int64_t levels = off[off_ + n_];
+    vector<ArrowArray> arrays;
+    vector<ArrowSchema> schemas;
+    if (px)  { arrays.push_back(make_array(levels, keep_, px, 2));  schemas.push_back(make_schema("l", "px")); }
+    if (qty) { arrays.push_back(make_array(levels, keep_, qty, 2)); schemas.push_back(make_schema("l", "qty")); }
+
+    vector<ArrowArray> elem;
+    elem.push_back(make_array(levels, keep_, nullptr, 1, move(arrays)));
+    vector<ArrowSchema> elem_s;
+    elem_s.push_back(make_schema("+s", "element", move(schemas)));
+
+    add(make_array(n_, keep_, off, 2, move(elem), off_), make_schema("+l", name, move(elem_s)));  // uint32 offsets < 2^31 read as int32
+  }
+
+  void finish(ArrowArray* out, ArrowSchema* schema)
+  {
+    *out    = make_array(n_, keep_, nullptr, 1, move(arrays_));
+    *schema = make_schema("+s", "", move(schemas_));
+    arrays_.clear();
+    schemas_.clear();
+  }
+
+private:
+  void add(ArrowArray a, ArrowSchema s)
+  {
+    arrays_.push_back(a);
+    schemas_.push_back(s);
+  }
+
+  int64_t n_;
+  int64_t off_;
+  shared_ptr<const void> keep_;
+  vector<ArrowArray> arrays_;
+  vector<ArrowSchema> schemas_;
+};
+
+// ======== ShardedDB (PIMPL) ========
+
+struct ShardedDB::Impl
+{
+  string root_;
+  optional<string> sampling_;
+  PipelineOptions pipeline_;
+  BatchOptions batch_;
+  IoOptions io_;
+  shared_ptr<FileHandleCache> file_cache_ = make_shared<FileHandleCache>(64);
+  bool use_manifest_ = true;
+  mutable ManifestCache manifests_;
+  optional<ReadAheadOptions> readahead_opt_;
+  mutable mutex readahead_m_;
+  mutable shared_ptr<ReadAhead> readahead_;  // started by the first reader that needs it
+
+  Impl(string root, optional<string> sampling)
+  : root_(move(root)), sampling_(move(sampling)) {}
+
+  FileOpener opener() const
+  {
+    lock_guard<mutex> lk(readahead_m_);
+    const ReadAheadOptions ra = readahead_opt_.value_or(ReadAheadOptions{g_prefetch});
+    if (!ra.enabled || ra.files_ahead == 0) return FileOpener{io_, file_cache_, nullptr};
+    if (!readahead_) readahead_ = make_shared<ReadAhead>(ra, file_cache_);
+    return FileOpener{io_, file_cache_, readahead_};
+  }
+
+  unique_ptr<TopBatchReader>   get_top  (int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const;
+  unique_ptr<TradeBatchReader> get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel,
+                                         vector<Candidate>* files_out = nullptr) const;  // files_out: copy of the candidates
+  unique_ptr<DeltaBatchReader> get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const;
+};
+
+// Shared driver of the three batch readers: walks files_ either sequentially on
+// the caller's thread or through a RowGroupPipeline, one filtered row group per batch.
+template <class Streamer, class Select, class Buf>
+struct BatchReaderCore
+{
+  vector<Candidate> files_;
+  size_t file_idx_ = 0;
+  size_t ra_next_ = 0;
+  unique_ptr<Streamer> fs_;
+  int64_t start_ns_;
+  int64_t end_ns_;
+  Select sel_;
+  PipelineOptions pipe_opt_;
+  FileOpener open_;
+  unique_ptr<RowGroupPipeline<Streamer, Select, Buf>> pipe_;
+  ReaderCounters counters_;
+  bool strict_ = false;     // open/read failures throw instead of skipping the file (checkpoint replay)
+
+  // current batch (lifetime until next() is called again)
+  Buf buf_;
+  BatchOptions batch_opt_;
+  Buf acc_;                 // coalesced row groups (target_rows)
+  Buf* owner_ = &buf_;      // buffer the current batch was decoded or coalesced into
+  const Buf* src_ = &buf_;  // where its columns are now (owner_ or the export holder)
+  size_t slice_b_ = 0;      // current batch = rows [slice_b_, slice_b_ + slice_n_) of *src_
+  size_t slice_n_ = 0;
+  bool has_batch_ = false;
+  shared_ptr<Buf> shared_;  // the current batch's columns once exported (see share_batch)
+
+  BatchReaderCore(const char* kind, vector<Candidate> files, int64_t s, int64_t e, Select sel, PipelineOptions pipe,
+                  BatchOptions batch, FileOpener open)
+  : files_(move(files)), start_ns_(s), end_ns_(e), sel_(sel), pipe_opt_(pipe), open_(move(open)), batch_opt_(batch)
+  {
+    if (g_debug) {
+      cerr << "[debug] " << kind << ": " << files_.size() << " candidate files\n";
+      for (const auto& c : files_) {
+        cerr << "  - " << c.path << " [" << iso_from_ns(c.file_start_ns)
+             << " .. " << iso_from_ns(c.file_end_ns) << ")\n";
+      }
+      if (pipe_opt_.threads > 0) {
+        cerr << "[debug] " << kind << ": pipeline threads=" << pipe_opt_.threads
+             << " depth=" << pipe_opt_.depth << " max_bytes=" << pipe_opt_.max_bytes << "\n";
+      }
+      if (batch_opt_.target_rows || batch_opt_.max_rows) {
+        cerr << "[debug] " << kind << ": batch target_rows=" << batch_opt_.target_rows
+             << " max_rows=" << batch_opt_.max_rows << "\n";
+      }
+    }
+  }
+
+  // Swap the decoded columns of a and b; the scratch arena and file name stay
+  static void swap_columns(Buf& a, Buf& b)
+  {
+    swap(a, b);
+    swap(a.scratch, b.scratch);
+    swap(a.file, b.file);
+  }
+
+  // Move (not copy) the current batch's columns into a holder that exports keep
+  // alive past next(); views handed out by next() keep pointing into it
+  shared_ptr<const Buf> share_batch()
+  {
+    if (!shared_)
+    {
+      shared_ = make_shared<Buf>();
+      swap_columns(*shared_, *owner_);
+      shared_->file = owner_->file;
+      src_ = shared_.get();
+    }
+    return shared_;
+  }
+
+  // Drop the reader's reference; if every export is released already, take
+  // the columns back so their capacity is reused
+  void unshare_batch()
+  {
+    if (!shared_) return;
+    if (shared_.use_count() == 1) swap_columns(*shared_, *owner_);
+    shared_.reset();
+    src_ = owner_;
+  }
+
+  // Advance to the next batch: the next slice of the current buffer, else the
+  // next row group, coalesced with the following ones up to target_rows
+  bool next_batch()
+  {
+    has_batch_ = false;
+    const size_t max_rows = batch_opt_.max_rows;
+
+    if (slice_b_ + slice_n_ < src_->ts.size())
+    {
+      slice_b_ += slice_n_;
+      slice_n_ = max_rows ? min(max_rows, src_->ts.size() - slice_b_) : src_->ts.size() - slice_b_;
+      return count_batch();
+    }
+
+    unshare_batch();
+    slice_b_ = slice_n_ = 0;
+    src_ = owner_ = &buf_;
+    if (!next_buf()) return false;
+
+    if (batch_opt_.target_rows && buf_.ts.size() < batch_opt_.target_rows)
+    {
+      swap_columns(acc_, buf_);
+      acc_.file = buf_.file;  // a coalesced batch reports the file of its first row group
+      src_ = owner_ = &acc_;
+      while (acc_.ts.size() < batch_opt_.target_rows && next_buf()) append_rows(acc_, buf_);
+    }
+
+    slice_n_ = max_rows ? min(max_rows, src_->ts.size()) : src_->ts.size();
+    return count_batch();
+  }
+
+  // View over the current batch's rows
+  template <class View>
+  void batch_view(View& out) const
+  {
+    fill_view(*src_, sel_, out);
+    if (slice_b_ > 0 || slice_n_ < out.n) out = slice_view(out, slice_b_, slice_n_);
+  }
+
+  // Fill buf_ with the next non-empty filtered row group
+  bool next_buf()
+  {
+    if (pipe_opt_.threads > 0)
+    {
+      if (!pipe_) pipe_ = make_unique<RowGroupPipeline<Streamer, Select, Buf>>(files_, start_ns_, end_ns_, sel_, pipe_opt_, open_, counters_);
+      return pipe_->pop(buf_);
+    }
+
+    while (true)
+    {
+      if (!fs_)
+      {
+        if (file_idx_ >= files_.size()) return false;
+
+        read_ahead<Streamer>(open_, files_, file_idx_ + 1, ra_next_, start_ns_, end_ns_, sel_);
+
+        try
+        {
+          fs_ = open_streamer<Streamer>(files_[file_idx_].path, open_, start_ns_, end_ns_, sel_);
+          buf_.file = fs::path(files_[file_idx_].path).filename().string();
+          counters_.files_opened.fetch_add(1, memory_order_relaxed);
+        }
+        catch (const exception& e)
+        {
+          if (strict_) throw runtime_error("open failed: " + files_[file_idx_].path + " : " + e.what());
+          cerr << "WARN: open failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
+          ++file_idx_;
+          continue;
+        }
+      }
+
+      bool ok = false;
+
+      try
+      {
+        ok = next_rg(*fs_, start_ns_, end_ns_, sel_, buf_, counters_);
+      }
+      catch (const exception& e)
+      {
+        if (strict_) throw runtime_error("read failed: " + files_[file_idx_].path + " : " + e.what());
+        cerr << "WARN: read failed: " << files_[file_idx_].path << " : " << e.what() << "\n";
+        ok = false;
+      }
+
+      if (!ok)
+      {
+        fs_.reset();
+        ++file_idx_;
+        continue;
+      }
+
+      if (buf_.ts.empty()) continue;
+      return true;
+    }
+  }
+
+  bool count_batch()
+  {
+    has_batch_ = true;
+    counters_.batches.fetch_add(1, memory_order_relaxed);
+    counters_.rows_emitted.fetch_add(slice_n_, memory_order_relaxed);
+    return true;
+  }
+};
+
+struct ShardedDB::TopBatchReader::Impl : BatchReaderCore<FileStreamerTopCols, TopSelect, TopBuf>
+{
+  Impl(vector<Candidate> files, int64_t s, int64_t e, TopSelect sel, PipelineOptions pipe, BatchOptions batch, FileOpener open)
+  : BatchReaderCore("top", move(files), s, e, sel, pipe, batch, move(open)) {}
+
+  bool next(TopColsView& out)
+  {
+    if (!next_batch()) return false;
+    batch_view(out);
+    return true;
+  }
+
+  bool export_arrow(ArrowArray* out, ArrowSchema* schema)
+  {
+    if (!has_batch_) return false;
+    auto keep = share_batch();
+    TopColsView v;
+    fill_view(*keep, sel_, v);
+
+    using F = FileStreamerTopCols;
+    ArrowBatchExport x(slice_n_, keep, slice_b_);
+    x.column(F::COL_NAMES[F::TS],         v.ts);
+    x.column(F::COL_NAMES[F::ASK_PX],     v.ask_px);
+    x.column(F::COL_NAMES[F::ASK_QTY],    v.ask_qty);
+    x.column(F::COL_NAMES[F::BID_PX],     v.bid_px);
+    x.column(F::COL_NAMES[F::BID_QTY],    v.bid_qty);
+    x.column(F::COL_NAMES[F::VALU],       v.valu);
+    x.column(F::COL_NAMES[F::MIN_BID_PX], v.min_bid_px);
+    x.column(F::COL_NAMES[F::MAX_BID_PX], v.max_bid_px);
+    x.column(F::COL_NAMES[F::MIN_ASK_PX], v.min_ask_px);
+    x.column(F::COL_NAMES[F::MAX_ASK_PX], v.max_ask_px);
+    x.column(F::COL_NAMES[F::MIN_BID_TS], v.min_bid_ts);
+    x.column(F::COL_NAMES[F::MAX_BID_TS], v.max_bid_ts);
+    x.column(F::COL_NAMES[F::MIN_ASK_TS], v.min_ask_ts);
+    x.column(F::COL_NAMES[F::MAX_ASK_TS], v.max_ask_ts);
+    x.finish(out, schema);
+    return true;
+  }
+};
+
+struct ShardedDB::TradeBatchReader::Impl : BatchReaderCore<FileStreamerTradeCols, TradeSelect, TradeBuf>
+{
+  Impl(vector<Candidate> files, int64_t s, int64_t e, TradeSelect sel, PipelineOptions pipe, BatchOptions batch, FileOpener open)
+  : BatchReaderCore("trade", move(files), s, e, sel, pipe, batch, move(open)) {}
+
+  bool next(TradeColsView& out)
+  {
+    if (!next_batch()) return false;
+    batch_view(out);
+    return true;
+  }
+
+  bool export_arrow(ArrowArray* out, ArrowSchema* schema)
+  {
+    if (!has_batch_) return false;
+    auto keep = share_batch();
+    TradeColsView v;
+    fill_view(*keep, sel_, v);
+
+    using F = FileStreamerTradeCols;
+    ArrowBatchExport x(slice_n_, keep, slice_b_);
+    x.column(F::COL_NAMES[F::TS],              v.ts);
+    x.column(F::COL_NAMES[F::PX],              v.px);
+    x.column(F::COL_NAMES[F::QTY],             v.qty);
+    x.column(F::COL_NAMES[F::TRADE_ID],        v.tradeId);
+    x.column(F::COL_NAMES[F::BUYER_ORDER_ID],  v.buyerOrderId);
+    x.column(F::COL_NAMES[F::SELLER_ORDER_ID], v.sellerOrderId);
+    x.column(F::COL_NAMES[F::TRADE_TIME],      v.tradeTime);
+    x.column(F::COL_NAMES[F::IS_MARKET],       v.isMarket);
+    x.column(F::COL_NAMES[F::EVENT_TIME],      v.eventTime);
+    x.finish(out, schema);
+    return true;
+  }
+};
+
+struct ShardedDB::DeltaBatchReader::Impl : BatchReaderCore<FileStreamerDeltaCols, DeltaSelect, DeltaBuf>
+{
+  Impl(vector<Candidate> files, int64_t s, int64_t e, DeltaSelect sel, PipelineOptions pipe, BatchOptions batch, FileOpener open)
+  : BatchReaderCore("depth", move(files), s, e, sel, pipe, batch, move(open)) {}
+
+  bool next(DeltaColsView& out)
+  {
+    if (!next_batch()) return false;
+    batch_view(out);
+    return true;
+  }
+
+  bool export_arrow(ArrowArray* out, ArrowSchema* schema)
+  {
+    if (!has_batch_) return false;
+    auto keep = share_batch();
+    DeltaColsView v;
+    fill_view(*keep, sel_, v);
+
+    ArrowBatchExport x(slice_n_, keep, slice_b_);
+    x.column("ts",        v.ts);
+    x.column("firstId",   v.firstId);
+    x.column("lastId",    v.lastId);
+    x.column("eventTime", v.eventTime);
+    x.levels("ask", v.ask_off, v.ask_px, v.ask_qty);
+    x.levels("bid", v.bid_off, v.bid_px, v.bid_qty);
+    x.finish(out, schema);
+    return true;
+  }
+};
+
+// ---- K-way merge over batch readers (zero-copy slices, see slice_view)
+
+struct ShardedDB::MergedReader::Impl
+{
+  struct Stream
+  {
+    StreamKind kind = StreamKind::Top;
+    unique_ptr<TopBatchReader>   top;
+    unique_ptr<TradeBatchReader> trade;
+    unique_ptr<DeltaBatchReader> depth;
+    TopColsView   top_v{};
+    TradeColsView trade_v{};
+    DeltaColsView depth_v{};
+    const int64_t* ts = nullptr;
+    size_t pos = 0;
+    size_t n = 0;
+  };
+
+  vector<Stream> streams_;
+  // min-heap of (head ts, stream index)
+  priority_queue<pair<int64_t, size_t>, vector<pair<int64_t, size_t>>, greater<>> heap_;
+  bool primed_ = false;
+  optional<size_t> pending_;  // stream of the last slice; refilled on the next call
+
+  // Advance stream i to its next non-empty batch
+  bool fill(size_t i)
+  {
+    Stream& st = streams_[i];
+    bool ok = false;
+    switch (st.kind)
+    {
+      case StreamKind::Top:   ok = st.top->next(st.top_v);     st.ts = st.top_v.ts;   st.n = st.top_v.n;   break;
+      case StreamKind::Trade: ok = st.trade->next(st.trade_v); st.ts = st.trade_v.ts; st.n = st.trade_v.n; break;
+      case StreamKind::Depth: ok = st.depth->next(st.depth_v); st.ts = st.depth_v.ts; st.n = st.depth_v.n; break;
+    }
+    st.pos = 0;
+    if (!ok) st.n = 0;
+    return ok && st.n > 0;
+  }
+
+  bool next(MergedSlice& out)
+  {
+    if (!primed_)
+    {
+      primed_ = true;
+      for (size_t i = 0; i < streams_.size(); ++i)
+        if (fill(i)) heap_.emplace(streams_[i].ts[0], i);
+    }
+
+    if (pending_)
+    {
+      const size_t i = *pending_;
+      pending_.reset();
+      Stream& st = streams_[i];
+      if (st.pos < st.n || fill(i)) heap_.emplace(st.ts[st.pos], i);
+    }
+
+    if (heap_.empty()) return false;
+    const size_t i = heap_.top().second;
+    heap_.pop();
+
+    // Take rows of stream i up to the head of the next stream (ties: lower index first)
+    Stream& st = streams_[i];
+    size_t end = st.n;
+    if (!heap_.empty())
+    {
+      const auto [bound, j] = heap_.top();
+      end = st.pos + 1;
+      while (end < st.n && (st.ts[end] < bound || (st.ts[end] == bound && i < j))) ++end;
+    }
+
+    out.stream = i;
+    out.kind   = st.kind;
+    out.n      = end - st.pos;
+    switch (st.kind)
+    {
+      case StreamKind::Top:   out.top   = slice_view(st.top_v,   st.pos, out.n); break;
+      case StreamKind::Trade: out.trade = slice_view(st.trade_v, st.pos, out.n); break;
+      case StreamKind::Depth: out.depth = slice_view(st.depth_v, st.pos, out.n); break;
+    }
+
+    st.pos   = end;
+    pending_ = i;
+    return true;
+  }
+
+  ReaderStats stats() const
+  {
+    ReaderStats sum;
+    for (const Stream& st : streams_)
+    {
+      ReaderStats x = st.kind == StreamKind::Top ? st.top->stats()
+                    : st.kind == StreamKind::Trade ? st.trade->stats() : st.depth->stats();
+      sum.files_opened       += x.files_opened;
+      sum.row_groups_skipped += x.row_groups_skipped;
+      sum.row_groups_decoded += x.row_groups_decoded;
+      sum.rows_decoded       += x.rows_decoded;
+      sum.rows_emitted       += x.rows_emitted;
+      sum.batches            += x.batches;
+      sum.scratch_allocs     += x.scratch_allocs;
+    }
+    return sum;
+  }
+};
+
+// ---- ShardedDB methods
+
+ShardedDB::ShardedDB(std::string root, std::optional<std::string> sampling)
+: impl_(make_unique<Impl>(move(root), move(sampling))) {}
+
+ShardedDB::~ShardedDB() = default;
+ShardedDB::ShardedDB(ShardedDB&&) noexcept = default;
+ShardedDB& ShardedDB::operator=(ShardedDB&&) noexcept = default;
+
+void ShardedDB::set_pipeline(PipelineOptions opt) { impl_->pipeline_ = opt; }
+void ShardedDB::set_batch(BatchOptions opt) { impl_->batch_ = opt; }
+
+void ShardedDB::set_use_manifest(bool enabled) { impl_->use_manifest_ = enabled; }
+
+size_t ShardedDB::update_manifest(const string& kind, const string& market, const string& symb)
+{
+  auto nm = norm_market(market);
+  if (!nm) throw runtime_error("market must be 'fut' or 'spot'");
+  return update_manifest_dir(shard_dir(impl_->root_, kind, *nm, symb));
+}
+
+void ShardedDB::set_readahead(ReadAheadOptions opt)
+{
+  lock_guard<mutex> lk(impl_->readahead_m_);
+  impl_->readahead_opt_ = opt;
+  impl_->readahead_.reset();  // readers already running keep the previous service
+}
+
+void ShardedDB::set_file_cache(size_t capacity) { impl_->file_cache_->set_capacity(capacity); }
+FileCacheStats ShardedDB::file_cache_stats() const { return impl_->file_cache_->stats(); }
+
+void ShardedDB::set_io(IoOptions opt)
+{
+#if !PQ_HAVE_URING
+  if (opt.backend == IoBackend::Uring)
+    cerr << "WARN: io_uring backend not built in (compile with -DPQ_WITH_URING -luring), using pread\n";
+#endif
+  impl_->io_ = opt;
+}
+
+ShardedDB::TopBatchReader::TopBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TopBatchReader::TopBatchReader(TopBatchReader&&) noexcept = default;
+ShardedDB::TopBatchReader& ShardedDB::TopBatchReader::operator=(TopBatchReader&&) noexcept = default;
+ShardedDB::TopBatchReader::~TopBatchReader() = default;
+bool ShardedDB::TopBatchReader::next(TopColsView& out) { return impl_->next(out); }
+ReaderStats ShardedDB::TopBatchReader::stats() const { return impl_->counters_.snapshot(); }
+bool ShardedDB::TopBatchReader::export_arrow(ArrowArray* out, ArrowSchema* schema) { return impl_->export_arrow(out, schema); }
+
+ShardedDB::TradeBatchReader::TradeBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TradeBatchReader::TradeBatchReader(TradeBatchReader&&) noexcept = default;
+ShardedDB::TradeBatchReader& ShardedDB::TradeBatchReader::operator=(TradeBatchReader&&) noexcept = default;
+ShardedDB::TradeBatchReader::~TradeBatchReader() = default;
+bool ShardedDB::TradeBatchReader::next(TradeColsView& out) { return impl_->next(out); }
+ReaderStats ShardedDB::TradeBatchReader::stats() const { return impl_->counters_.snapshot(); }
+bool ShardedDB::TradeBatchReader::export_arrow(ArrowArray* out, ArrowSchema* schema) { return impl_->export_arrow(out, schema); }
+
+ShardedDB::DeltaBatchReader::DeltaBatchReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::DeltaBatchReader::DeltaBatchReader(DeltaBatchReader&&) noexcept = default;
+ShardedDB::DeltaBatchReader& ShardedDB::DeltaBatchReader::operator=(DeltaBatchReader&&) noexcept = default;
+ShardedDB::DeltaBatchReader::~DeltaBatchReader() = default;
+bool ShardedDB::DeltaBatchReader::next(DeltaColsView& out) { return impl_->next(out); }
+ReaderStats ShardedDB::DeltaBatchReader::stats() const { return impl_->counters_.snapshot(); }
+bool ShardedDB::DeltaBatchReader::export_arrow(ArrowArray* out, ArrowSchema* schema) { return impl_->export_arrow(out, schema); }
+
+ShardedDB::MergedReader::MergedReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::MergedReader::MergedReader(MergedReader&&) noexcept = default;
+ShardedDB::MergedReader& ShardedDB::MergedReader::operator=(MergedReader&&) noexcept = default;
+ShardedDB::MergedReader::~MergedReader() = default;
+bool ShardedDB::MergedReader::next(MergedSlice& out) { return impl_->next(out); }
+ReaderStats ShardedDB::MergedReader::stats() const { return impl_->stats(); }
+
+// Market-aware
+unique_ptr<ShardedDB::TopBatchReader> ShardedDB::Impl::get_top(int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const
+{
+  auto files = candidate_files_strict(root_, symb, sampling_ ? "top_" + *sampling_ : "top", market, s, e, use_manifest_ ? &manifests_ : nullptr);
+  auto impl = make_unique<TopBatchReader::Impl>(move(files), s, e, sel, pipeline_, batch_, opener());
+  return make_unique<TopBatchReader>(move(impl));
+}
+unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::Impl::get_trade(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel,
+                                                                    vector<Candidate>* files_out) const
+{
+  auto files = candidate_files_strict(root_, symb, "trade", market, s, e, use_manifest_ ? &manifests_ : nullptr);
+  if (files_out) *files_out = files;
+  auto impl = make_unique<TradeBatchReader::Impl>(move(files), s, e, sel, pipeline_, batch_, opener());
+  return make_unique<TradeBatchReader>(move(impl));
+}
+unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::Impl::get_depth(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const
+{
+  auto files = candidate_files_strict(root_, symb, "depth", market, s, e, use_manifest_ ? &manifests_ : nullptr);
+  auto impl = make_unique<DeltaBatchReader::Impl>(move(files), s, e, sel, pipeline_, batch_, opener());
+  return make_unique<DeltaBatchReader>(move(impl));
+}
+
+// Public API (market-aware)
+unique_ptr<ShardedDB::TopBatchReader>
+ShardedDB::get_top_cols(int64_t s, int64_t e, const string& symb, optional<string> market, TopSelect sel) const
+{
+  return impl_->get_top(s, e, symb, move(market), sel);
+}
+unique_ptr<ShardedDB::TradeBatchReader>
+ShardedDB::get_trade_cols(int64_t s, int64_t e, const string& symb, optional<string> market, TradeSelect sel) const
+{
+  return impl_->get_trade(s, e, symb, move(market), sel);
+}
+unique_ptr<ShardedDB::DeltaBatchReader>
+ShardedDB::get_depth_cols(int64_t s, int64_t e, const string& symb, optional<string> market, DeltaSelect sel) const
+{
+  return impl_->get_depth(s, e, symb, move(market), sel);
+}
+
+// Backward compatible (search both markets)
+unique_ptr<ShardedDB::TopBatchReader>   ShardedDB::get_top_cols  (int64_t s, int64_t e, const string& symb, TopSelect sel) const   { return impl_->get_top(s, e, symb, nullopt, sel); }
+unique_ptr<ShardedDB::TradeBatchReader> ShardedDB::get_trade_cols(int64_t s, int64_t e, const string& symb, TradeSelect sel) const { return impl_->get_trade(s, e, symb, nullopt, sel); }
+unique_ptr<ShardedDB::DeltaBatchReader> ShardedDB::get_depth_cols(int64_t s, int64_t e, const string& symb, DeltaSelect sel) const { return impl_->get_depth(s, e, symb, nullopt, sel); }
+
+unique_ptr<ShardedDB::MergedReader>
+ShardedDB::get_merged(int64_t s, int64_t e, const vector<StreamSpec>& specs) const
+{
+  auto impl = make_unique<MergedReader::Impl>();
+  impl->streams_.resize(specs.size());
+  for (size_t i = 0; i < specs.size(); ++i)
+  {
+    const StreamSpec& sp = specs[i];
+    auto& st = impl->streams_[i];
+    st.kind = sp.kind;
+    switch (sp.kind)
+    {
+      case StreamKind::Top:   { TopSelect   sel = sp.top;   sel.ts = true; st.top   = impl_->get_top  (s, e, sp.symb, sp.market, sel); break; }
+      case StreamKind::Trade: { TradeSelect sel = sp.trade; sel.ts = true; st.trade = impl_->get_trade(s, e, sp.symb, sp.market, sel); break; }
+      case StreamKind::Depth: { DeltaSelect sel = sp.depth; sel.ts = true; st.depth = impl_->get_depth(s, e, sp.symb, sp.market, sel); break; }
+    }
+  }
+  return make_unique<MergedReader>(move(impl));
+}
+
+// ======== Point-in-time top lookup (top_asof) ========
+//
+// Queries are answered in ts order in one pass over the shards. A row group
+// owns the queries in [its ts min, the next row group's ts min), so the footer
+// statistics alone decide which row groups are decoded at all (one without
+// stats is decoded for its bounds, and that decode is kept). Inside a decoded
+// row group the prevailing row of a query is an upper_bound on ts, and the
+// price/qty columns are read only over the rows the queries hit. A day file
+// that holds no query is not opened; its last row group is looked up (walking
+// back over such days, within the lookback) only when a later query precedes
+// the first row of its own day. Row groups and days are taken to follow each
+// other in ts order, as the writers produce them.
+
+struct AsOfGroup
+{
+  shared_ptr<FileStreamerTopCols> fs;
+  int rg = -1;
+  vector<int64_t> ts;  // decoded ts, when the bounds needed it
+};
+
+static void asof_read_ts(const FileStreamerTopCols& fs, parquet::RowGroupReader& rg, int rg_i, vector<int64_t>& ts)
+{
+  ts.resize(static_cast<size_t>(fs.rg_rows(rg_i)));
+  fs.read_i64(rg, rg_i, fs.col(FileStreamerTopCols::TS), 0, static_cast<int64_t>(ts.size()), ts.data());
+}
+
+// Answer queries order[q0, q1) (ts sorted, none before the row group's ts min) from g
+static void asof_resolve(AsOfGroup& g, span<const int64_t> query_ts, const vector<size_t>& order,
+                         size_t q0, size_t q1, int64_t lookback_ns, vector<TopAsOf>& out)
+{
+  using F = FileStreamerTopCols;
+  const F& fs = *g.fs;
+  for (int c : {F::ASK_PX, F::ASK_QTY, F::BID_PX, F::BID_QTY})
+    if (fs.col(c) < 0) throw runtime_error(string("top_asof: missing ") + F::COL_NAMES[c]);
+
+  shared_ptr<parquet::RowGroupReader> rg = fs.reader->RowGroup(g.rg);
+  if (g.ts.empty()) asof_read_ts(fs, *rg, g.rg, g.ts);
+  const vector<int64_t>& ts = g.ts;
+
+  // Rows by ts (file order on ties) when the row group is not sorted
+  vector<size_t> by_ts;
+  vector<int64_t> ts_sorted;
+  const bool sorted = is_sorted(ts.begin(), ts.end());
+  if (!sorted)
+  {
+    by_ts.resize(ts.size());
+    iota(by_ts.begin(), by_ts.end(), size_t{0});
+    stable_sort(by_ts.begin(), by_ts.end(), [&](size_t a, size_t b) { return ts[a] < ts[b]; });
+    ts_sorted.resize(ts.size());
+    for (size_t i = 0; i < ts.size(); ++i) ts_sorted[i] = ts[by_ts[i]];
+  }
+  const vector<int64_t>& key = sorted ? ts : ts_sorted;
+
+  // Row of each query (SIZE_MAX: none within the lookback)
+  vector<size_t> row(q1 - q0, SIZE_MAX);
+  size_t lo = SIZE_MAX, hi = 0;
+  for (size_t k = 0; k < row.size(); ++k)
+  {
+    const int64_t q = query_ts[order[q0 + k]];
+    const size_t p = static_cast<size_t>(upper_bound(key.begin(), key.end(), q) - key.begin());
+    if (p == 0) continue;
+    const size_t r = sorted ? p - 1 : by_ts[p - 1];
+    if (q - ts[r] > lookback_ns) continue;
+    row[k] = r;
+    lo = min(lo, r);
+    hi = max(hi, r);
+  }
+  if (lo == SIZE_MAX) return;
+
+  const int64_t first = static_cast<int64_t>(lo), count = static_cast<int64_t>(hi - lo + 1);
+  vector<int64_t> apx(hi - lo + 1), aq(apx.size()), bpx(apx.size()), bq(apx.size());
+  fs.read_i64(*rg, g.rg, fs.col(F::ASK_PX),  first, count, apx.data());
+  fs.read_i64(*rg, g.rg, fs.col(F::ASK_QTY), first, count, aq.data());
+  fs.read_i64(*rg, g.rg, fs.col(F::BID_PX),  first, count, bpx.data());
+  fs.read_i64(*rg, g.rg, fs.col(F::BID_QTY), first, count, bq.data());
+
+  for (size_t k = 0; k < row.size(); ++k)
+  {
+    if (row[k] == SIZE_MAX) continue;
+    const size_t i = row[k] - lo;
+    out[order[q0 + k]] = TopAsOf{true, ts[row[k]], apx[i], aq[i], bpx[i], bq[i]};
+  }
+}
+
+vector<TopAsOf> ShardedDB::top_asof(const string& symb, const string& market,
+                                    span<const int64_t> query_ts, int64_t lookback_ns) const
+{
+  vector<TopAsOf> out(query_ts.size());
+  if (query_ts.empty()) return out;
+  if (lookback_ns < 0) throw runtime_error("top_asof: lookback_ns must be >= 0");
+
+  vector<size_t> order(query_ts.size());
+  iota(order.begin(), order.end(), size_t{0});
+  stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return query_ts[a] < query_ts[b]; });
+
+  constexpr int64_t I64_MIN = numeric_limits<int64_t>::min(), I64_MAX = numeric_limits<int64_t>::max();
+  const int64_t q_lo = query_ts[order.front()], q_hi = query_ts[order.back()];
+  const int64_t s = q_lo < I64_MIN + lookback_ns ? I64_MIN : q_lo - lookback_ns;
+  const int64_t e = q_hi == I64_MAX ? I64_MAX : q_hi + 1;
+
+  const string kind = impl_->sampling_ ? "top_" + *impl_->sampling_ : "top";
+  auto files = candidate_files_strict(impl_->root_, symb, kind, market, s, e,
+                                      impl_->use_manifest_ ? &impl_->manifests_ : nullptr);
+  const FileOpener open = impl_->opener();
+
+  // null (after a WARN) when the shard cannot be opened or has no ts
+  uint64_t opened = 0, decoded = 0, pruned = 0;
+  auto open_file = [&](const Candidate& c) -> shared_ptr<FileStreamerTopCols>
+  {
+    try
+    {
+      auto fs = make_shared<FileStreamerTopCols>(c.path, open);
+      if (fs->col(FileStreamerTopCols::TS) < 0) throw runtime_error("missing ts");
+      ++opened;
+      return fs;
+    }
+    catch (const exception& ex)
+    {
+      cerr << "WARN: open failed: " << c.path << " : " << ex.what() << "\n";
+      return nullptr;
+    }
+  };
+
+  size_t qi = 0;             // next unanswered query of order
+  optional<AsOfGroup> prev;  // last row group of files[0, prev_upto); owns the queries before the next one's ts min
+  size_t prev_upto = 0;
+
+  // Bring prev up to files[0, upto): the last row group of the newest skipped
+  // day that has rows and is not older than the lookback of query qi
+  auto refresh_prev = [&](size_t upto)
+  {
+    const int64_t q = query_ts[order[qi]];
+    const int64_t oldest = q < I64_MIN + lookback_ns ? I64_MIN : q - lookback_ns;
+    for (size_t k = upto; k-- > prev_upto; )
+    {
+      auto fs = files[k].file_end_ns > oldest ? open_file(files[k]) : nullptr;
+      if (!fs)
+      {
+        prev.reset();  // too old, or unreadable: nothing known before it
+        break;
+      }
+      for (int g = fs->num_row_groups(); g-- > 0; )
+      {
+        if (fs->rg_rows(g) == 0) continue;
+        prev = AsOfGroup{fs, g, {}};
+        prev_upto = upto;
+        return;
+      }
+    }
+    prev_upto = upto;  // skipped days without rows: prev still holds
+  };
+
+  // Hand the queries before next_min (all if nullopt) to prev, the last row
+  // group before files[upto] or inside it
+  auto close_prev = [&](optional<int64_t> next_min, size_t upto)
+  {
+    size_t q1 = qi;
+    while (q1 < order.size() && (!next_min || query_ts[order[q1]] < *next_min)) ++q1;
+    if (q1 > qi && prev_upto < upto) refresh_prev(upto);
+    if (prev && q1 > qi)
+    {
+      asof_resolve(*prev, query_ts, order, qi, q1, lookback_ns, out);
+      ++decoded;
+    }
+    else if (prev) ++pruned;
+    qi = q1;
+  };
+
+  for (size_t i = 0; i < files.size() && qi < order.size(); ++i)
+  {
+    const Candidate& c = files[i];
+    if (query_ts[order[qi]] >= c.file_end_ns) continue;  // owns no query: not opened
+
+    auto fs = open_file(c);
+    if (!fs)
+    {
+      // its queries stay found = false; later ones cannot see past it either
+      close_prev(c.file_start_ns, i);
+      while (qi < order.size() && query_ts[order[qi]] < c.file_end_ns) ++qi;
+      prev.reset();
+      prev_upto = i + 1;
+      continue;
+    }
+
+    for (int g = 0; g < fs->num_row_groups() && qi < order.size(); ++g)
+    {
+      if (fs->rg_rows(g) == 0) continue;
+      AsOfGroup cur{fs, g, {}};
+      int64_t ts_min;
+      if (auto b = fs->rg_ts_bounds(g)) ts_min = b->first;
+      else
+      {
+        asof_read_ts(*fs, *fs->reader->RowGroup(g), g, cur.ts);
+        ts_min = *min_element(cur.ts.begin(), cur.ts.end());
+      }
+      close_prev(ts_min, i);
+      prev = move(cur);
+      prev_upto = i + 1;
+    }
+  }
+  if (qi < order.size()) close_prev(nullopt, files.size());
+
+  if (g_debug)
+  {
+    cerr << "[debug] top_asof: " << query_ts.size() << " queries, " << files.size() << " candidate files, "
+         << opened << " opened, " << decoded << " row groups decoded, " << pruned << " pruned by ts bounds\n";
+  }
+  return out;
+}
+
+// ======== Trade / top as-of join (join_trades_top) ========
+//
+// The carry is seeded with the top row prevailing just before start_ns (one
+// top_asof lookup), so the top stream starts at start_ns rather than a whole
+// lookback earlier; lookback_ns only marks a carry as too stale to join.
+// Both readers only move forward. For each trade the top cursor advances to
+// the last top row with ts <= trade ts by an upper_bound in the top batch (top
+// rows usually outnumber trades, so most of them are stepped over). An
+// unsorted top batch is walked through a stable ts-order permutation instead:
+// rows later in the batch but earlier in time are not lost, and rows past the
+// trade stay for later trades. The prevailing row is copied out as the carry,
+// so it outlives the top batch it came from; a row older than the carry
+// (batches out of ts order) never replaces it. A trade older than the carry
+// gets no top row.
+
+struct ShardedDB::TradeTopJoinReader::Impl
+{
+  struct Carry
+  {
+    bool have = false;
+    int64_t ts = 0, apx = 0, aq = 0, bpx = 0, bq = 0;
+  };
+
+  unique_ptr<TradeBatchReader> trade_;
+  unique_ptr<TopBatchReader> top_;
+  int64_t lookback_ns_;
+
+  TopColsView top_v_{};
+  size_t top_pos_ = 0;
+  bool top_sorted_ = true;
+  vector<uint32_t> top_perm_;  // ts order of an unsorted top batch
+  bool top_done_ = false;
+  Carry carry_;
+
+  // Top columns of the current joined batch, reused across batches
+  vector<int64_t> ts_, apx_, aq_, bpx_, bq_;
+  vector<uint8_t> has_;
+
+  Impl(unique_ptr<TradeBatchReader> trade, unique_ptr<TopBatchReader> top, int64_t lookback_ns, const TopAsOf& seed)
+  : trade_(move(trade)), top_(move(top)), lookback_ns_(lookback_ns)
+  {
+    if (seed.found) carry_ = Carry{true, seed.ts, seed.ask_px, seed.ask_qty, seed.bid_px, seed.bid_qty};
+  }
+
+  // Move the carry to the last top row with ts <= t
+  void advance_top(int64_t t)
+  {
+    while (!top_done_)
+    {
+      if (top_pos_ >= top_v_.n)
+      {
+        if (!top_->next(top_v_)) { top_done_ = true; return; }
+        top_pos_ = 0;
+        top_sorted_ = is_sorted(top_v_.ts, top_v_.ts + top_v_.n);
+        if (!top_sorted_)
+        {
+          const int64_t* ts = top_v_.ts;
+          top_perm_.resize(top_v_.n);
+          iota(top_perm_.begin(), top_perm_.end(), 0u);
+          stable_sort(top_perm_.begin(), top_perm_.end(), [ts](uint32_t a, uint32_t b) { return ts[a] < ts[b]; });
+        }
+        continue;
+      }
+      const auto row = [this](size_t k) -> size_t { return top_sorted_ ? k : top_perm_[k]; };
+      if (top_v_.ts[row(top_pos_)] > t) return;
+
+      size_t end;
+      if (top_sorted_) end = static_cast<size_t>(upper_bound(top_v_.ts + top_pos_ + 1, top_v_.ts + top_v_.n, t) - top_v_.ts);
+      else
+      {
+        const int64_t* ts = top_v_.ts;
+        end = static_cast<size_t>(upper_bound(top_perm_.begin() + top_pos_ + 1, top_perm_.end(), t,
+                                              [ts](int64_t x, uint32_t r) { return x < ts[r]; }) - top_perm_.begin());
+      }
+
+      const size_t r = row(end - 1);
+      if (!carry_.have || top_v_.ts[r] >= carry_.ts)
+        carry_ = Carry{true, top_v_.ts[r], top_v_.ask_px[r], top_v_.ask_qty[r], top_v_.bid_px[r], top_v_.bid_qty[r]};
+      top_pos_ = end;
+      if (end < top_v_.n) return;
+    }
+  }
+
+  bool next(TradeTopJoinView& out)
+  {
+    TradeColsView v;
+    do
+    {
+      if (!trade_->next(v)) return false;
+    } while (v.n == 0);
+
+    const size_t n = v.n;
+    ts_.resize(n);
+    apx_.resize(n);
+    aq_.resize(n);
+    bpx_.resize(n);
+    bq_.resize(n);
+    has_.resize(n);
+
+    for (size_t i = 0; i < n; ++i)
+    {
+      const int64_t t = v.ts[i];
+      advance_top(t);
+      const bool ok = carry_.have && carry_.ts <= t && t - carry_.ts <= lookback_ns_;
+      ts_[i]  = ok ? carry_.ts  : 0;
+      apx_[i] = ok ? carry_.apx : 0;
+      aq_[i]  = ok ? carry_.aq  : 0;
+      bpx_[i] = ok ? carry_.bpx : 0;
+      bq_[i]  = ok ? carry_.bq  : 0;
+      has_[i] = ok;
+    }
+
+    out = TradeTopJoinView{v, ts_.data(), apx_.data(), aq_.data(), bpx_.data(), bq_.data(), has_.data(), n};
+    return true;
+  }
+
+  ReaderStats stats() const
+  {
+    ReaderStats sum = trade_->stats();
+    ReaderStats x = top_->stats();
+    sum.files_opened       += x.files_opened;
+    sum.row_groups_skipped += x.row_groups_skipped;
+    sum.row_groups_decoded += x.row_groups_decoded;
+    sum.rows_decoded       += x.rows_decoded;
+    sum.rows_emitted       += x.rows_emitted;
+    sum.batches            += x.batches;
+    sum.scratch_allocs     += x.scratch_allocs;
+    return sum;
+  }
+};
+
+ShardedDB::TradeTopJoinReader::TradeTopJoinReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TradeTopJoinReader::TradeTopJoinReader(TradeTopJoinReader&&) noexcept = default;
+ShardedDB::TradeTopJoinReader& ShardedDB::TradeTopJoinReader::operator=(TradeTopJoinReader&&) noexcept = default;
+ShardedDB::TradeTopJoinReader::~TradeTopJoinReader() = default;
+bool ShardedDB::TradeTopJoinReader::next(TradeTopJoinView& out) { return impl_->next(out); }
+ReaderStats ShardedDB::TradeTopJoinReader::stats() const { return impl_->stats(); }
+
+unique_ptr<ShardedDB::TradeTopJoinReader>
+ShardedDB::join_trades_top(int64_t s, int64_t e, const string& symb, const string& market, TradeSelect sel, int64_t lookback_ns) const
+{
+  if (lookback_ns < 0) throw runtime_error("join_trades_top: lookback_ns must be >= 0");
+  sel.ts = true;
+
+  TopSelect top_sel;
+  top_sel.valu = false;
+
+  // Top row in effect before s: the last one with ts < s
+  TopAsOf seed;
+  if (s > numeric_limits<int64_t>::min() && s < e)
+  {
+    const int64_t q = s - 1;
+    seed = top_asof(symb, market, span<const int64_t>(&q, 1), lookback_ns)[0];
+  }
+
+  auto trade = impl_->get_trade(s, e, symb, market, sel);
+  auto top   = impl_->get_top(s, e, symb, market, top_sel);
+  return make_unique<TradeTopJoinReader>(make_unique<TradeTopJoinReader::Impl>(move(trade), move(top), lookback_ns, seed));
+}
+
+// ======== Trade bars (aggregate_trades) ========
+//
+// Batches are cut into runs of one bucket by binary search on ts (an unsorted
+// batch is first gathered through a stable ts-order permutation) and each run
+// is reduced by a branch-free kernel in one pass over blocks of four rows:
+// high/low, volume, isMarket volume (qty masked by the isMarket byte) and the
+// notional spread over four accumulators. Runs fold into a bucket -> bar map,
+// with open/close taken from the earliest/latest-ts trade, so interleaved
+// buckets and row groups out of ts order still give one bar per bucket. Every
+// row still to come is in the current batch's file or a later day file, so
+// bars of buckets ending by that file's day start are final and are emitted in
+// bucket order; a trade stamped before its file's day whose bar is already out
+// is dropped with a WARN.
+
+static int64_t bucket_start(int64_t ts, int64_t bucket_ns)
+{
+  const int64_t r = ts % bucket_ns;
+  return r < 0 ? ts - r - bucket_ns : ts - r;
+}
+
+static void reduce_trades(const int64_t* px, const int64_t* qty, const uint8_t* mkt, size_t n, TradeBar& bar)
+{
+  int64_t hi[2] = { bar.high, bar.high };
+  int64_t lo[2] = { bar.low, bar.low };
+  int64_t vol = 0;
+  int64_t vol_mkt = 0;
+  double acc[4] = { 0, 0, 0, 0 };  // acc[l] sums the notional of rows k % 4 == l
+  size_t k = 0;
+
+#if defined(__SSE2__)
+  // One pass over blocks of four rows. volume / isMarket volume are SSE2 adds;
+  // high / low stay scalar cmov chains and the notional scalar cvtsi2sd (an
+  // emulated 64-bit compare and packed int64 -> double are slower than those
+  // below SSE4.2 / AVX-512DQ).
+  const __m128i zero = _mm_setzero_si128();
+  __m128i vv = zero, vm = zero;
+  for (; k + 4 <= n; k += 4)
+  {
+    const __m128i q0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qty + k));
+    const __m128i q1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(qty + k + 2));
+    // isMarket bytes widened to int64 lane masks, all ones where 0
+    uint32_t m4;
+    memcpy(&m4, mkt + k, 4);
+    __m128i z = _mm_cmpeq_epi8(_mm_cvtsi32_si128(static_cast<int>(m4)), zero);
+    z = _mm_unpacklo_epi8(z, z);
+    z = _mm_unpacklo_epi16(z, z);
+    vv = _mm_add_epi64(vv, _mm_add_epi64(q0, q1));
+    vm = _mm_add_epi64(vm, _mm_add_epi64(_mm_andnot_si128(_mm_unpacklo_epi32(z, z), q0),
+                                         _mm_andnot_si128(_mm_unpackhi_epi32(z, z), q1)));
+
+    for (size_t l = 0; l < 4; ++l)
+    {
+      hi[l & 1] = max(hi[l & 1], px[k + l]);
+      lo[l & 1] = min(lo[l & 1], px[k + l]);
+      acc[l] += static_cast<double>(px[k + l]) * static_cast<double>(qty[k + l]);
+    }
+  }
+  uint64_t v[2], m[2];
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(v), vv);
+  _mm_storeu_si128(reinterpret_cast<__m128i*>(m), vm);
+  vol     = static_cast<int64_t>(v[0] + v[1]);
+  vol_mkt = static_cast<int64_t>(m[0] + m[1]);
+#else
+  for (; k + 4 <= n; k += 4)
+    for (size_t l = 0; l < 4; ++l)
+    {
+      hi[l & 1] = max(hi[l & 1], px[k + l]);
+      lo[l & 1] = min(lo[l & 1], px[k + l]);
+      vol     += qty[k + l];
+      vol_mkt += qty[k + l] & -static_cast<int64_t>(mkt[k + l] != 0);
+      acc[l]  += static_cast<double>(px[k + l]) * static_cast<double>(qty[k + l]);
+    }
+#endif
+  for (; k < n; ++k)
+  {
+    hi[0] = max(hi[0], px[k]);
+    lo[0] = min(lo[0], px[k]);
+    vol     += qty[k];
+    vol_mkt += qty[k] & -static_cast<int64_t>(mkt[k] != 0);
+    acc[0]  += static_cast<double>(px[k]) * static_cast<double>(qty[k]);
+  }
+
+  bar.high           = max(hi[0], hi[1]);
+  bar.low            = min(lo[0], lo[1]);
+  bar.volume        += vol;
+  bar.volume_market += vol_mkt;
+  bar.volume_other  += vol - vol_mkt;
+  bar.notional      += (acc[0] + acc[1]) + (acc[2] + acc[3]);
+  bar.trades        += n;
+}
+
+struct ShardedDB::TradeBarReader::Impl
+{
+  // A bar still taking trades; ts of the trades its open / close came from
+  struct Pending
+  {
+    TradeBar bar;
+    int64_t open_ts = 0;
+    int64_t close_ts = 0;
+  };
+
+  unique_ptr<TradeBatchReader> src_;
+  int64_t bucket_ns_;
+  unordered_map<string, int64_t> file_start_;  // candidate basename -> day start
+
+  map<int64_t, Pending> bars_;  // by bucket start
+  int64_t final_below_ = numeric_limits<int64_t>::min();  // no trade before this is still to come
+  bool have_emitted_ = false;
+  int64_t last_emitted_ = 0;
+  uint64_t late_ = 0;
+  bool done_ = false;
+
+  // ts-ordered copy of an unsorted batch
+  vector<uint32_t> perm_;
+  vector<int64_t> sts_, spx_, sqty_;
+  vector<uint8_t> smkt_;
+
+  Impl(unique_ptr<TradeBatchReader> src, int64_t bucket_ns, const vector<Candidate>& files)
+  : src_(move(src)), bucket_ns_(bucket_ns)
+  {
+    for (const auto& c : files) file_start_[fs::path(c.path).filename().string()] = c.file_start_ns;
+  }
+
+  bool is_final(int64_t b0) const
+  {
+    return static_cast<__int128>(b0) + bucket_ns_ <= final_below_;
+  }
+
+  // Fold rows [0, n) of one bucket, in ts order, into its bar
+  void add_run(const int64_t* ts, const int64_t* px, const int64_t* qty, const uint8_t* mkt, size_t n, int64_t b0)
+  {
+    auto [it, fresh] = bars_.try_emplace(b0);
+    Pending& p = it->second;
+    if (fresh)
+    {
+      p.bar.ts   = b0;
+      p.bar.open = p.bar.high = p.bar.low = px[0];
+      p.open_ts  = ts[0];
+    }
+    else if (ts[0] < p.open_ts)
+    {
+      p.bar.open = px[0];
+      p.open_ts  = ts[0];
+    }
+    if (fresh || ts[n - 1] >= p.close_ts)
+    {
+      p.bar.close = px[n - 1];
+      p.close_ts  = ts[n - 1];
+    }
+    reduce_trades(px, qty, mkt, n, p.bar);
+  }
+
+  void add_batch(const TradeColsView& v)
+  {
+    const size_t n = v.n;
+    const int64_t* ts  = v.ts;
+    const int64_t* px  = v.px;
+    const int64_t* qty = v.qty;
+    const uint8_t* mkt = v.isMarket;
+
+    if (!is_sorted(ts, ts + n))
+    {
+      perm_.resize(n);
+      iota(perm_.begin(), perm_.end(), 0u);
+      stable_sort(perm_.begin(), perm_.end(), [ts](uint32_t a, uint32_t b) { return ts[a] < ts[b]; });
+      sts_.resize(n);
+      spx_.resize(n);
+      sqty_.resize(n);
+      smkt_.resize(n);
+      for (size_t k = 0; k < n; ++k)
+      {
+        const uint32_t r = perm_[k];
+        sts_[k]  = ts[r];
+        spx_[k]  = px[r];
+        sqty_[k] = qty[r];
+        smkt_[k] = mkt[r];
+      }
+      ts  = sts_.data();
+      px  = spx_.data();
+      qty = sqty_.data();
+      mkt = smkt_.data();
+    }
+
+    for (size_t i = 0; i < n; )
+    {
+      const int64_t b0 = bucket_start(ts[i], bucket_ns_);
+      const size_t end = static_cast<size_t>(
+        partition_point(ts + i, ts + n, [&](int64_t x) { return bucket_start(x, bucket_ns_) == b0; }) - ts);
+      if (have_emitted_ && b0 <= last_emitted_) late_ += end - i;
+      else add_run(ts + i, px + i, qty + i, mkt + i, end - i, b0);
+      i = end;
+    }
+  }
+
+  bool next(TradeBar& out)
+  {
+    while (true)
+    {
+      if (!bars_.empty() && (done_ || is_final(bars_.begin()->first)))
+      {
+        auto it = bars_.begin();
+        out = it->second.bar;
+        if (out.volume != 0) out.vwap = out.notional / static_cast<double>(out.volume);
+        have_emitted_ = true;
+        last_emitted_ = it->first;
+        bars_.erase(it);
+        return true;
+      }
+      if (done_) return false;
+
+      TradeColsView v;
+      if (!src_->next(v))
+      {
+        done_ = true;
+        if (late_)
+          cerr << "WARN: aggregate_trades: dropped " << late_ << " trades stamped before their file's day "
+               << "(their bars were already emitted)\n";
+        continue;
+      }
+      if (v.n == 0) continue;
+
+      // Rows still to come are in this batch's (first) file or later day files
+      if (v.file)
+      {
+        auto it = file_start_.find(v.file);
+        if (it != file_start_.end()) final_below_ = max(final_below_, it->second);
+      }
+      add_batch(v);
+    }
+  }
+};
+
+ShardedDB::TradeBarReader::TradeBarReader(std::unique_ptr<Impl> impl) : impl_(std::move(impl)) {}
+ShardedDB::TradeBarReader::TradeBarReader(TradeBarReader&&) noexcept = default;
+ShardedDB::TradeBarReader& ShardedDB::TradeBarReader::operator=(TradeBarReader&&) noexcept = default;
+ShardedDB::TradeBarReader::~TradeBarReader() = default;
+bool ShardedDB::TradeBarReader::next(TradeBar& out) { return impl_->next(out); }
+ReaderStats ShardedDB::TradeBarReader::stats() const { return impl_->src_->stats(); }
+
+unique_ptr<ShardedDB::TradeBarReader>
+ShardedDB::aggregate_trades(int64_t s, int64_t e, const string& symb, const string& market, int64_t bucket_ns) const
+{
+  if (bucket_ns <= 0) throw runtime_error("bucket_ns must be > 0");
+
+  TradeSelect sel;
+  sel.ts = sel.px = sel.qty = sel.isMarket = true;
+  sel.tradeId = sel.buyerOrderId = sel.sellerOrderId = sel.tradeTime = sel.eventTime = false;
+
+  vector<Candidate> files;
+  auto src = impl_->get_trade(s, e, symb, market, sel, &files);
+  return make_unique<TradeBarReader>(make_unique<TradeBarReader::Impl>(move(src), bucket_ns, files));
+}
+
+// ======== L2 order book reconstruction (BookBuilder) ========
+
+// One side, ordered worse -> better so the best level is last. A removed level
+// stays as a qty-0 tombstone, so a price that comes back (the common case near
+// the top) is revived in place without shifting the array; tombstones are
+// compacted away once they outnumber the live levels.
+struct BookSide
+{
+  vector<BookLevel> lv;
+  size_t dead = 0;
+
+  size_t live() const { return lv.size() - dead; }
+
+  template <class Better>
+  void apply(int64_t px, int64_t qty, Better better)
+  {
+    auto find = [&] {
+      return lower_bound(lv.begin(), lv.end(), px, [&](const BookLevel& l, int64_t p) { return better(l.px, p); });
+    };
+    auto it = find();
+    if (it != lv.end() && it->px == px)
+    {
+      if (it->qty == 0 && qty != 0) --dead;
+      else if (it->qty != 0 && qty == 0) ++dead;
+      it->qty = qty;
+      return;
+    }
+    if (qty == 0) return;
+
+    if (dead > live() + 256)
+    {
+      lv.erase(remove_if(lv.begin(), lv.end(), [](const BookLevel& l) { return l.qty == 0; }), lv.end());
+      dead = 0;
+      it = find();
+    }
+    lv.insert(it, BookLevel{px, qty});
+  }
+
+  // Up to n live levels, best first
+  void top(size_t n, vector<BookLevel>& out) const
+  {
+    out.clear();
+    for (auto it = lv.rbegin(); it != lv.rend() && out.size() < n; ++it)
+      if (it->qty != 0) out.push_back(*it);
+  }
+
+  void clear()
+  {
+    lv.clear();
+    dead = 0;
+  }
+};
+
+struct BookBuilder::Impl
+{
+  BookOptions opt_;
+  BookSide asks_;  // px descending: best (lowest) ask last
+  BookSide bids_;  // px ascending: best (highest) bid last
+  vector<BookLevel> snap_asks_;
+  vector<BookLevel> snap_bids_;
+
+  DeltaColsView cur_{};
+  size_t row_ = 0;
+
+  int64_t last_id_ = 0;
+  bool have_id_ = false;
+  bool gap_pending_ = false;
+
+  bool have_ts_ = false;
+  int64_t next_emit_ns_ = 0;
+  int64_t last_ts_ = 0;  // ts of the last applied row
+  uint64_t since_emit_ = 0;
+
+  BookStats st_;
+
+  explicit Impl(BookOptions opt) : opt_(opt) {}
+
+  void apply_row(size_t r)
+  {
+    const DeltaColsView& v = cur_;
+    if (opt_.check_ids && v.firstId && v.lastId)
+    {
+      if (have_id_ && v.lastId[r] <= last_id_)
+      {
+        ++st_.stale_rows;
+        return;
+      }
+      if (have_id_ && v.firstId[r] > last_id_ + 1)
+      {
+        ++st_.gaps;
+        gap_pending_ = true;
+      }
+      last_id_ = v.lastId[r];
+      have_id_ = true;
+    }
+    else if (v.lastId)
+    {
+      last_id_ = v.lastId[r];
+    }
+
+    if (v.ask_off && v.ask_px && v.ask_qty)
+    {
+      for (uint32_t k = v.ask_off[r]; k < v.ask_off[r + 1]; ++k)
+        asks_.apply(v.ask_px[k], v.ask_qty[k], greater<int64_t>());
+      st_.level_updates += v.ask_off[r + 1] - v.ask_off[r];
+    }
+    if (v.bid_off && v.bid_px && v.bid_qty)
+    {
+      for (uint32_t k = v.bid_off[r]; k < v.bid_off[r + 1]; ++k)
+        bids_.apply(v.bid_px[k], v.bid_qty[k], less<int64_t>());
+      st_.level_updates += v.bid_off[r + 1] - v.bid_off[r];
+    }
+    ++st_.rows;
+  }
+
+  void fill(BookSnapshot& out, int64_t ts)
+  {
+    asks_.top(opt_.depth, snap_asks_);
+    bids_.top(opt_.depth, snap_bids_);
+
+    out.ts        = ts;
+    out.last_id   = last_id_;
+    out.asks      = snap_asks_.data();
+    out.bids      = snap_bids_.data();
+    out.n_asks    = snap_asks_.size();
+    out.n_bids    = snap_bids_.size();
+    out.after_gap = gap_pending_;
+    gap_pending_  = false;
+    ++st_.snapshots;
+  }
+};
+
+BookBuilder::BookBuilder(BookOptions opt) : impl_(make_unique<Impl>(opt)) {}
+BookBuilder::~BookBuilder() = default;
+BookBuilder::BookBuilder(BookBuilder&&) noexcept = default;
+BookBuilder& BookBuilder::operator=(BookBuilder&&) noexcept = default;
+
+void BookBuilder::feed(const DeltaColsView& v)
+{
+  impl_->cur_ = v;
+  impl_->row_ = 0;
+}
+
+bool BookBuilder::next(BookSnapshot& out)
+{
+  Impl& m = *impl_;
+  const int64_t every_ns = m.opt_.every_ns;
+
+  while (m.row_ < m.cur_.n)
+  {
+    const size_t r = m.row_;
+    const int64_t ts = m.cur_.ts ? m.cur_.ts[r] : 0;
+
+    if (every_ns > 0)
+    {
+      const int64_t step = ts - ts % every_ns;
+      if (!m.have_ts_)
+      {
+        m.have_ts_ = true;
+        m.next_emit_ns_ = step + every_ns;
+      }
+      else if (ts >= m.next_emit_ns_)
+      {
+        // the book as of the last boundary crossed; row r is applied on the next call
+        m.next_emit_ns_ = step + every_ns;
+        m.fill(out, step);
+        return true;
+      }
+    }
+
+    m.apply_row(r);
+    m.last_ts_ = ts;
+    ++m.row_;
+
+    if (m.opt_.every_updates > 0 && ++m.since_emit_ >= m.opt_.every_updates)
+    {
+      m.since_emit_ = 0;
+      m.fill(out, ts);
+      return true;
+    }
+  }
+  return false;
+}
+
+void BookBuilder::snapshot(BookSnapshot& out)
+{
+  impl_->fill(out, impl_->last_ts_);
+}
+
+void BookBuilder::clear()
+{
+  Impl& m = *impl_;
+  m.asks_.clear();
+  m.bids_.clear();
+  m.have_id_ = false;
+  m.gap_pending_ = false;
+}
+
+void BookBuilder::load(const BookCheckpoint& c)
+{
+  Impl& m = *impl_;
+  clear();
+  m.asks_.lv.assign(c.asks.rbegin(), c.asks.rend());
+  m.bids_.lv.assign(c.bids.rbegin(), c.bids.rend());
+  m.last_id_ = c.last_id;
+  m.have_id_ = c.last_id != 0;
+  m.have_ts_ = false;
+  m.last_ts_ = c.ts;
+}
+
+BookStats BookBuilder::stats() const
+{
+  BookStats st = impl_->st_;
+  st.ask_levels = impl_->asks_.live();
+  st.bid_levels = impl_->bids_.live();
+  return st;
+}
+
+// ======== Book checkpoints (<shard>.ckpt sidecars of depth shards) ========
+//
+// Written by update_checkpoints(): the full book at the start of each depth day
+// file and at every every_ns step inside it, carried over from the previous day
+// so a day starts where the one before ended. Layout (native-endian int64s):
+//   "PQCKPT2\n" shard_size shard_mtime every_ns count
+//   count x { ts last_id n_asks n_bids flags }  (index, ts ascending)
+//   per entry (n_asks + n_bids) x { px qty }    (asks then bids, best first)
+// A sidecar whose recorded size/mtime no longer match its shard is ignored.
+// CKPT_AFTER_GAP marks a book whose carried history went through an id gap or
+// a missing day (sticky down the chain); find_checkpoint skips those by default.
+
+static const char CKPT_MAGIC[8] = { 'P', 'Q', 'C', 'K', 'P', 'T', '2', '\n' };
+static constexpr int64_t CKPT_AFTER_GAP = 1;
+
+struct CkptEntry
+{
+  int64_t ts;
+  int64_t last_id;
+  int64_t n_asks;
+  int64_t n_bids;
+  int64_t flags;
+};
+
+struct CkptFile
+{
+  FileStamp stamp;
+  int64_t every_ns = 0;
+  vector<CkptEntry> index;
+};
+
+static string checkpoint_path(const string& shard)
+{
+  return fs::path(shard).replace_extension(".ckpt").string();
+}
+
+// Header + index; leaves `in` at the first level record
+static bool read_ckpt_index(ifstream& in, CkptFile& out)
+{
+  char magic[sizeof CKPT_MAGIC];
+  int64_t head[4];
+  if (!in.read(magic, sizeof magic) || memcmp(magic, CKPT_MAGIC, sizeof magic) != 0) return false;
+  if (!in.read(reinterpret_cast<char*>(head), sizeof head)) return false;
+  if (head[3] < 0 || head[3] > 10'000'000) return false;
+
+  out.stamp    = FileStamp{head[0], head[1]};
+  out.every_ns = head[2];
+  out.index.resize(static_cast<size_t>(head[3]));
+  return static_cast<bool>(in.read(reinterpret_cast<char*>(out.index.data()),
+                                   static_cast<streamsize>(out.index.size() * sizeof(CkptEntry))));
+}
+
+static void save_checkpoints(const string& path, const CkptFile& f, const vector<BookLevel>& levels)
+{
+  const string tmp = path + ".tmp";
+  {
+    ofstream out(tmp, ios::binary | ios::trunc);
+    if (!out) throw runtime_error("checkpoint: cannot write " + tmp);
+    const int64_t head[4] = { f.stamp.size, f.stamp.mtime, f.every_ns, static_cast<int64_t>(f.index.size()) };
+    out.write(CKPT_MAGIC, sizeof CKPT_MAGIC);
+    out.write(reinterpret_cast<const char*>(head), sizeof head);
+    out.write(reinterpret_cast<const char*>(f.index.data()), static_cast<streamsize>(f.index.size() * sizeof(CkptEntry)));
+    out.write(reinterpret_cast<const char*>(levels.data()), static_cast<streamsize>(levels.size() * sizeof(BookLevel)));
+    if (!out) throw runtime_error("checkpoint: write failed " + tmp);
+  }
+  fs::rename(tmp, path);
+}
+
+// Latest checkpoint at or before at_ns of one shard (the latest one without
+// CKPT_AFTER_GAP unless allow_after_gap); false without a current sidecar
+static bool load_checkpoint(const string& shard, int64_t at_ns, BookCheckpoint& out, bool allow_after_gap)
+{
+  ifstream in(checkpoint_path(shard), ios::binary);
+  if (!in) return false;
+
+  CkptFile f;
+  if (!read_ckpt_index(in, f))
+  {
+    cerr << "WARN: ignoring corrupt or old-format checkpoint file " << checkpoint_path(shard) << "\n";
+    return false;
+  }
+  if (!(f.stamp == file_stamp(shard)))
+  {
+    if (g_debug) cerr << "[debug] checkpoint: stale sidecar for " << shard << "\n";
+    return false;
+  }
+
+  auto it = upper_bound(f.index.begin(), f.index.end(), at_ns,
+                        [](int64_t t, const CkptEntry& e) { return t < e.ts; });
+  if (!allow_after_gap)
+    while (it != f.index.begin() && (prev(it)->flags & CKPT_AFTER_GAP)) --it;
+  if (it == f.index.begin()) return false;
+  --it;
+
+  int64_t skip = 0;
+  for (auto p = f.index.begin(); p != it; ++p) skip += p->n_asks + p->n_bids;
+  in.seekg(static_cast<streamoff>(skip * static_cast<int64_t>(sizeof(BookLevel))), ios::cur);
+
+  out.ts        = it->ts;
+  out.last_id   = it->last_id;
+  out.after_gap = (it->flags & CKPT_AFTER_GAP) != 0;
+  out.asks.resize(static_cast<size_t>(it->n_asks));
+  out.bids.resize(static_cast<size_t>(it->n_bids));
+  in.read(reinterpret_cast<char*>(out.asks.data()), static_cast<streamsize>(out.asks.size() * sizeof(BookLevel)));
+  in.read(reinterpret_cast<char*>(out.bids.data()), static_cast<streamsize>(out.bids.size() * sizeof(BookLevel)));
+  if (!in)
+  {
+    cerr << "WARN: truncated checkpoint file " << checkpoint_path(shard) << "\n";
+    return false;
+  }
+  return true;
+}
+
+size_t ShardedDB::update_checkpoints(const string& market, const string& symb, int64_t every_ns)
+{
+  if (every_ns <= 0) throw runtime_error("checkpoint interval must be > 0");
+  auto nm = norm_market(market);
+  if (!nm) throw runtime_error("market must be 'fut' or 'spot'");
+  const string dir = shard_dir(impl_->root_, "depth", *nm, symb);
+  const int64_t day_ns = 86'400'000'000'000LL;
+
+  vector<Candidate> files;
+  std::error_code ec;
+  for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec))
+  {
+    if (!it->is_regular_file(ec) || it->path().extension() != ".parquet") continue;
+    int64_t day_start = 0;
+    if (!day_from_name(it->path().string(), day_start)) continue;
+    files.push_back(Candidate{it->path().string(), day_start, day_start + day_ns});
+  }
+  if (ec) throw runtime_error("checkpoint: cannot walk " + dir + " : " + ec.message());
+  sort(files.begin(), files.end(), [](const Candidate& a, const Candidate& b) { return a.file_start_ns < b.file_start_ns; });
+
+  // Everything from the first missing/stale sidecar on depends on the carried book
+  auto current = [every_ns](const Candidate& c)
+  {
+    ifstream in(checkpoint_path(c.path), ios::binary);
+    CkptFile f;
+    return in && read_ckpt_index(in, f) && f.stamp == file_stamp(c.path) && f.every_ns == every_ns;
+  };
+  size_t first = 0;
+  while (first < files.size() && current(files[first])) ++first;
+  if (first == files.size()) return 0;
+
+  BookOptions bo;
+  bo.depth     = numeric_limits<size_t>::max();
+  bo.every_ns  = every_ns;
+  bo.check_ids = (*nm == "spot");
+  BookBuilder book(bo);
+
+  DeltaSelect sel;
+  sel.eventTime = false;
+
+  CkptFile f;
+  vector<BookLevel> levels;
+  bool after_gap = false;  // sticky: the carried book went through an id gap or a missing day
+  auto record = [&](const BookSnapshot& snap)
+  {
+    after_gap = after_gap || snap.after_gap;
+    if (!f.index.empty() && snap.ts <= f.index.back().ts) return;
+    f.index.push_back(CkptEntry{snap.ts, snap.last_id, static_cast<int64_t>(snap.n_asks), static_cast<int64_t>(snap.n_bids),
+                                after_gap ? CKPT_AFTER_GAP : 0});
+    levels.insert(levels.end(), snap.asks, snap.asks + snap.n_asks);
+    levels.insert(levels.end(), snap.bids, snap.bids + snap.n_bids);
+  };
+  auto replay = [&](const Candidate& c, int64_t from_ns, bool keep)
+  {
+    DeltaBatchReader::Impl rdr({c}, from_ns, c.file_end_ns, sel, PipelineOptions{}, BatchOptions{}, impl_->opener());
+    rdr.strict_ = true;  // a day that cannot be read must not be checkpointed as empty
+    DeltaColsView v;
+    BookSnapshot snap;
+    while (rdr.next(v))
+    {
+      book.feed(v);
+      while (book.next(snap)) if (keep) record(snap);
+    }
+  };
+
+  // A failed day ends the run: its sidecar and every later one are removed (they
+  // would carry a half-applied book), so the next run resumes from the last good day
+  size_t i = first;
+  auto fail = [&](const exception& e)
+  {
+    for (size_t k = i; k < files.size(); ++k) fs::remove(checkpoint_path(files[k].path), ec);
+    throw runtime_error("checkpoint: " + files[i].path + " : " + e.what());
+  };
+
+  // Resume from the previous day's last checkpoint (an empty book without one,
+  // which counts as a gap)
+  if (first > 0)
+  {
+    BookCheckpoint c;
+    const Candidate& prev = files[first - 1];
+    if (load_checkpoint(prev.path, prev.file_end_ns, c, true))
+    {
+      book.load(c);
+      after_gap = c.after_gap;
+      try { replay(prev, c.ts, false); }
+      catch (const exception& e) { fail(e); }
+    }
+    else after_gap = true;
+  }
+
+  size_t written = 0;
+  for (; i < files.size(); ++i)
+  {
+    const Candidate& c = files[i];
+    f = CkptFile{};
+    f.stamp    = file_stamp(c.path);
+    f.every_ns = every_ns;
+    levels.clear();
+    if (i > 0 && files[i - 1].file_end_ns != c.file_start_ns) after_gap = true;  // missing day(s)
+
+    BookSnapshot snap;
+    book.snapshot(snap);
+    snap.ts = c.file_start_ns;
+    record(snap);
+
+    try
+    {
+      replay(c, c.file_start_ns, true);
+      save_checkpoints(checkpoint_path(c.path), f, levels);
+    }
+    catch (const exception& e) { fail(e); }
+    ++written;
+    if (g_debug) cerr << "[debug] checkpoint: " << c.path << " : " << f.index.size() << " books\n";
+  }
+  return written;
+}
+
+optional<BookCheckpoint> ShardedDB::find_checkpoint(int64_t at_ns, const string& symb, const string& market, bool allow_after_gap) const
+{
+  const int64_t day = floor_day_ns(at_ns);
+  auto files = candidate_files_strict(impl_->root_, symb, "depth", market, day, day + 86'400'000'000'000LL);
+
+  BookCheckpoint c;
+  for (const auto& f : files)
+    if (load_checkpoint(f.path, at_ns, c, allow_after_gap)) return c;
+  return nullopt;
+}
@@ -7,6 +7,7 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -21,7 +22,7 @@ struct TopColsView
   const int64_t* bid_qty  = nullptr;
   const int64_t* valu     = nullptr;
 
-  // Sampled extra columns (present when reading sampled top_px files)
+  // Sampled extra columns (present when reading sampled top_px / top_<S> files)
   const int64_t* min_bid_px = nullptr;
   const int64_t* max_bid_px = nullptr;
   const int64_t* min_ask_px = nullptr;
@@ -70,6 +71,74 @@ struct TradeColsView
   size_t n = 0;
 };
 
+// ======== Arrow C Data Interface (ABI structs as published by Apache Arrow) ========
+//
+// Batch readers export their current batch through these (see export_arrow);
+// the guard lets this header coexist with arrow/c/abi.h or nanoarrow.
+
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+extern "C" {
+
+struct ArrowSchema
+{
+  const char* format;
+  const char* name;
+  const char* metadata;
+  int64_t flags;
+  int64_t n_children;
+  struct ArrowSchema** children;
+  struct ArrowSchema* dictionary;
+
+  void (*release)(struct ArrowSchema*);
+  void* private_data;
+};
+
+struct ArrowArray
+{
+  int64_t length;
+  int64_t null_count;
+  int64_t offset;
+  int64_t n_buffers;
+  int64_t n_children;
+  const void** buffers;
+  struct ArrowArray** children;
+  struct ArrowArray* dictionary;
+
+  void (*release)(struct ArrowArray*);
+  void* private_data;
+};
+
+}  // extern "C"
+
+#endif  // ARROW_C_DATA_INTERFACE
+
+// ======== Row filters (pushed down into the batch readers) ========
+
+// A Select's `where` is a conjunction of "column op constant" terms on the raw
+// int64 values (px/qty scaled 1e8, isMarket 0/1), e.g.
+//   TradeSelect sel; sel.where = {{TradeField::qty, CmpOp::Gt, 5'000'000'000}, {TradeField::isMarket, CmpOp::Eq, 1}};
+// Row groups whose footer min/max prove that no row can pass are skipped; in the
+// rest the filter columns are decoded first into a per-row selection mask and
+// only the surviving rows of the selected columns are kept.
+enum class CmpOp { Lt, Le, Gt, Ge, Eq, Ne };
+
+enum class TopField   { ts, ask_px, ask_qty, bid_px, bid_qty, valu, spread };  // spread = ask_px - bid_px
+enum class TradeField { ts, px, qty, tradeId, buyerOrderId, sellerOrderId, tradeTime, isMarket, eventTime };
+
+template <class Field>
+struct Term
+{
+  Field   col;
+  CmpOp   op;
+  int64_t value;
+};
+
 // ======== Column selection ========
 
 struct TopSelect
@@ -90,6 +159,8 @@ struct TopSelect
   bool max_bid_ts = false;
   bool min_ask_ts = false;
   bool max_ask_ts = false;
+
+  std::vector<Term<TopField>> where;  // row filter (see Row filters above); empty = all rows
 };
 
 struct DeltaSelect
@@ -116,6 +187,289 @@ struct TradeSelect
   bool tradeTime     = true;
   bool isMarket      = true;
   bool eventTime     = true;
+
+  std::vector<Term<TradeField>> where;  // row filter (see Row filters above); empty = all rows
+};
+
+// ======== Reader options ========
+
+// Opt-in background decoding: worker threads decode the next row groups (across
+// file boundaries) into a bounded queue that next() drains in file/row-group order.
+struct PipelineOptions
+{
+  unsigned threads   = 0;           // 0 = decode on the caller's thread (default)
+  size_t   depth     = 8;           // max row groups decoded ahead of the consumer
+  size_t   max_bytes = 256u << 20;  // cap on decoded-but-not-yet-consumed bytes
+};
+
+// Batch sizing of next(). By default a batch is one filtered row group, however
+// the files were written (40 rows or 2M). max_rows cuts batches into zero-copy
+// slices of at most that many rows (e.g. 32768: 256 KiB per int64 column);
+// target_rows appends the following row groups, across files, to a smaller
+// batch until it holds that many rows (copied into one buffer). 0 = off.
+struct BatchOptions
+{
+  size_t target_rows = 0;
+  size_t max_rows    = 0;
+};
+
+// How shard files are read. Pread suits local NVMe with a warm page cache,
+// Mmap avoids a copy when the same files are re-read, Uring batches the selected
+// column chunks of all matching row groups of a file into a few large reads
+// (needs a build with -DPQ_WITH_URING -luring, otherwise it falls back to Pread).
+enum class IoBackend { Pread, Mmap, Uring };
+
+struct IoOptions
+{
+  IoBackend backend     = IoBackend::Pread;
+  size_t    buffer_size = 0;   // Pread/Uring: >0 = buffered column streams of this many bytes
+  unsigned  queue_depth = 64;  // Uring: submission queue entries per open file
+};
+
+// Background warming of the files a reader will open next: the byte ranges of
+// the selected column chunks in row groups overlapping the window are hinted
+// to the kernel and the opened file is parked in the file cache for the reader.
+struct ReadAheadOptions
+{
+  bool     enabled      = false;
+  size_t   budget_bytes = 256u << 20;  // max bytes hinted per file
+  unsigned files_ahead  = 1;           // files queued ahead of the one being opened
+};
+
+// Per-reader counters; snapshot via stats() at any point between next() calls
+struct ReaderStats
+{
+  uint64_t files_opened       = 0;
+  uint64_t row_groups_skipped = 0;  // pruned by footer ts min/max, never decoded
+  uint64_t row_groups_decoded = 0;
+  uint64_t rows_decoded       = 0;  // rows of decoded row groups, before the ts filter
+  uint64_t rows_emitted       = 0;
+  uint64_t scratch_allocs     = 0;  // decode scratch blocks allocated; flat once the arenas are warm
+  uint64_t batches            = 0;
+};
+
+// Open-file cache counters (see ShardedDB::set_file_cache)
+struct FileCacheStats
+{
+  uint64_t hits      = 0;  // opens served by an idle cached reader (no open, no footer parse)
+  uint64_t misses    = 0;
+  uint64_t evictions = 0;
+  size_t   size      = 0;  // idle readers held now
+  size_t   capacity  = 0;
+};
+
+// Decoded column-chunk cache counters (see ShardedDB::set_chunk_cache)
+struct ChunkCacheStats
+{
+  uint64_t hits         = 0;  // chunk requests served without decoding (incl. waits on an in-flight decode)
+  uint64_t misses       = 0;
+  uint64_t evictions    = 0;
+  size_t   entries      = 0;
+  size_t   bytes        = 0;  // decoded bytes held now
+  size_t   budget_bytes = 0;
+};
+
+// ======== Merged multi-stream reading ========
+
+enum class StreamKind { Top, Trade, Depth };
+
+// One input of a merged read; only the select matching `kind` is used (its ts is forced on)
+struct StreamSpec
+{
+  StreamKind kind = StreamKind::Top;
+  std::string symb;
+  std::optional<std::string> market;  // "fut" | "spot"; nullopt = both
+  TopSelect   top{};
+  TradeSelect trade{};
+  DeltaSelect depth{};
+};
+
+// A run of consecutive rows of one stream, in global ts order. Only the view of
+// `kind` is set; its pointers are offset into the stream's current batch (no
+// copy) and stay valid until the next call to next(). For depth slices the
+// per-row columns (ts, ids, ask_off/bid_off) are offset, while ask_px/ask_qty/
+// bid_px/bid_qty are the batch's arrays, which the shifted offsets index into.
+struct MergedSlice
+{
+  size_t stream = 0;  // index into the specs given to get_merged()
+  StreamKind kind = StreamKind::Top;
+  TopColsView   top{};
+  TradeColsView trade{};
+  DeltaColsView depth{};
+  size_t n = 0;
+};
+
+// ======== Trade bars ========
+
+// Trades of one [ts, ts + bucket_ns) bucket; prices/quantities in the files' int64 units
+struct TradeBar
+{
+  int64_t  ts            = 0;  // bucket start (a multiple of bucket_ns)
+  int64_t  open          = 0;
+  int64_t  high          = 0;
+  int64_t  low           = 0;
+  int64_t  close         = 0;
+  int64_t  volume        = 0;  // sum qty
+  int64_t  volume_market = 0;  // sum qty of isMarket = 1 trades
+  int64_t  volume_other  = 0;  // sum qty of isMarket = 0 trades
+  double   notional      = 0;  // sum px * qty (raw px units x raw qty units)
+  double   vwap          = 0;  // notional / volume, raw px units
+  uint64_t trades        = 0;
+};
+
+// ======== Point-in-time top lookup ========
+
+// Prevailing top-of-book at a query ts: the last top row with ts <= query
+// (see ShardedDB::top_asof); found = false when there is none within the lookback
+struct TopAsOf
+{
+  bool    found   = false;
+  int64_t ts      = 0;  // ts of the prevailing row
+  int64_t ask_px  = 0;
+  int64_t ask_qty = 0;
+  int64_t bid_px  = 0;
+  int64_t bid_qty = 0;
+};
+
+// ======== Trade / top as-of join ========
+
+// One trade batch joined to the top-of-book prevailing at each trade: the last
+// top row with ts <= trade ts (see ShardedDB::join_trades_top). `trade` is the
+// trade reader's batch as is; the top columns run parallel to it, and
+// has_top[i] = 0 when no top row precedes trade i within the lookback (its top
+// fields are then 0). Valid until next() is called.
+struct TradeTopJoinView
+{
+  TradeColsView trade{};
+  const int64_t* top_ts  = nullptr;
+  const int64_t* ask_px  = nullptr;
+  const int64_t* ask_qty = nullptr;
+  const int64_t* bid_px  = nullptr;
+  const int64_t* bid_qty = nullptr;
+  const uint8_t* has_top = nullptr;  // 0/1
+  size_t n = 0;
+};
+
+// ======== Gap scan ========
+
+// Carried between find_gaps calls, so a stream's batches and files scan as one
+struct GapCarry
+{
+  bool    have_prev = false;
+  int64_t prev_ts   = 0;  // last ts of the previous call
+};
+
+// Gap statistics of a ts stream, added to by find_gaps. The gap of a row is its
+// ts minus the previous ts; a step back counts as a 0 gap (and as non_monotonic).
+struct GapStats
+{
+  uint64_t pairs         = 0;  // rows with a previous row
+  uint64_t non_monotonic = 0;  // ts < previous
+  uint64_t repeated      = 0;  // ts == previous
+  uint64_t max_gap_ns    = 0;
+  uint64_t sum_gap_ns    = 0;  // mean gap = sum_gap_ns / pairs
+  std::vector<int64_t>  bins_ns;  // ascending, non-negative lower bounds of the histogram bins
+  std::vector<uint64_t> hist;     // hist[k]: gaps in [bins_ns[k], bins_ns[k + 1])
+
+  GapStats() = default;
+  explicit GapStats(std::vector<int64_t> bins) : bins_ns(std::move(bins)), hist(bins_ns.size()) {}
+
+  // Gaps >= bins_ns[bin]
+  uint64_t at_least(size_t bin) const
+  {
+    uint64_t n = 0;
+    for (size_t k = bin; k < hist.size(); ++k) n += hist[k];
+    return n;
+  }
+};
+
+// Scans ts[0, n) as the continuation of carry (ts[0] pairs with carry.prev_ts
+// when carry.have_prev) and leaves ts[n - 1] in it. The positions i whose gap
+// ts[i] - previous >= threshold_ns replace *gaps (nullptr: only counted); the
+// batch is added to *stats when given. Returns the number of such gaps.
+size_t find_gaps(const int64_t* ts, size_t n, int64_t threshold_ns, GapCarry& carry,
+                 std::vector<uint32_t>* gaps, GapStats* stats = nullptr);
+
+// ======== L2 order book reconstruction ========
+
+struct BookLevel
+{
+  int64_t px  = 0;
+  int64_t qty = 0;
+};
+
+struct BookOptions
+{
+  size_t   depth         = 20;    // levels per side in a snapshot
+  int64_t  every_ns      = 0;     // snapshot at every multiple of this ts step (book before the first row at/after it); 0 = off
+  uint64_t every_updates = 0;     // snapshot after every N applied rows; 0 = off
+  bool     check_ids     = true;  // spot diff-depth: firstId must be the previous lastId + 1 (off for futures)
+};
+
+// Top of the book, best level first; arrays valid until the next BookBuilder call
+struct BookSnapshot
+{
+  int64_t ts      = 0;
+  int64_t last_id = 0;
+  const BookLevel* asks = nullptr;
+  const BookLevel* bids = nullptr;
+  size_t n_asks = 0;
+  size_t n_bids = 0;
+  bool after_gap = false;  // a firstId/lastId break happened since the previous snapshot
+};
+
+struct BookStats
+{
+  uint64_t rows          = 0;  // delta rows applied
+  uint64_t level_updates = 0;
+  uint64_t gaps          = 0;  // firstId > previous lastId + 1
+  uint64_t stale_rows    = 0;  // lastId <= previous lastId, skipped
+  uint64_t snapshots     = 0;
+  size_t   ask_levels    = 0;  // current book size
+  size_t   bid_levels    = 0;
+};
+
+// Full book at ts: the state after every depth row with ts < this ts (see
+// ShardedDB::update_checkpoints / find_checkpoint)
+struct BookCheckpoint
+{
+  int64_t ts      = 0;
+  int64_t last_id = 0;
+  bool after_gap  = false;      // an id gap or missing day precedes it in the carried chain; levels may be stale
+  std::vector<BookLevel> asks;  // best first
+  std::vector<BookLevel> bids;  // best first
+};
+
+// Applies depth deltas (qty 0 = remove the level) to flat sorted price arrays,
+// one per side, kept best-last so updates near the top move few elements.
+// Needs ts plus the px/qty lists of each side in the view, firstId/lastId for the
+// sequence check. Usage: feed(batch), then next(snap) until false, repeat.
+class BookBuilder
+{
+public:
+  explicit BookBuilder(BookOptions opt = {});
+  ~BookBuilder();
+  BookBuilder(BookBuilder&&) noexcept;
+  BookBuilder& operator=(BookBuilder&&) noexcept;
+  BookBuilder(const BookBuilder&) = delete;
+  BookBuilder& operator=(const BookBuilder&) = delete;
+
+  // Next batch to apply (the view must stay valid until next() returns false)
+  void feed(const DeltaColsView& v);
+  // Apply rows of the fed batch up to the next due snapshot; false once the batch is applied
+  bool next(BookSnapshot& out);
+  // Current top of the book at any time
+  void snapshot(BookSnapshot& out);
+  // Drop all levels and the sequence state (e.g. to rebuild after a gap)
+  void clear();
+  // Replace the book with a checkpoint; feed deltas from c.ts on afterwards
+  void load(const BookCheckpoint& c);
+
+  BookStats stats() const;
+
+private:
+  struct Impl;
+  std::unique_ptr<Impl> impl_;
 };
 
 // ======== Public DB + columnar-batch readers ========
@@ -132,8 +486,56 @@ public:
 
   // Enable/disable verbose debug printing (file discovery + processing)
   static void set_debug(bool enabled);
-  // Enable/disable Linux prefetch (posix_fadvise/readahead)
+  // Enable/disable read-ahead (default ReadAheadOptions) for DBs without set_readahead()
   static void set_prefetch(bool enabled);
+  // Back decode scratch arenas with transparent huge pages (Linux madvise)
+  static void set_huge_pages(bool enabled);
+  // Decode depth ask/bid lists entry by entry (the pre-bulk path; for benchmarks)
+  static void set_legacy_depth_decode(bool enabled);
+  // Share decoded flat column chunks (file, row group, column) between all
+  // readers of the process, LRU within budget_bytes; 0 (default) disables.
+  // Applies to readers created after this call.
+  static void set_chunk_cache(size_t budget_bytes);
+  static ChunkCacheStats chunk_cache_stats();
+
+  // Background row-group decoding for readers created after this call
+  void set_pipeline(PipelineOptions opt);
+  // Batch sizing (split / coalesce row groups) for readers created after this call
+  void set_batch(BatchOptions opt);
+  // File access backend for readers created after this call
+  void set_io(IoOptions opt);
+
+  // Keep up to `capacity` idle opened files (reader + parsed footer, LRU) for
+  // later queries to reuse; default 64, 0 disables. Safe to share across threads.
+  void set_file_cache(size_t capacity);
+  FileCacheStats file_cache_stats() const;
+  // Async read-ahead of the next files for readers created after this call
+  void set_readahead(ReadAheadOptions opt);
+
+  // Discover files through <kind>_<market>/<SYMB>/_manifest.tsv where present (default on)
+  void set_use_manifest(bool enabled);
+  // (Re)write that manifest; only new or changed files are opened. Returns files listed.
+  // Run it after backfilling days older than the last listed file, or they are not found
+  size_t update_manifest(const std::string& kind, const std::string& market, const std::string& symb);
+
+  // (Re)write the <shard>.ckpt book checkpoints (every every_ns, carried across
+  // days) of the depth files of symb; from the first missing or stale sidecar on.
+  // Returns files written. Throws at the first day that cannot be read, after
+  // removing the sidecars from that day on; the next run resumes there.
+  size_t update_checkpoints(const std::string& market, const std::string& symb, int64_t every_ns = 60'000'000'000LL);
+  // Latest checkpoint at or before at_ns in the depth shard of that day, if its
+  // sidecar is current; books marked after_gap only with allow_after_gap.
+  // Replay: book.load(*c), then get_depth_cols(c->ts, end, ...).
+  std::optional<BookCheckpoint> find_checkpoint(int64_t at_ns, const std::string& symb, const std::string& market,
+                                                bool allow_after_gap = false) const;
+
+  // Prevailing top row for each of query_ts (any order; results in the same
+  // order), from rows no older than lookback_ns before its query. One pass in
+  // ts order: row groups that own no query are pruned by their ts statistics,
+  // the others are decoded once and searched by binary search.
+  std::vector<TopAsOf> top_asof(const std::string& symb, const std::string& market,
+                                std::span<const int64_t> query_ts,
+                                int64_t lookback_ns = 86'400'000'000'000LL) const;
 
   struct TopBatchReader
   {
@@ -146,6 +548,15 @@ public:
     explicit TopBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(TopColsView& out);
+    ReaderStats stats() const;
+
+    // The batch of the last successful next() as a non-nullable struct array of
+    // the selected columns (int64 "l"; isMarket uint8 "C"; depth sides
+    // list<struct<px, qty>> "+l"). Zero-copy: the batch's column storage is kept
+    // alive until out->release, independently of further next() calls. Both
+    // structs are filled (caller-owned, released by the caller); false if there
+    // is no current batch.
+    bool export_arrow(ArrowArray* out, ArrowSchema* schema);
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -164,6 +575,8 @@ public:
     explicit TradeBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(TradeColsView& out);
+    ReaderStats stats() const;
+    bool export_arrow(ArrowArray* out, ArrowSchema* schema);  // see TopBatchReader
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -182,6 +595,8 @@ public:
     explicit DeltaBatchReader(std::unique_ptr<Impl> impl);
 
     bool next(DeltaColsView& out);
+    ReaderStats stats() const;
+    bool export_arrow(ArrowArray* out, ArrowSchema* schema);  // see TopBatchReader
 
   private:
     std::unique_ptr<Impl> impl_;
@@ -189,6 +604,68 @@ public:
     DeltaBatchReader& operator=(DeltaBatchReader&) = delete;
   };
 
+  // K-way ts merge of several streams; ties go to the lower spec index
+  struct MergedReader
+  {
+    struct Impl;
+
+    MergedReader(MergedReader&&) noexcept;
+    MergedReader& operator=(MergedReader&&) noexcept;
+    ~MergedReader();
+
+    explicit MergedReader(std::unique_ptr<Impl> impl);
+
+    bool next(MergedSlice& out);
+    ReaderStats stats() const;  // summed over the underlying readers
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    MergedReader(const MergedReader&) = delete;
+    MergedReader& operator=(const MergedReader&) = delete;
+  };
+
+  // Time bars over a trade stream: one bar per bucket, in bucket order, even
+  // when trades arrive out of ts order; buckets without trades are not emitted
+  struct TradeBarReader
+  {
+    struct Impl;
+
+    TradeBarReader(TradeBarReader&&) noexcept;
+    TradeBarReader& operator=(TradeBarReader&&) noexcept;
+    ~TradeBarReader();
+
+    explicit TradeBarReader(std::unique_ptr<Impl> impl);
+
+    bool next(TradeBar& out);
+    ReaderStats stats() const;  // of the underlying trade reader
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TradeBarReader(const TradeBarReader&) = delete;
+    TradeBarReader& operator=(const TradeBarReader&) = delete;
+  };
+
+  // Streaming as-of join of a trade stream against the top stream of the same
+  // symbol (see TradeTopJoinView); one forward pass, one batch of each held
+  struct TradeTopJoinReader
+  {
+    struct Impl;
+
+    TradeTopJoinReader(TradeTopJoinReader&&) noexcept;
+    TradeTopJoinReader& operator=(TradeTopJoinReader&&) noexcept;
+    ~TradeTopJoinReader();
+
+    explicit TradeTopJoinReader(std::unique_ptr<Impl> impl);
+
+    bool next(TradeTopJoinView& out);
+    ReaderStats stats() const;  // summed over the trade and top readers
+
+  private:
+    std::unique_ptr<Impl> impl_;
+    TradeTopJoinReader(const TradeTopJoinReader&) = delete;
+    TradeTopJoinReader& operator=(const TradeTopJoinReader&) = delete;
+  };
+
   // New overloads (market-aware): market = "fut" | "spot"
   std::unique_ptr<TopBatchReader>   get_top_cols  (int64_t start_ns, int64_t end_ns, const std::string& symb, std::optional<std::string> market, TopSelect sel = {}) const;
   std::unique_ptr<TradeBatchReader> get_trade_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, std::optional<std::string> market, TradeSelect sel = {}) const;
@@ -199,8 +676,23 @@ public:
   std::unique_ptr<TradeBatchReader> get_trade_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, TradeSelect sel = {}) const;
   std::unique_ptr<DeltaBatchReader> get_depth_cols(int64_t start_ns, int64_t end_ns, const std::string& symb, DeltaSelect sel = {}) const;
 
+  std::unique_ptr<MergedReader> get_merged(int64_t start_ns, int64_t end_ns, const std::vector<StreamSpec>& specs) const;
+
+  // OHLC / volume / notional / VWAP / trade count per bucket_ns bucket of
+  // [start_ns, end_ns); one market ("fut" | "spot"), bars never mix instruments
+  std::unique_ptr<TradeBarReader> aggregate_trades(int64_t start_ns, int64_t end_ns, const std::string& symb,
+                                                   const std::string& market, int64_t bucket_ns) const;
+
+  // Trades of [start_ns, end_ns) (columns per sel) with the prevailing top row
+  // of each. The row in effect at start_ns comes from one top_asof lookup and
+  // the top stream is read from start_ns on; a row older than lookback_ns
+  // before its trade does not count. Top rows need not be sorted within a
+  // batch; trades are expected in ts order
+  std::unique_ptr<TradeTopJoinReader> join_trades_top(int64_t start_ns, int64_t end_ns, const std::string& symb,
+                                                      const std::string& market, TradeSelect sel = {},
+                                                      int64_t lookback_ns = 86'400'000'000'000LL) const;
+
 private:
   struct Impl;
   std::unique_ptr<Impl> impl_;
 };
-
@@ -0,0 +1,208 @@
+// parquet_text_out.h
+// Buffered text output for parquet_reader: fields are formatted straight into one
+// reusable byte buffer (std::to_chars, integer fixed point for the 1e8-scaled
+// px/qty, ISO timestamps with the per-second prefix cached) and the buffer goes
+// out with a single fwrite per flush. No iostreams, no allocation per row.
+
+#pragma once
+
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+class TextOut
+{
+public:
+  // f = nullptr: an in-memory line buffer (see view()/clear()), never flushed
+  explicit TextOut(std::FILE* f = nullptr, size_t flush_at = size_t{1} << 20)
+  : f_(f), flush_at_(flush_at)
+  {
+    buf_.resize(f ? flush_at + 4096 : 256);
+  }
+
+  ~TextOut() { flush(); }
+
+  TextOut(TextOut&& o) noexcept { swap(o); }
+  TextOut& operator=(TextOut&& o) noexcept { swap(o); return *this; }
+  TextOut(const TextOut&) = delete;
+  TextOut& operator=(const TextOut&) = delete;
+
+  void swap(TextOut& o) noexcept
+  {
+    std::swap(f_, o.f_);
+    std::swap(flush_at_, o.flush_at_);
+    std::swap(buf_, o.buf_);
+    std::swap(len_, o.len_);
+    std::swap(sec_, o.sec_);
+    std::swap(prefix_, o.prefix_);
+  }
+
+  void put(char c) { *reserve(1) = c; ++len_; }
+
+  void put(std::string_view s)
+  {
+    char* p = reserve(s.size());
+    for (size_t i = 0; i < s.size(); ++i) p[i] = s[i];
+    len_ += s.size();
+  }
+
+  void put_i64(int64_t v)
+  {
+    char* p = reserve(20);
+    len_ = static_cast<size_t>(std::to_chars(p, p + 20, v).ptr - buf_.data());
+  }
+
+  void put_u64(uint64_t v)
+  {
+    char* p = reserve(20);
+    len_ = static_cast<size_t>(std::to_chars(p, p + 20, v).ptr - buf_.data());
+  }
+
+  // raw / 10^scale (scale <= 19) fixed with `precision` decimals, all in
+  // integers. Same text as printing the long double quotient with std::fixed:
+  // an exact tie is rounded the way that quotient's binary approximation
+  // rounds (snprintf, once per ~10^(scale - precision) values). Precisions past
+  // the long double's ~19 significant digits are padded with exact zeros.
+  void put_fixed(int64_t raw, int scale, int precision)
+  {
+    if (precision < 0) precision = 0;
+    const bool neg = raw < 0;
+    uint64_t u = neg ? 0 - static_cast<uint64_t>(raw) : static_cast<uint64_t>(raw);
+
+    int frac = scale;   // decimals held in u
+    if (precision < scale)
+    {
+      const uint64_t d = POW10[scale - precision];
+      const uint64_t r = u % d;
+      if (r == d - r)
+      {
+        char* p = reserve(48 + static_cast<size_t>(precision));
+        const long double x = static_cast<long double>(raw) / static_cast<long double>(POW10[scale]);
+        len_ += static_cast<size_t>(std::snprintf(p, 48 + static_cast<size_t>(precision), "%.*Lf", precision, x));
+        return;
+      }
+      u /= d;
+      if (r > d - r) ++u;
+      frac = precision;
+    }
+
+    char* p = reserve(24 + static_cast<size_t>(precision));
+    char* q = p;
+    if (neg) *q++ = '-';
+    q = std::to_chars(q, q + 20, u / POW10[frac]).ptr;
+    if (precision > 0)
+    {
+      *q++ = '.';
+      uint64_t f = u % POW10[frac];
+      for (int k = frac - 1; k >= 0; --k) { q[k] = static_cast<char>('0' + f % 10); f /= 10; }
+      q += frac;
+      for (int k = frac; k < precision; ++k) *q++ = '0';
+    }
+    len_ = static_cast<size_t>(q - buf_.data());
+  }
+
+  // Same digits as printf("%.*f", precision, v)
+  void put_double_fixed(double v, int precision)
+  {
+    char* p = reserve(352 + static_cast<size_t>(precision));
+    len_ = static_cast<size_t>(std::to_chars(p, p + 352 + precision, v, std::chars_format::fixed, precision).ptr - buf_.data());
+  }
+
+  // YYYY-MM-DDTHH:MM:SS.mmmZ; gmtime_r runs only when the second changes
+  void put_iso_ms(int64_t ns)
+  {
+    const int64_t s  = ns / 1'000'000'000LL;
+    const int64_t ms = (ns / 1'000'000LL) % 1000;
+    if (s != sec_)
+    {
+      time_t t = static_cast<time_t>(s);
+      tm tm{};
+      gmtime_r(&t, &tm);
+      two(prefix_ + 0, (tm.tm_year + 1900) / 100);
+      two(prefix_ + 2, (tm.tm_year + 1900) % 100);
+      prefix_[4] = '-';
+      two(prefix_ + 5, tm.tm_mon + 1);
+      prefix_[7] = '-';
+      two(prefix_ + 8, tm.tm_mday);
+      prefix_[10] = 'T';
+      two(prefix_ + 11, tm.tm_hour);
+      prefix_[13] = ':';
+      two(prefix_ + 14, tm.tm_min);
+      prefix_[16] = ':';
+      two(prefix_ + 17, tm.tm_sec);
+      prefix_[19] = '.';
+      sec_ = s;
+    }
+    char* p = reserve(24);
+    for (int k = 0; k < 20; ++k) p[k] = prefix_[k];
+    p[20] = static_cast<char>('0' + ms / 100);
+    p[21] = static_cast<char>('0' + ms / 10 % 10);
+    p[22] = static_cast<char>('0' + ms % 10);
+    p[23] = 'Z';
+    len_ += 24;
+  }
+
+  // Ends a row; the buffer goes out once it holds flush_at bytes
+  void end_line()
+  {
+    put('\n');
+    if (f_ && len_ >= flush_at_) flush();
+  }
+
+  // Whole lines formatted elsewhere (e.g. view() of an in-memory TextOut);
+  // a block of flush_at bytes or more is written as is, after the buffer
+  void put_lines(std::string_view s)
+  {
+    if (f_ && s.size() >= flush_at_)
+    {
+      flush();
+      std::fwrite(s.data(), 1, s.size(), f_);
+      return;
+    }
+    put(s);
+    if (f_ && len_ >= flush_at_) flush();
+  }
+
+  void flush()
+  {
+    if (!f_ || len_ == 0) return;
+    std::fwrite(buf_.data(), 1, len_, f_);
+    len_ = 0;
+  }
+
+  void clear() { len_ = 0; }
+  std::string_view view() const { return std::string_view(buf_.data(), len_); }
+
+private:
+  static constexpr uint64_t POW10[20] = {
+    1ull, 10ull, 100ull, 1000ull, 10000ull, 100000ull, 1000000ull, 10000000ull,
+    100000000ull, 1000000000ull, 10000000000ull, 100000000000ull, 1000000000000ull,
+    10000000000000ull, 100000000000000ull, 1000000000000000ull, 10000000000000000ull,
+    100000000000000000ull, 1000000000000000000ull, 10000000000000000000ull };
+
+  static void two(char* p, int v)
+  {
+    p[0] = static_cast<char>('0' + v / 10);
+    p[1] = static_cast<char>('0' + v % 10);
+  }
+
+  // Room for n more bytes at the end (line buffers grow; the file buffer only
+  // grows for a row longer than its slack)
+  char* reserve(size_t n)
+  {
+    if (len_ + n > buf_.size()) buf_.resize((len_ + n) * 2);
+    return buf_.data() + len_;
+  }
+
+  std::FILE* f_ = nullptr;
+  size_t flush_at_ = 0;
+  std::vector<char> buf_;
+  size_t len_ = 0;
+  int64_t sec_ = INT64_MIN;  // second of the cached prefix_
+  char prefix_[20] = {};
+};
@@ -0,0 +1,337 @@
+// parquet_top_resample.cpp (tick top-of-book -> sampled top_<S>_<market> shards with min/max columns)
+// Build:
+//   g++ -std=gnu++23 -O3 -DNDEBUG parquet_top_resample.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_top_resample
+//
+// Usage:
+//   parquet_top_resample <root> <symb> <spot|fut> [samplings_csv=100ms,1s,60s]
+//                        [--start=SEC] [--end=SEC] [--threads=N] [--force] [--debug]
+//
+// Reads the tick top stream of every day through ShardedDB::get_top_cols and
+// writes, per sampling S, one shard per day in the strict layout:
+//   <root>/top_<S>_<market>/<SYMB>/<Y>/<M>/bn_top_<S>_<market>_<SYMB>_<Y>_<M>_<D>.parquet
+// One row per non-empty bucket: ts = bucket start, ask/bid px/qty + valu = last
+// tick of the bucket, min/max_{bid,ask}_px over the bucket with the ts of their
+// first occurrence. ShardedDB(root, "<S>") reads them back (all samplings are
+// produced in one pass over the ticks; days run in parallel, existing outputs
+// are kept unless --force).
+
+#include "parquet_reader_lib.h"
+
+#include <arrow/io/file.h>
+#include <parquet/api/writer.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <filesystem>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+namespace fs = std::filesystem;
+
+static int64_t to_ns(double sec) { return static_cast<int64_t>(sec * 1e9); }
+
+static const int64_t DAY_NS = 86'400'000'000'000LL;
+
+enum Col { TS, ASK_PX, ASK_QTY, BID_PX, BID_QTY, VALU,
+           MIN_BID_PX, MAX_BID_PX, MIN_ASK_PX, MAX_ASK_PX,
+           MIN_BID_TS, MAX_BID_TS, MIN_ASK_TS, MAX_ASK_TS, NCOLS };
+static const char* COL_NAMES[NCOLS] = {
+  "ts", "ask_px", "ask_qty", "bid_px", "bid_qty", "valu",
+  "min_bid_px", "max_bid_px", "min_ask_px", "max_ask_px",
+  "min_bid_ts", "max_bid_ts", "min_ask_ts", "max_ask_ts" };
+
+struct Sampling
+{
+  string name;  // "100ms" | "1s" | "60s"
+  int64_t step_ns;
+};
+
+static vector<string> split_csv(const string& s)
+{
+  vector<string> out;
+  stringstream ss(s);
+  string x;
+  while (getline(ss, x, ',')) if (!x.empty()) out.push_back(x);
+  return out;
+}
+
+// Bucket start (floor, also for negative ts)
+static int64_t bucket_start(int64_t ts, int64_t step_ns)
+{
+  const int64_t r = ts % step_ns;
+  return r < 0 ? ts - r - step_ns : ts - r;
+}
+
+// One sampling's output columns for a day; ticks are folded in bucket runs.
+// Ticks out of ts order are merged into the row of their bucket (the last tick
+// is the one with the highest ts) and finish() puts the rows back in ts order.
+struct Sampler
+{
+  int64_t step_ns;
+  vector<int64_t> cols[NCOLS];
+  vector<int64_t> last_ts;              // ts of the tick behind each row's ask/bid/valu
+  unordered_map<int64_t, size_t> rows;  // bucket -> row, built on the first out-of-order bucket
+  bool unsorted = false;                // a tick came before an earlier one
+
+  explicit Sampler(int64_t step) : step_ns(step) {}
+
+  // Fold one batch; a bucket left open by the previous batch is continued
+  void add(const TopColsView& v)
+  {
+    if (v.n == 0) return;
+    if (!unsorted && ((!last_ts.empty() && v.ts[0] < last_ts.back()) || !is_sorted(v.ts, v.ts + v.n)))
+    {
+      unsorted = true;
+      for (size_t r = 0; r < cols[TS].size(); ++r) rows.emplace(cols[TS][r], r);
+    }
+
+    size_t i = 0;
+    while (i < v.n)
+    {
+      const int64_t b0 = bucket_start(v.ts[i], step_ns);
+      size_t j = i + 1;
+      while (j < v.n && v.ts[j] >= b0 && v.ts[j] - b0 < step_ns) ++j;
+      fold(v, i, j, row_of(b0, v.ts[i]));
+      i = j;
+    }
+  }
+
+  // Row of bucket b0, appended (seeded with tick t's prices) when new
+  size_t row_of(int64_t b0, int64_t t)
+  {
+    const size_t n = cols[TS].size();
+    if (n && cols[TS].back() == b0) return n - 1;
+    if (unsorted)
+    {
+      auto [it, fresh] = rows.emplace(b0, n);
+      if (!fresh) return it->second;
+    }
+    for (auto& c : cols) c.push_back(0);
+    cols[TS].back() = b0;
+    cols[MIN_BID_PX].back() = cols[MIN_ASK_PX].back() = numeric_limits<int64_t>::max();
+    cols[MAX_BID_PX].back() = cols[MAX_ASK_PX].back() = numeric_limits<int64_t>::min();
+    cols[MIN_BID_TS].back() = cols[MAX_BID_TS].back() = t;
+    cols[MIN_ASK_TS].back() = cols[MAX_ASK_TS].back() = t;
+    last_ts.push_back(numeric_limits<int64_t>::min());
+    return n;
+  }
+
+  // Ticks [i, j) into row r; a px tie keeps the earlier ts
+  void fold(const TopColsView& v, size_t i, size_t j, size_t r)
+  {
+    int64_t min_b = cols[MIN_BID_PX][r], max_b = cols[MAX_BID_PX][r];
+    int64_t min_a = cols[MIN_ASK_PX][r], max_a = cols[MAX_ASK_PX][r];
+    int64_t min_b_ts = cols[MIN_BID_TS][r], max_b_ts = cols[MAX_BID_TS][r];
+    int64_t min_a_ts = cols[MIN_ASK_TS][r], max_a_ts = cols[MAX_ASK_TS][r];
+    int64_t last = last_ts[r];
+    size_t at = SIZE_MAX;
+    for (size_t k = i; k < j; ++k)
+    {
+      const int64_t t = v.ts[k];
+      if (v.bid_px[k] < min_b || (v.bid_px[k] == min_b && t < min_b_ts)) { min_b = v.bid_px[k]; min_b_ts = t; }
+      if (v.bid_px[k] > max_b || (v.bid_px[k] == max_b && t < max_b_ts)) { max_b = v.bid_px[k]; max_b_ts = t; }
+      if (v.ask_px[k] < min_a || (v.ask_px[k] == min_a && t < min_a_ts)) { min_a = v.ask_px[k]; min_a_ts = t; }
+      if (v.ask_px[k] > max_a || (v.ask_px[k] == max_a && t < max_a_ts)) { max_a = v.ask_px[k]; max_a_ts = t; }
+      if (t >= last) { last = t; at = k; }
+    }
+    cols[MIN_BID_PX][r] = min_b; cols[MIN_BID_TS][r] = min_b_ts;
+    cols[MAX_BID_PX][r] = max_b; cols[MAX_BID_TS][r] = max_b_ts;
+    cols[MIN_ASK_PX][r] = min_a; cols[MIN_ASK_TS][r] = min_a_ts;
+    cols[MAX_ASK_PX][r] = max_a; cols[MAX_ASK_TS][r] = max_a_ts;
+
+    if (at == SIZE_MAX) return;
+    last_ts[r]       = last;
+    cols[ASK_PX][r]  = v.ask_px[at];
+    cols[ASK_QTY][r] = v.ask_qty[at];
+    cols[BID_PX][r]  = v.bid_px[at];
+    cols[BID_QTY][r] = v.bid_qty[at];
+    cols[VALU][r]    = v.valu ? v.valu[at] : 0;
+  }
+
+  // Rows in bucket order (only needed after out-of-order ticks)
+  void finish()
+  {
+    if (!unsorted || is_sorted(cols[TS].begin(), cols[TS].end())) return;
+    vector<size_t> order(cols[TS].size());
+    iota(order.begin(), order.end(), size_t{0});
+    sort(order.begin(), order.end(), [&](size_t a, size_t b) { return cols[TS][a] < cols[TS][b]; });
+    vector<int64_t> tmp(order.size());
+    for (auto& c : cols)
+    {
+      for (size_t k = 0; k < order.size(); ++k) tmp[k] = c[order[k]];
+      c.swap(tmp);
+    }
+  }
+};
+
+// All-INT64 REQUIRED columns, zstd, footer statistics on (ts pruning); tmp + rename
+static void write_shard(const string& path, const vector<int64_t> (&cols)[NCOLS])
+{
+  using parquet::schema::GroupNode;
+  using parquet::schema::PrimitiveNode;
+
+  parquet::schema::NodeVector fields;
+  for (const char* name : COL_NAMES)
+    fields.push_back(PrimitiveNode::Make(name, parquet::Repetition::REQUIRED, parquet::Type::INT64, parquet::ConvertedType::NONE));
+  auto schema = static_pointer_cast<GroupNode>(GroupNode::Make("schema", parquet::Repetition::REQUIRED, fields));
+
+  parquet::WriterProperties::Builder props;
+  props.compression(parquet::Compression::ZSTD);
+  props.enable_statistics();
+
+  fs::create_directories(fs::path(path).parent_path());
+  const string tmp = path + ".tmp";
+  PARQUET_ASSIGN_OR_THROW(auto out, arrow::io::FileOutputStream::Open(tmp));
+  auto writer = parquet::ParquetFileWriter::Open(out, schema, props.build());
+
+  const int64_t rows = static_cast<int64_t>(cols[TS].size());
+  const int64_t rg_rows = 1 << 20;
+  for (int64_t off = 0; off < rows; off += rg_rows)
+  {
+    const int64_t n = min(rg_rows, rows - off);
+    parquet::RowGroupWriter* rg = writer->AppendRowGroup();
+    for (const auto& c : cols)
+      static_cast<parquet::Int64Writer*>(rg->NextColumn())->WriteBatch(n, nullptr, nullptr, c.data() + off);
+  }
+  writer->Close();
+  PARQUET_THROW_NOT_OK(out->Close());
+  fs::rename(tmp, path);
+}
+
+static string shard_path(const string& root, const string& kind, const string& mkt, const string& symb, int64_t day_ns)
+{
+  time_t s = static_cast<time_t>(day_ns / 1'000'000'000LL);
+  tm tm{};
+  gmtime_r(&s, &tm);
+  const int y = tm.tm_year + 1900, m = tm.tm_mon + 1, d = tm.tm_mday;
+
+  ostringstream p;
+  p << root << '/' << kind << '_' << mkt << '/' << symb << '/' << y << '/' << m << '/'
+    << "bn_" << kind << '_' << mkt << '_' << symb << '_' << y << '_' << m << '_' << d << ".parquet";
+  return p.str();
+}
+
+int main(int argc, char** argv)
+{
+  if (argc < 4) {
+    cerr << "Usage: " << argv[0] << " <root> <symb> <spot|fut> [samplings_csv=100ms,1s,60s]\n"
+         << "        [--start=SEC] [--end=SEC] (default: 2023-01-01 .. 2036-01-01)\n"
+         << "        [--threads=N]             (days in parallel; default: hardware threads)\n"
+         << "        [--force]                 (rewrite existing outputs)\n"
+         << "        [--debug]\n";
+    return 1;
+  }
+
+  const string root = argv[1];
+  const string symb = argv[2];
+  const string mkt  = argv[3];
+  if (mkt != "spot" && mkt != "fut") { cerr << "ERROR: market must be spot|fut\n"; return 1; }
+
+  vector<string> names = {"100ms", "1s", "60s"};
+  double start_sec = 1672531200.0;  // 2023-01-01
+  double end_sec   = 2082758400.0;  // 2036-01-01
+  unsigned threads = max(1u, thread::hardware_concurrency());
+  bool force = false;
+  bool debug = false;
+
+  int pos = 0;
+  for (int i = 4; i < argc; ++i) {
+    string a = argv[i];
+    try {
+      if (a.rfind("--start=",0)==0)        start_sec = stod(a.substr(8));
+      else if (a.rfind("--end=",0)==0)     end_sec = stod(a.substr(6));
+      else if (a.rfind("--threads=",0)==0) threads = max(1u, static_cast<unsigned>(stoul(a.substr(10))));
+      else if (a == "--force")             force = true;
+      else if (a == "--debug")             debug = true;
+      else if (pos == 0)                   { names = split_csv(a); ++pos; }
+      else { cerr << "ERROR: unexpected argument " << a << "\n"; return 1; }
+    } catch (...) { cerr << "ERROR: bad value in " << a << "\n"; return 1; }
+  }
+  if (end_sec <= start_sec) { cerr << "ERROR: end <= start\n"; return 1; }
+
+  vector<Sampling> samplings;
+  for (const auto& n : names) {
+    if (n == "100ms")    samplings.push_back({n, 100'000'000LL});
+    else if (n == "1s")  samplings.push_back({n, 1'000'000'000LL});
+    else if (n == "60s") samplings.push_back({n, 60'000'000'000LL});
+    else { cerr << "ERROR: sampling must be 100ms, 1s or 60s\n"; return 1; }
+  }
+
+  ShardedDB::set_debug(debug);
+  ShardedDB db(root);
+  db.set_file_cache(0);  // every day file is read once
+
+  vector<int64_t> days;
+  for (int64_t d = to_ns(start_sec) - to_ns(start_sec) % DAY_NS; d < to_ns(end_sec); d += DAY_NS) days.push_back(d);
+
+  TopSelect sel;  // tick columns only (ts, ask/bid px/qty, valu)
+
+  atomic<size_t> next{0};
+  atomic<size_t> written{0};
+  atomic<bool> failed{false};
+  mutex out_m;
+
+  auto work = [&] {
+    for (size_t k = next++; k < days.size(); k = next++) {
+      const int64_t day = days[k];
+
+      vector<string> paths;
+      bool todo = force;
+      for (const auto& s : samplings) {
+        paths.push_back(shard_path(root, "top_" + s.name, mkt, symb, day));
+        if (!fs::exists(paths.back())) todo = true;
+      }
+      if (!todo) continue;
+
+      try {
+        vector<Sampler> out;
+        for (const auto& s : samplings) out.emplace_back(s.step_ns);
+
+        auto rdr = db.get_top_cols(day, day + DAY_NS, symb, mkt, sel);
+        TopColsView v;
+        uint64_t ticks = 0;
+        while (rdr->next(v)) {
+          for (auto& s : out) s.add(v);
+          ticks += v.n;
+        }
+        if (ticks == 0) continue;
+        for (auto& sm : out) sm.finish();
+        if (!out.empty() && out[0].unsorted) {
+          lock_guard<mutex> lk(out_m);
+          cerr << "WARN: " << symb << " " << mkt << " day " << day / 1'000'000'000LL
+               << " : ticks out of ts order, merged into their buckets\n";
+        }
+
+        for (size_t i = 0; i < out.size(); ++i) {
+          if (!force && fs::exists(paths[i])) continue;
+          write_shard(paths[i], out[i].cols);
+          ++written;
+          lock_guard<mutex> lk(out_m);
+          cout << paths[i] << ": " << out[i].cols[TS].size() << " rows from " << ticks << " ticks\n";
+        }
+      } catch (const exception& e) {
+        lock_guard<mutex> lk(out_m);
+        cerr << "ERROR: " << symb << " " << mkt << " day " << day / 1'000'000'000LL << " : " << e.what() << "\n";
+        failed = true;
+      }
+    }
+  };
+
+  vector<thread> pool;
+  for (unsigned t = 1; t < min<size_t>(threads, days.size()); ++t) pool.emplace_back(work);
+  work();
+  for (auto& t : pool) t.join();
+
+  cerr << written << " shards written\n";
+  return failed ? 2 : 0;
+}
@@ -1,13 +1,15 @@
 // parquet_trade_spot_audit.cpp
 // Scan top_spot parquet files and detect anomalies.
 // Build:
-//   g++ -std=gnu++23 -O3 parquet_trade_spot_audit.cpp -lparquet -larrow -lzstd -o parquet_trade_spot_audit
+//   g++ -std=gnu++23 -O3 parquet_trade_spot_audit.cpp parquet_reader_lib.cpp -lparquet -larrow -lzstd -o parquet_trade_spot_audit
 //
 // Usage:
 //   ./parquet_trade_spot_audit /path/to/parquets output.ndjson [--all]
 //
 // Produces NDJSON; by default writes only files that have anomalies. Use --all to emit all files.
 
+#include "parquet_reader_lib.h"
+
 #include <parquet/api/reader.h>
 
 #include <filesystem>
@@ -119,9 +121,10 @@ static bool analyze_top_file(const string& path, FileMetric& out, string* err_ou
         out.has_valu = (idx_valu >= 0);
 
         Welford bid_px_w, ask_px_w, bid_qty_w, ask_qty_w, valu_w;
+        GapCarry gap_carry;   // ts gaps continue across row groups
+        GapStats gap_stats({1'000'000'000LL});
 
         // to detect duplicate consecutive snapshots: remember previous tuple
-        int64_t prev_ts = 0;
         int64_t prev_bid_px=LLONG_MIN, prev_ask_px=LLONG_MIN, prev_bid_qty=LLONG_MIN, prev_ask_qty=LLONG_MIN;
         bool have_prev = false;
 
@@ -146,6 +149,10 @@ static bool analyze_top_file(const string& path, FileMetric& out, string* err_ou
             if (out.has_ask_qty) nrows = min<int64_t>(nrows, (int64_t)v_ask_qty.size());
             if (out.has_valu) nrows = min<int64_t>(nrows, (int64_t)v_valu.size());
 
+            // time gaps, monotonicity and repeats of the scanned ts (>= 100ms counted, >= 1s binned)
+            if (out.has_ts && nrows > 0)
+                out.gaps_gt_100ms += find_gaps(v_ts.data(), (size_t)nrows, 100'000'000LL, gap_carry, nullptr, &gap_stats);
+
             for (int64_t i=0;i<nrows;++i) {
                 ++out.rows_scanned;
 
@@ -154,15 +161,6 @@ static bool analyze_top_file(const string& path, FileMetric& out, string* err_ou
                     int64_t t = v_ts[i];
                     if (t < out.ts_min) out.ts_min = t;
                     if (t > out.ts_max) out.ts_max = t;
-                    if (have_prev) {
-                        if (t < prev_ts) ++out.non_monotonic_ts;
-                        uint64_t gap = (t >= prev_ts) ? (uint64_t)(t - prev_ts) : 0;
-                        if (gap > out.max_gap_ns) out.max_gap_ns = gap;
-                        if (gap >= 100000000ULL) ++out.gaps_gt_100ms;
-                        if (gap >= 1000000000ULL) ++out.gaps_gt_1s;
-                        if (t == prev_ts) ++out.repeated_ts_count;
-                    }
-                    prev_ts = t;
                 } else {
                     ++out.null_ts;
                 }
@@ -243,6 +241,11 @@ static bool analyze_top_file(const string& path, FileMetric& out, string* err_ou
             } // rows in RG
         } // row groups
 
+        out.max_gap_ns = gap_stats.max_gap_ns;
+        out.gaps_gt_1s = gap_stats.at_least(0);
+        out.non_monotonic_ts = gap_stats.non_monotonic;
+        out.repeated_ts_count = gap_stats.repeated;
+
         out.bid_px_avg = (bid_px_w.n > 0) ? bid_px_w.mean : 0.0L;
         out.ask_px_avg = (ask_px_w.n > 0) ? ask_px_w.mean : 0.0L;
         out.bid_qty_avg = (bid_qty_w.n > 0) ? bid_qty_w.mean : 0.0L;